@@ -0,0 +1,197 @@
+// Задержка attach по UDP от отправки запроса до получения ответа (ping-pong
+// через loopback). UDP-поток сервера — RequestHandler и runSocketLoop в этом
+// процессе — работает в двух режимах: epoll (поток спит до прихода
+// датаграммы) и busy-poll (поток опрашивает сокет в цикле, udp_busy_poll).
+// Клиент всегда ждёт ответа в цикле опроса, чтобы его собственное
+// пробуждение не попадало в замер.
+//
+//   pgw_latency_bench [--requests N] [--sessions N] [--server-cpu C] [--client-cpu C]
+//                     [--mode epoll|busy|both] [--busy-poll-usec U]
+//
+// Для стабильных результатов сервер и клиент привязываются к разным
+// изолированным ядрам (isolcpus, nohz_full), сборка — Release.
+
+#include "udp_loop.h"
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Номер абонента в IMSI — 10 цифр
+constexpr size_t kMaxSessions = 10000000;
+
+struct Options {
+    size_t requests = 200000;
+    size_t sessions = 1000;
+    int server_cpu = -1;
+    int client_cpu = -1;
+    int busy_poll_usec = 50;
+    bool epoll = true;
+    bool busy = true;
+};
+
+bool pinTo(pthread_t thread, int cpu) {
+    if (cpu < 0) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+// IMSI 00101 и номер i (i < 10^10) в последних цифрах
+Imsi imsiAt(size_t i) {
+    char digits[] = "001010000000000";
+    for (size_t pos = sizeof(digits) - 2; i != 0; --pos, i /= 10) digits[pos] = static_cast<char>('0' + i % 10);
+    Imsi imsi;
+    parseImsi(digits, sizeof(digits) - 1, imsi);
+    return imsi;
+}
+
+double us(uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+void runMode(const Options& o, bool busy_poll) {
+    CdrWriterOptions cdr_options;
+    cdr_options.path = "/dev/null";
+    CdrWriter cdr(cdr_options);
+    cdr.start();
+    SessionTable sessions(64, o.sessions, std::chrono::seconds(3600));
+    BlacklistHolder blacklist(std::make_shared<const Blacklist>());
+    AdmissionControl admission(OverloadOptions{});
+    WorkerMetrics metrics;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sock < 0 || bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::perror("server socket");
+        std::exit(1);
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+    bool kernel_busy_poll = busy_poll && o.busy_poll_usec > 0 && enableBusyPoll(sock, o.busy_poll_usec);
+
+    std::atomic<bool> stop{false};
+    int shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    UdpLoopOptions loop;
+    loop.sock = sock;
+    loop.shutdown_fd = shutdown_fd;
+    loop.stop = &stop;
+    loop.batch_size = 32;
+    loop.busy_poll = busy_poll;
+    std::thread server([&]() {
+        RequestHandler handler(sessions, cdr, blacklist, admission, metrics, 0);
+        runSocketLoop(loop, handler, metrics);
+    });
+    if (!pinTo(server.native_handle(), o.server_cpu)) std::fprintf(stderr, "cannot pin server to CPU %d\n", o.server_cpu);
+
+    int client = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    connect(client, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    std::vector<std::array<uint8_t, kImsiBcdSize>> bcd(o.sessions);
+    for (size_t i = 0; i < o.sessions; ++i) encodeImsiBcd(imsiAt(i), bcd[i].data());
+
+    // Первый проход создаёт сессии и прогревает кэши; в замер идут обновления
+    LatencyHistogram rtt;
+    uint64_t lost = 0;
+    char reply[kMaxReply];
+    const size_t total = o.requests + o.sessions;
+    for (size_t i = 0; i < total; ++i) {
+        const auto& request = bcd[i % o.sessions];
+        auto t0 = Clock::now();
+        send(client, request.data(), request.size(), 0);
+        // sched_yield без других готовых потоков на ядре сразу возвращается,
+        // а на общем ядре отдаёт его серверу
+        ssize_t n;
+        while ((n = recv(client, reply, sizeof(reply), 0)) < 0 && errno == EAGAIN &&
+               Clock::now() - t0 < std::chrono::milliseconds(100)) {
+            sched_yield();
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+        if (n <= 0) {
+            ++lost;
+            continue;
+        }
+        if (i >= o.sessions) rtt.record(static_cast<uint64_t>(ns));
+    }
+
+    stop = true;
+    uint64_t one = 1;
+    (void)!write(shutdown_fd, &one, sizeof(one));
+    server.join();
+    close(client);
+    close(sock);
+    close(shutdown_fd);
+    cdr.stop();
+
+    HistogramSnapshot snap;
+    rtt.mergeInto(snap);
+    HistogramSnapshot handling;
+    metrics.latency.mergeInto(handling);
+    const char* name = !busy_poll ? "epoll" : kernel_busy_poll ? "busy+SO" : "busy";
+    std::printf("%-8s rtt p50 %6.1f us  p90 %6.1f us  p99 %6.1f us  p99.9 %7.1f us  max %8.1f us"
+                "  jitter(p99-p50) %6.1f us  server p50 %5.1f us  lost %llu\n",
+                name, us(snap.quantile(0.5)), us(snap.quantile(0.9)), us(snap.quantile(0.99)),
+                us(snap.quantile(0.999)), us(snap.quantile(1.0)),
+                us(snap.quantile(0.99)) - us(snap.quantile(0.5)), us(handling.quantile(0.5)),
+                static_cast<unsigned long long>(lost));
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--requests")) o.requests = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--sessions")) o.sessions = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--server-cpu")) o.server_cpu = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--client-cpu")) o.client_cpu = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--busy-poll-usec")) o.busy_poll_usec = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--mode") && std::strcmp(argv[i + 1], "both") != 0) {
+            o.epoll = !std::strcmp(argv[i + 1], "epoll");
+            o.busy = !std::strcmp(argv[i + 1], "busy");
+        } else if (std::strcmp(argv[i], "--mode") != 0) {
+            std::fprintf(stderr,
+                         "Usage: %s [--requests N] [--sessions N] [--server-cpu C] [--client-cpu C]\n"
+                         "          [--mode epoll|busy|both] [--busy-poll-usec U]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+    if (o.sessions == 0 || o.sessions > kMaxSessions || (!o.epoll && !o.busy)) {
+        std::fprintf(stderr, "--sessions must be in [1, %zu], --mode epoll|busy|both\n", kMaxSessions);
+        return 1;
+    }
+    // Сообщения о каждой сессии не нужны и искажают замер
+    spdlog::set_level(spdlog::level::warn);
+    if (!pinTo(pthread_self(), o.client_cpu)) std::fprintf(stderr, "cannot pin client to CPU %d\n", o.client_cpu);
+    std::printf("requests %zu, sessions %zu, server CPU %d, client CPU %d\n", o.requests, o.sessions,
+                o.server_cpu, o.client_cpu);
+    if (o.epoll) runMode(o, false);
+    // Сервер в режиме busy-poll не отдаёт ядро: на одном ядре с клиентом
+    // каждый ответ ждал бы кванта планировщика
+    if (o.busy && std::thread::hardware_concurrency() < 2) {
+        std::printf("busy     skipped: needs separate CPUs for server and client\n");
+    } else if (o.busy) {
+        runMode(o, true);
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+// Микробенчмарки горячего пути сервера на Google Benchmark:
+// BCD, таблица сессий (1K–10M), чёрный список, строки CDR, истечение.
+//
+//   pgw_bench [--benchmark_filter=Session] [--benchmark_out=bench.json]
+//
+// По умолчанию результаты печатаются в JSON, чтобы сравнивать сборки
+// (например, tools/compare.py из Google Benchmark); для чтения глазами —
+// --benchmark_format=console.
+
+#include "blacklist.h"
+#include "session_table.h"
+#include "cdr_format.h"
+#include "imsi.h"
+#include "utils.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = SessionTable::Clock;
+
+namespace {
+
+constexpr size_t kShards = 64;
+constexpr size_t kKeyPool = 1 << 16;   // случайные ключи на итерацию берутся из пула
+
+uint64_t makeKey(uint64_t n) {
+    return (n << 4) | 0x0F;
+}
+
+// Ключи [1, range], перемешанные: доступ к таблице без закономерности
+std::vector<uint64_t> randomKeys(uint64_t range, size_t count, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> keys(count);
+    for (auto& key : keys) key = makeKey(rng() % range + 1);
+    return keys;
+}
+
+// Заполненная таблица на sessions сессий. Построение 10M сессий занимает
+// секунды, а функция бенчмарка вызывается несколько раз при подборе числа
+// итераций, поэтому последняя таблица переиспользуется.
+SessionTable& filledTable(size_t sessions) {
+    static std::unique_ptr<SessionTable> table;
+    static size_t table_sessions = 0;
+    if (!table || table_sessions != sessions) {
+        table.reset();
+        table = std::make_unique<SessionTable>(kShards, sessions, std::chrono::hours(1));
+        Clock::time_point now = Clock::now();
+        for (uint64_t i = 1; i <= sessions; ++i) table->touch(makeKey(i), now);
+        table_sessions = sessions;
+    }
+    return *table;
+}
+
+// --- IMSI ---
+
+void BM_ImsiStringToBcd(benchmark::State& state) {
+    std::string imsi = "001010123456789";
+    for (auto _ : state) {
+        auto bcd = imsiStringToBcd(imsi);
+        benchmark::DoNotOptimize(bcd.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ImsiStringToBcd);
+
+void BM_BcdToImsiString(benchmark::State& state) {
+    std::vector<uint8_t> bcd = imsiStringToBcd("001010123456789");
+    for (auto _ : state) {
+        auto imsi = bcdToImsiString(bcd);
+        benchmark::DoNotOptimize(imsi.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BcdToImsiString);
+
+// Путь UDP-потока: 8 байт датаграммы -> Imsi
+void BM_DecodeImsiBcd(benchmark::State& state) {
+    std::vector<uint8_t> bcd = imsiStringToBcd("001010123456789");
+    for (auto _ : state) {
+        Imsi imsi;
+        benchmark::DoNotOptimize(decodeImsiBcd(bcd.data(), bcd.size(), imsi));
+        benchmark::DoNotOptimize(imsi);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeImsiBcd);
+
+void BM_EncodeImsiBcd(benchmark::State& state) {
+    Imsi imsi;
+    parseImsi("001010123456789", kImsiDigits, imsi);
+    uint8_t out[kImsiBcdSize];
+    for (auto _ : state) {
+        encodeImsiBcd(imsi, out);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeImsiBcd);
+
+// --- Таблица сессий ---
+
+// Вставка sessions новых сессий в пустую таблицу с заранее заданной ёмкостью
+void BM_SessionInsert(benchmark::State& state) {
+    size_t sessions = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto table = std::make_unique<SessionTable>(kShards, sessions, std::chrono::hours(1));
+        Clock::time_point now = Clock::now();
+        state.ResumeTiming();
+        for (uint64_t i = 1; i <= sessions; ++i) table->touch(makeKey(i), now);
+        state.PauseTiming();
+        table.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(sessions));
+}
+BENCHMARK(BM_SessionInsert)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+// Обновление существующей сессии (повторный attach)
+void BM_SessionRefresh(benchmark::State& state) {
+    size_t sessions = static_cast<size_t>(state.range(0));
+    SessionTable& table = filledTable(sessions);
+    std::vector<uint64_t> keys = randomKeys(sessions, kKeyPool, 1);
+    size_t i = 0;
+    Clock::time_point now = Clock::now();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(table.touch(keys[i++ & (kKeyPool - 1)], now));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SessionRefresh)->RangeMultiplier(10)->Range(1000, 10000000);
+
+// Поиск без блокировок (/check_subscriber): state.range(1) = 1 — существующие ключи
+void BM_SessionLookup(benchmark::State& state) {
+    size_t sessions = static_cast<size_t>(state.range(0));
+    SessionTable& table = filledTable(sessions);
+    std::vector<uint64_t> keys = randomKeys(sessions, kKeyPool, 2);
+    if (!state.range(1)) {
+        for (auto& key : keys) key = makeKey((key >> 4) + sessions);   // за пределами заполненного диапазона
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(table.contains(keys[i++ & (kKeyPool - 1)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SessionLookup)
+    ->ArgNames({"sessions", "hit"})
+    ->ArgsProduct({{1000, 10000, 100000, 1000000, 10000000}, {0, 1}});
+
+// Один тик очистки, на котором истекают все sessions сессий
+void BM_SessionExpireTick(benchmark::State& state) {
+    size_t sessions = static_cast<size_t>(state.range(0));
+    std::vector<uint64_t> expired;
+    expired.reserve(sessions);
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto table = std::make_unique<SessionTable>(kShards, sessions, std::chrono::seconds(30));
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 1; i <= sessions; ++i) table->touch(makeKey(i), start);
+        expired.clear();
+        state.ResumeTiming();
+        table->expire(start + std::chrono::seconds(32), expired);
+        state.PauseTiming();
+        table.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(sessions));
+}
+BENCHMARK(BM_SessionExpireTick)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+// Тик очистки без истёкших сессий: стоимость холостого прохода по шардам
+void BM_SessionIdleTick(benchmark::State& state) {
+    size_t sessions = static_cast<size_t>(state.range(0));
+    SessionTable& table = filledTable(sessions);
+    std::vector<uint64_t> expired;
+    for (auto _ : state) {
+        expired.clear();
+        benchmark::DoNotOptimize(table.expire(Clock::now(), expired));
+    }
+}
+BENCHMARK(BM_SessionIdleTick)->RangeMultiplier(100)->Range(1000, 10000000);
+
+// --- Чёрный список ---
+
+// state.range(0) — размер списка, range(1) — фильтр Блума, range(2) — доля попаданий 0/1
+void BM_BlacklistContains(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    std::vector<uint64_t> keys;
+    keys.reserve(size);
+    for (uint64_t i = 1; i <= size; ++i) keys.push_back(makeKey(i * 2));
+    Blacklist blacklist(std::move(keys), state.range(1) != 0);
+    std::vector<uint64_t> probes = randomKeys(size, kKeyPool, 3);
+    // чётные номера лежат в списке, нечётные — нет
+    for (auto& key : probes) {
+        uint64_t n = key >> 4;
+        key = makeKey(state.range(2) ? n * 2 : n * 2 + 1);
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(blacklist.contains(Imsi{probes[i++ & (kKeyPool - 1)]}));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BlacklistContains)
+    ->ArgNames({"size", "bloom", "hit"})
+    ->ArgsProduct({{1000, 100000, 1000000}, {0, 1}, {0, 1}});
+
+// --- CDR ---
+
+// Записи одной секунды: строка времени берётся из кэша форматтера
+void BM_CdrFormatSameSecond(benchmark::State& state) {
+    CdrFormatter formatter;
+    char line[CdrFormatter::kMaxLine];
+    CdrRecord record{makeKey(123456789), static_cast<int64_t>(std::time(nullptr)), CdrEvent::Renew};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(formatter.format(record, line));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CdrFormatSameSecond);
+
+// Каждая запись в новой секунде: localtime_r и strftime на каждую строку
+void BM_CdrFormatNewSecond(benchmark::State& state) {
+    CdrFormatter formatter;
+    char line[CdrFormatter::kMaxLine];
+    CdrRecord record{makeKey(123456789), static_cast<int64_t>(std::time(nullptr)), CdrEvent::Create};
+    for (auto _ : state) {
+        ++record.timestamp;
+        benchmark::DoNotOptimize(formatter.format(record, line));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CdrFormatNewSecond);
+
+// Метка времени события, как её получает UDP-поток
+void BM_CdrTimestamp(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::time(nullptr));
+    }
+}
+BENCHMARK(BM_CdrTimestamp);
+
+void BM_CdrToBinary(benchmark::State& state) {
+    CdrRecord record{makeKey(123456789), static_cast<int64_t>(std::time(nullptr)), CdrEvent::Delete};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(toBinaryRecord(record));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CdrToBinary);
+
+}
+
+int main(int argc, char** argv) {
+    // JSON по умолчанию, если формат не задан явно
+    std::vector<char*> args(argv, argv + argc);
+    bool has_format = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--benchmark_format", 18) == 0) has_format = true;
+    }
+    char json_format[] = "--benchmark_format=json";
+    if (!has_format) args.insert(args.begin() + 1, json_format);
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
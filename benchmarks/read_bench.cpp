@@ -0,0 +1,120 @@
+// Задержка обновления сессий (путь attach) под конкурентной нагрузкой
+// HTTP-чтений: без читателей, с читателями под mutex шарда (как было)
+// и с читателями через seqlock (SessionTable::contains).
+//
+//   pgw_read_bench [--sessions N] [--writers W] [--readers R] [--seconds S]
+
+#include "session_table.h"
+#include "metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using Clock = SessionTable::Clock;
+
+namespace {
+
+// Таблица на все сессии выделяется сразу
+constexpr size_t kMaxSessions = 100000000;
+
+enum class ReadMode { None, Locked, Seqlock };
+
+const char* modeName(ReadMode mode) {
+    switch (mode) {
+        case ReadMode::None: return "no readers";
+        case ReadMode::Locked: return "mutex readers";
+        case ReadMode::Seqlock: return "seqlock readers";
+    }
+    return "";
+}
+
+uint64_t makeKey(uint64_t n) {
+    return (n << 4) | 0x0F;
+}
+
+void runPhase(ReadMode mode, size_t sessions, int writers, int readers, int seconds) {
+    SessionTable table(64, sessions, std::chrono::seconds(3600));
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < sessions; ++i) table.touch(makeKey(i + 1), start);
+
+    std::atomic<bool> stop{false};
+    std::vector<std::unique_ptr<LatencyHistogram>> latency;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        latency.push_back(std::make_unique<LatencyHistogram>());
+        threads.emplace_back([&, w]() {
+            std::mt19937_64 rng(w + 1);
+            LatencyHistogram& hist = *latency[w];
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t key = makeKey(rng() % sessions + 1);
+                auto t0 = Clock::now();
+                table.withShard(table.shardOf(key), [&](SessionTable::Shard& s) { s.touch(key, t0); });
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+                hist.record(static_cast<uint64_t>(ns));
+            }
+        });
+    }
+    std::atomic<uint64_t> reads{0};
+    int reader_count = mode == ReadMode::None ? 0 : readers;
+    for (int r = 0; r < reader_count; ++r) {
+        threads.emplace_back([&, r]() {
+            std::mt19937_64 rng(1000 + r);
+            uint64_t done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t key = makeKey(rng() % (2 * sessions) + 1);
+                if (mode == ReadMode::Locked) {
+                    table.readShard(table.shardOf(key), [&](const SessionTable::Shard& s) { (void)s.find(key); });
+                } else {
+                    (void)table.contains(key);
+                }
+                ++done;
+            }
+            reads.fetch_add(done);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& t : threads) t.join();
+
+    HistogramSnapshot snap;
+    for (const auto& h : latency) h->mergeInto(snap);
+    std::printf("%-16s updates/s %10.0f  p50 %6llu ns  p99 %6llu ns  p99.9 %7llu ns  reads/s %11.0f\n",
+                modeName(mode), static_cast<double>(snap.count) / seconds,
+                static_cast<unsigned long long>(snap.quantile(0.5)),
+                static_cast<unsigned long long>(snap.quantile(0.99)),
+                static_cast<unsigned long long>(snap.quantile(0.999)),
+                static_cast<double>(reads.load()) / seconds);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t sessions = 1000000;
+    int writers = 2;
+    int readers = 4;
+    int seconds = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--sessions")) sessions = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--writers")) writers = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--readers")) readers = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--seconds")) seconds = std::atoi(argv[i + 1]);
+        else {
+            std::fprintf(stderr, "Usage: %s [--sessions N] [--writers W] [--readers R] [--seconds S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sessions == 0 || sessions > kMaxSessions || writers < 1 || readers < 1 || seconds < 1) {
+        std::fprintf(stderr, "--sessions must be in [1, %zu], --writers, --readers and --seconds >= 1\n",
+                     kMaxSessions);
+        return 1;
+    }
+    std::printf("sessions %zu, writers %d, readers %d, %d s per phase\n", sessions, writers, readers, seconds);
+    for (ReadMode mode : {ReadMode::None, ReadMode::Locked, ReadMode::Seqlock})
+        runPhase(mode, sessions, writers, readers, seconds);
+    return 0;
+}
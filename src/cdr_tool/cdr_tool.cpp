@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../common/cdr_format.h"
+#include "../common/imsi.h"
+
+// Утилита для двоичных сегментов CDR (cdr_format = "binary"):
+// печатает записи в текстовом формате cdr.log, при необходимости
+// фильтруя по IMSI, интервалу времени и типу события.
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0
+              << " [--imsi IMSI]... [--from TIME] [--to TIME] [--event EVENT] [--count] <segment.cdrb>...\n"
+              << "  TIME  — секунды Unix или \"YYYY-mm-dd HH:MM:SS\" (локальное время)\n"
+              << "  EVENT — create | renew | delete | shutdown\n"
+              << "  --count — вывести только число подходящих записей" << std::endl;
+}
+
+// Разбор времени: число секунд Unix или локальная дата-время
+static bool parseTime(const std::string& value, int64_t& out) {
+    if (!value.empty() && std::all_of(value.begin(), value.end(), ::isdigit)) {
+        // Число вне int64_t — ошибка разбора, а не исключение
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+        return ec == std::errc() && ptr == value.data() + value.size();
+    }
+    std::tm tm{};
+    const char* end = strptime(value.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if (!end || *end != '\0') return false;
+    tm.tm_isdst = -1;
+    out = static_cast<int64_t>(std::mktime(&tm));
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<uint64_t> imsis;
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    bool filter_event = false;
+    CdrEvent event = CdrEvent::Create;
+    bool count_only = false;
+    std::vector<std::string> segments;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--imsi" && has_value) {
+            std::string value = argv[++i];
+            Imsi imsi;
+            ImsiError err = parseImsi(value.data(), value.size(), imsi);
+            if (err != ImsiError::Ok) {
+                std::cerr << "Invalid IMSI '" << value << "': " << imsiErrorMessage(err) << std::endl;
+                return 1;
+            }
+            imsis.push_back(imsi.packed);
+        } else if ((arg == "--from" || arg == "--to") && has_value) {
+            std::string value = argv[++i];
+            if (!parseTime(value, arg == "--from" ? from : to)) {
+                std::cerr << "Invalid time '" << value << "'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--event" && has_value) {
+            std::string value = argv[++i];
+            if (!parseCdrEventName(value, event)) {
+                std::cerr << "Invalid event '" << value << "'" << std::endl;
+                return 1;
+            }
+            filter_event = true;
+        } else if (arg == "--count") {
+            count_only = true;
+        } else if (arg == "--help" || arg == "-h" || (!arg.empty() && arg[0] == '-')) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            segments.push_back(arg);
+        }
+    }
+    if (segments.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::sort(imsis.begin(), imsis.end());
+
+    // Вывод через собственный буфер: fwrite крупными блоками
+    std::vector<char> out(1 << 20);
+    size_t used = 0;
+    CdrFormatter formatter;
+    uint64_t matched = 0;
+
+    for (const auto& path : segments) {
+        CdrSegmentReader reader;
+        std::string error;
+        if (!reader.open(path, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < reader.size(); ++i) {
+            CdrRecord record = reader.record(i);
+            if (record.timestamp < from || record.timestamp > to) continue;
+            if (filter_event && record.event != event) continue;
+            if (!imsis.empty() && !std::binary_search(imsis.begin(), imsis.end(), record.imsi)) continue;
+            ++matched;
+            if (count_only) continue;
+            if (used + CdrFormatter::kMaxLine > out.size()) {
+                std::fwrite(out.data(), 1, used, stdout);
+                used = 0;
+            }
+            used += formatter.format(record, out.data() + used);
+        }
+    }
+    if (count_only) {
+        std::cout << matched << std::endl;
+        return 0;
+    }
+    std::fwrite(out.data(), 1, used, stdout);
+    std::fflush(stdout);
+    return 0;
+}
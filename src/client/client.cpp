@@ -1,7 +1,15 @@
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 #include <cstring>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -10,15 +18,318 @@
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/ostream_sink.h>
 #include "../common/config.h"
+#include "../common/protocol.h"
 #include "../common/utils.h"
 
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " <config.json> <IMSI>\n"
+              << "       " << argv0 << " <config.json> --batch <FILE|-> [options]\n"
+              << "  --window N        запросов в полёте (batch_window)\n"
+              << "  --timeout-ms MS   ожидание ответа на попытку (request_timeout_ms)\n"
+              << "  --retries N       повторов после таймаута (request_retries)\n"
+              << "  --imsis-per-datagram N\n"
+              << "                    IMSI в датаграмме, до 150 (imsis_per_datagram)" << std::endl;
+}
+
+struct BatchStats {
+    uint64_t requests = 0;
+    uint64_t answered = 0;
+    uint64_t timeouts = 0;
+    uint64_t invalid = 0;
+    uint64_t retries = 0;
+    uint64_t resets = 0;
+    uint64_t unmatched = 0;
+};
+
+// Отправка IMSI на сервер с окном датаграмм в полёте на одном сокете.
+// Исходный формат — только для окна в одну датаграмму: в ответе нет
+// номера запроса, и ответ сопоставляется с самой старой неотвеченной
+// датаграммой. Таймаут означает, что порядок мог сбиться: просроченные
+// запросы повторяются, оставшиеся в полёте отправляются заново с нового
+// сокета, а поздние ответы уходят вместе со старым. С окном больше одного
+// или imsis_per_datagram > 1 — пакетный формат: кластер отвечает на
+// датаграммы с IMSI других участников позже остальных, поэтому ответ
+// находится по номеру запроса; повтор получает новый номер, и сокет не
+// меняется.
+class BatchRunner {
+public:
+    using NextImsi = std::function<bool(std::string&)>;
+    using OnResult = std::function<void(const std::string& imsi, const std::string& result)>;
+
+    BatchRunner(const sockaddr_in& server, size_t window, size_t imsis_per_datagram, int timeout_ms, int retries,
+                spdlog::level::level_enum request_log_level)
+        : server_(server),
+          window_(window),
+          per_datagram_(imsis_per_datagram),
+          batch_(imsis_per_datagram > 1 || window > 1),
+          timeout_(std::chrono::milliseconds(timeout_ms)),
+          retries_(retries),
+          request_log_level_(request_log_level),
+          logger_(spdlog::default_logger()) {}
+
+    // false, если не удалось создать сокет или отправить запрос
+    bool run(const NextImsi& next, const OnResult& on_result) {
+        sock_ = openSocket();
+        if (sock_ < 0) return false;
+        bool input_done = false;
+        bool ok = true;
+        while (ok) {
+            // Пополнение окна: сначала повторы, затем новые строки
+            while (inflight_.size() < window_) {
+                Pending p;
+                if (!retry_.empty()) {
+                    p = std::move(retry_.front());
+                    retry_.pop_front();
+                } else if (!input_done) {
+                    input_done = !readGroup(next, on_result, p);
+                    if (p.imsis.empty()) break;
+                } else {
+                    break;
+                }
+                if (!send(std::move(p))) {
+                    ok = false;
+                    break;
+                }
+            }
+            if (!ok || inflight_.empty()) break;
+
+            // Ожидание ответа не дольше срока самого старого запроса
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(inflight_.begin()->second.deadline - Clock::now());
+            pollfd pfd{sock_, POLLIN, 0};
+            int ready = poll(&pfd, 1, wait.count() > 0 ? static_cast<int>(wait.count()) : 0);
+            if (ready < 0 && errno != EINTR) {
+                logger_->error("poll failed: {}", strerror(errno));
+                ok = false;
+                break;
+            }
+            if (ready > 0) receiveReplies(on_result);
+            expire(on_result);
+        }
+        close(sock_);
+        sock_ = -1;
+        return ok;
+    }
+
+    const BatchStats& stats() const { return stats_; }
+
+private:
+    // IMSI одной датаграммы
+    struct Pending {
+        std::vector<std::string> imsis;
+        std::vector<uint8_t> bcd;       // imsis.size() × 8 байт
+        int attempt = 0;
+        Clock::time_point deadline;
+    };
+
+    static int openSocket() {
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock < 0) spdlog::critical("Cannot create UDP socket: {}", strerror(errno));
+        return sock;
+    }
+
+    // До per_datagram_ корректных IMSI из входа; false — вход закончился
+    bool readGroup(const NextImsi& next, const OnResult& on_result, Pending& p) {
+        std::string imsi;
+        while (p.imsis.size() < per_datagram_) {
+            if (!next(imsi)) return false;
+            ++stats_.requests;
+            std::vector<uint8_t> bcd;
+            try {
+                bcd = imsiStringToBcd(imsi);
+            } catch (const std::exception& e) {
+                logger_->warn("Invalid IMSI '{}': {}", imsi, e.what());
+                ++stats_.invalid;
+                on_result(imsi, "invalid");
+                continue;
+            }
+            p.bcd.insert(p.bcd.end(), bcd.begin(), bcd.end());
+            p.imsis.push_back(std::move(imsi));
+        }
+        return true;
+    }
+
+    bool send(Pending&& p) {
+        const uint64_t seq = next_seq_++;
+        const uint8_t* data = p.bcd.data();
+        size_t size = p.bcd.size();
+        if (batch_) {
+            datagram_.resize(kBatchHeaderSize);
+            writeBatchHeader(static_cast<uint8_t>(p.imsis.size()), static_cast<uint32_t>(seq), datagram_.data());
+            datagram_.insert(datagram_.end(), p.bcd.begin(), p.bcd.end());
+            data = datagram_.data();
+            size = datagram_.size();
+        }
+        ssize_t sent = sendto(sock_, data, size, 0, reinterpret_cast<const sockaddr*>(&server_), sizeof(server_));
+        if (sent < 0) {
+            logger_->error("sendto failed: {}", strerror(errno));
+            return false;
+        }
+        if (batch_) {
+            logger_->log(request_log_level_, "Sent {} bytes for {} IMSIs, seq {} (attempt {})", sent,
+                         p.imsis.size(), static_cast<uint32_t>(seq), p.attempt + 1);
+        } else {
+            logger_->log(request_log_level_, "Sent {} bytes for IMSI {} (attempt {})", sent, p.imsis[0],
+                         p.attempt + 1);
+        }
+        p.deadline = Clock::now() + timeout_;
+        inflight_.emplace(seq, std::move(p));
+        return true;
+    }
+
+    // Номер в полёте по 32 битам из ответа: все они не старше next_seq_ - 2^32
+    uint64_t seqOf(uint32_t wire) const {
+        uint64_t seq = (next_seq_ & ~uint64_t(0xFFFFFFFF)) | wire;
+        return seq >= next_seq_ ? seq - (uint64_t(1) << 32) : seq;
+    }
+
+    void receiveReplies(const OnResult& on_result) {
+        uint8_t buf[kMaxBatchReply];
+        ssize_t n;
+        while ((n = recv(sock_, buf, sizeof(buf), MSG_DONTWAIT)) >= 0) {
+            if (batch_) {
+                receiveBatchReply(buf, static_cast<size_t>(n), on_result);
+                continue;
+            }
+            std::string response(buf, buf + n);
+            if (inflight_.empty()) {
+                logger_->warn("Unexpected response '{}'", response);
+                ++stats_.unmatched;
+                continue;
+            }
+            auto it = inflight_.begin();
+            logger_->log(request_log_level_, "Received response for IMSI {}: '{}'", it->second.imsis[0], response);
+            ++stats_.answered;
+            on_result(it->second.imsis[0], response);
+            inflight_.erase(it);
+        }
+    }
+
+    void receiveBatchReply(const uint8_t* data, size_t size, const OnResult& on_result) {
+        BatchHeader hdr;
+        if (!parseBatchReply(data, size, hdr)) {
+            logger_->warn("Malformed batch response ({} bytes)", size);
+            ++stats_.unmatched;
+            return;
+        }
+        auto it = inflight_.find(seqOf(hdr.seq));
+        if (it == inflight_.end() || it->second.imsis.size() != hdr.count) {
+            // Поздний ответ на уже повторённый запрос
+            logger_->debug("Unexpected response seq {}", hdr.seq);
+            ++stats_.unmatched;
+            return;
+        }
+        logger_->log(request_log_level_, "Received response seq {} for {} IMSIs", hdr.seq, hdr.count);
+        const Pending& p = it->second;
+        for (size_t i = 0; i < p.imsis.size(); ++i) {
+            on_result(p.imsis[i], imsiStatusName(static_cast<ImsiStatus>(data[kBatchHeaderSize + i])));
+        }
+        stats_.answered += p.imsis.size();
+        inflight_.erase(it);
+    }
+
+    void expire(const OnResult& on_result) {
+        auto now = Clock::now();
+        if (inflight_.empty() || inflight_.begin()->second.deadline > now) return;
+        std::deque<Pending> resend;
+        while (!inflight_.empty() && inflight_.begin()->second.deadline <= now) {
+            Pending p = std::move(inflight_.begin()->second);
+            inflight_.erase(inflight_.begin());
+            if (p.attempt < retries_) {
+                ++p.attempt;
+                ++stats_.retries;
+                resend.push_back(std::move(p));
+            } else {
+                for (const std::string& imsi : p.imsis) {
+                    logger_->warn("No response for IMSI {} after {} attempt(s)", imsi, p.attempt + 1);
+                    ++stats_.timeouts;
+                    on_result(imsi, "timeout");
+                }
+            }
+        }
+        if (!batch_) {
+            // Остаток окна сохраняет свои попытки и уходит следом за повторами
+            for (auto& entry : inflight_) resend.push_back(std::move(entry.second));
+            inflight_.clear();
+            close(sock_);
+            sock_ = openSocket();
+            ++stats_.resets;
+        }
+        for (Pending& p : retry_) resend.push_back(std::move(p));
+        retry_ = std::move(resend);
+    }
+
+    sockaddr_in server_;
+    size_t window_;
+    size_t per_datagram_;
+    bool batch_;
+    Clock::duration timeout_;
+    int retries_;
+    spdlog::level::level_enum request_log_level_;
+    std::shared_ptr<spdlog::logger> logger_;
+    int sock_ = -1;
+    // Датаграммы в полёте по номеру отправки: порядок map — порядок отправки
+    uint64_t next_seq_ = 0;
+    std::map<uint64_t, Pending> inflight_;
+    std::deque<Pending> retry_;
+    std::vector<uint8_t> datagram_;
+    BatchStats stats_;
+};
+
+// Строка входного файла: IMSI без пробелов вокруг; пустые строки и "#..." пропускаются
+bool nextImsiLine(std::istream& in, std::string& imsi) {
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        imsi = line.substr(begin, end - begin + 1);
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <config.json> <IMSI>" << std::endl;
+    if (argc < 3) {
+        usage(argv[0]);
         return 1;
     }
     std::string config_file = argv[1];
-    std::string imsi_str    = argv[2];
+    std::string imsi_str;
+    std::string batch_file;
+    bool batch = false;
+    int window = -1, timeout_ms = -1, retries = -1, per_datagram = -1;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (arg == "--batch" && (v = value())) {
+            batch = true;
+            batch_file = v;
+        } else if (arg == "--window" && (v = value())) {
+            window = std::atoi(v);
+        } else if (arg == "--timeout-ms" && (v = value())) {
+            timeout_ms = std::atoi(v);
+        } else if (arg == "--retries" && (v = value())) {
+            retries = std::atoi(v);
+        } else if (arg == "--imsis-per-datagram" && (v = value())) {
+            per_datagram = std::atoi(v);
+        } else if (arg.rfind("--", 0) != 0 && imsi_str.empty()) {
+            imsi_str = arg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (batch == !imsi_str.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
 
     // Загрузка конфига
     ClientConfig config;
@@ -28,80 +339,117 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error loading config: " << e.what() << std::endl;
         return 1;
     }
+    if (window >= 0) config.batch_window = window;
+    if (timeout_ms >= 0) config.request_timeout_ms = timeout_ms;
+    if (retries >= 0) config.request_retries = retries;
+    if (per_datagram >= 0) config.imsis_per_datagram = per_datagram;
+    if (config.batch_window < 1 || config.request_timeout_ms < 1) {
+        std::cerr << "--window and --timeout-ms must be >= 1" << std::endl;
+        return 1;
+    }
+    if (config.imsis_per_datagram < 1 || config.imsis_per_datagram > static_cast<int>(kMaxBatchImsis)) {
+        std::cerr << "--imsis-per-datagram must be in [1, " << kMaxBatchImsis << "]" << std::endl;
+        return 1;
+    }
 
     // Определение debug из log_level
     bool enable_debug = (config.log_level == "DEBUG" || config.log_level == "debug");
 
-    // Логгер
+    // Логгер. В пакетном режиме в консоль идут только предупреждения:
+    // stdout занят результатами, подробности — в файле
     auto console_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(std::cerr);
-    console_sink->set_level(enable_debug ? spdlog::level::debug : spdlog::level::info);
+    console_sink->set_level(enable_debug ? spdlog::level::debug
+                                         : (batch ? spdlog::level::warn : spdlog::level::info));
     auto file_sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(config.log_file, true);
-    file_sink->set_level(spdlog::level::debug);
+    file_sink->set_level(enable_debug || !batch ? spdlog::level::debug : spdlog::level::info);
 
     auto logger = std::make_shared<spdlog::logger>(
         "client_logger",
         spdlog::sinks_init_list{console_sink, file_sink}
     );
     logger->set_level(spdlog::level::debug);
-    logger->flush_on(spdlog::level::info);
+    logger->flush_on(batch ? spdlog::level::warn : spdlog::level::info);
     spdlog::set_default_logger(logger);
 
-    logger->info("Client starting: IMSI={}  server={}:{}  log_level={}",
-                 imsi_str, config.server_ip, config.server_port, config.log_level);
-    logger->debug("Loaded config: {}", config_file);
-
-    // BCD
-    std::vector<uint8_t> bcd;
-    try {
-        bcd = imsiStringToBcd(imsi_str);
-    } catch (const std::exception& e) {
-        logger->error("Invalid IMSI '{}': {}", imsi_str, e.what());
-        return 1;
-    }
-    logger->debug("BCD bytes: [{}]", fmt::join(bcd, ","));
-
-    // UDP socket
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        logger->critical("Cannot create UDP socket: {}", strerror(errno));
-        return 1;
+    if (batch) {
+        logger->info("Client starting: batch={}  server={}:{}  window={}  imsis_per_datagram={}  timeout={} ms  "
+                     "retries={}",
+                     batch_file, config.server_ip, config.server_port, config.batch_window,
+                     config.imsis_per_datagram, config.request_timeout_ms, config.request_retries);
+    } else {
+        logger->info("Client starting: IMSI={}  server={}:{}  log_level={}",
+                     imsi_str, config.server_ip, config.server_port, config.log_level);
     }
+    logger->debug("Loaded config: {}", config_file);
 
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_port = htons(config.server_port);
     if (inet_pton(AF_INET, config.server_ip.c_str(), &addr.sin_addr) <= 0) {
         logger->critical("Invalid server IP: {}", config.server_ip);
-        close(sock);
         return 1;
     }
 
-    // Отправление
-    ssize_t sent = sendto(sock, bcd.data(), bcd.size(), 0,
-                          reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
-    if (sent < 0) {
-        logger->error("sendto failed: {}", strerror(errno));
-        close(sock);
-        return 1;
+    if (!batch) {
+        // BCD
+        std::vector<uint8_t> bcd;
+        try {
+            bcd = imsiStringToBcd(imsi_str);
+        } catch (const std::exception& e) {
+            logger->error("Invalid IMSI '{}': {}", imsi_str, e.what());
+            return 1;
+        }
+        logger->debug("BCD bytes: [{}]", fmt::join(bcd, ","));
+
+        // Один запрос с теми же таймаутом и повторами, что и в пакетном режиме
+        BatchRunner runner(addr, 1, 1, config.request_timeout_ms, config.request_retries, spdlog::level::info);
+        bool pending = true;
+        std::string response;
+        bool ok = runner.run(
+            [&](std::string& imsi) {
+                if (!pending) return false;
+                pending = false;
+                imsi = imsi_str;
+                return true;
+            },
+            [&](const std::string&, const std::string& result) { response = result; });
+        if (!ok || runner.stats().answered == 0) {
+            spdlog::shutdown();
+            return 1;
+        }
+
+        // Вывод ответа и выход
+        std::cout << response << std::endl;
+        spdlog::shutdown();
+        return 0;
     }
-    logger->info("Sent {} bytes to {}:{}", sent, config.server_ip, config.server_port);
 
-    // Ответ
-    char buf[64] = {};
-    socklen_t len = sizeof(addr);
-    ssize_t n = recvfrom(sock, buf, sizeof(buf)-1, 0,
-                         reinterpret_cast<sockaddr*>(&addr), &len);
-    if (n < 0) {
-        logger->error("recvfrom failed: {}", strerror(errno));
-        close(sock);
-        return 1;
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (batch_file != "-") {
+        file.open(batch_file);
+        if (!file.is_open()) {
+            logger->critical("Cannot open batch file: {}", batch_file);
+            return 1;
+        }
+        in = &file;
     }
-    std::string response(buf, buf + n);
-    logger->info("Received response: '{}'", response);
 
-    // Вывод ответа и выход
-    std::cout << response << std::endl;
-    close(sock);
+    // Результаты печатаются по мере прихода: "<IMSI> <ответ|timeout|invalid>"
+    auto started = Clock::now();
+    BatchRunner runner(addr, static_cast<size_t>(config.batch_window),
+                       static_cast<size_t>(config.imsis_per_datagram), config.request_timeout_ms,
+                       config.request_retries, spdlog::level::debug);
+    bool ok = runner.run([&](std::string& imsi) { return nextImsiLine(*in, imsi); },
+                         [](const std::string& imsi, const std::string& result) {
+                             std::cout << imsi << ' ' << result << '\n';
+                         });
+    std::cout.flush();
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    const BatchStats& s = runner.stats();
+    logger->info("Batch done in {:.2f} s: {} requests, {} answered, {} timeouts, {} invalid, "
+                 "{} retries, {} socket resets, {} unmatched responses",
+                 elapsed, s.requests, s.answered, s.timeouts, s.invalid, s.retries, s.resets, s.unmatched);
     spdlog::shutdown();
-    return 0;
+    return ok && s.timeouts == 0 && s.invalid == 0 ? 0 : 1;
 }
@@ -0,0 +1,141 @@
+#include "cdr_format.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* cdrEventName(CdrEvent event) {
+    switch (event) {
+        case CdrEvent::Create: return "create";
+        case CdrEvent::Renew: return "renew";
+        case CdrEvent::Delete: return "delete";
+        case CdrEvent::Shutdown: return "shutdown";
+    }
+    return "unknown";
+}
+
+bool parseCdrEventName(const std::string& name, CdrEvent& out) {
+    for (CdrEvent e : {CdrEvent::Create, CdrEvent::Renew, CdrEvent::Delete, CdrEvent::Shutdown}) {
+        if (name == cdrEventName(e)) {
+            out = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CdrFormatter::formatTime(int64_t seconds, CachedTime& cache, char* out) {
+    if (seconds != cache.second) {
+        std::time_t t = static_cast<std::time_t>(seconds);
+        std::tm tm{};
+        localtime_r(&t, &tm);
+        std::strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &tm);
+        cache.second = seconds;
+    }
+    std::memcpy(out, cache.text, 19);
+}
+
+size_t CdrFormatter::format(const CdrRecord& record, char* out) {
+    char* p = out;
+    formatTime(record.timestamp, timestamp_, p);
+    p += 19;
+    *p++ = ',';
+    formatImsi(Imsi{record.imsi}, p);
+    p += kImsiDigits;
+    *p++ = ',';
+    const char* name = cdrEventName(record.event);
+    size_t len = std::strlen(name);
+    std::memcpy(p, name, len);
+    p += len;
+    if (record.last_seen != 0) {
+        *p++ = ',';
+        p += std::snprintf(p, 11, "%u", record.renews);
+        *p++ = ',';
+        formatTime(record.last_seen, last_seen_, p);
+        p += 19;
+    }
+    *p++ = '\n';
+    return static_cast<size_t>(p - out);
+}
+
+CdrSegmentHeader makeCdrSegmentHeader(int64_t created) {
+    CdrSegmentHeader header{};
+    std::memcpy(header.magic, kCdrSegmentMagic, sizeof(header.magic));
+    header.version = kCdrSegmentVersion;
+    header.record_size = sizeof(CdrBinaryRecord);
+    header.created = created;
+    return header;
+}
+
+CdrBinaryRecord toBinaryRecord(const CdrRecord& record) {
+    CdrBinaryRecord bin{};
+    bin.imsi = record.imsi;
+    bin.timestamp = static_cast<uint32_t>(record.timestamp);
+    bin.event = static_cast<uint8_t>(record.event);
+    bin.renews = record.renews;
+    bin.last_seen = static_cast<uint32_t>(record.last_seen);
+    return bin;
+}
+
+CdrSegmentReader::~CdrSegmentReader() {
+    close();
+}
+
+bool CdrSegmentReader::open(const std::string& path, std::string& error) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CdrSegmentHeader)) {
+        error = path + ": not a CDR segment (too short)";
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        error = path + ": mmap failed: " + std::strerror(errno);
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+    length_ = static_cast<size_t>(st.st_size);
+    madvise(data, length_, MADV_SEQUENTIAL);
+
+    const CdrSegmentHeader& h = header();
+    if (std::memcmp(h.magic, kCdrSegmentMagic, sizeof(h.magic)) != 0) {
+        error = path + ": bad magic";
+        close();
+        return false;
+    }
+    if (h.version < 1 || h.record_size < kCdrBinaryRecordV1Size) {
+        error = path + ": unsupported version " + std::to_string(h.version);
+        close();
+        return false;
+    }
+    record_size_ = h.record_size;
+    // Недописанный хвост (аварийная остановка) отбрасывается
+    count_ = (length_ - sizeof(CdrSegmentHeader)) / record_size_;
+    return true;
+}
+
+void CdrSegmentReader::close() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), length_);
+    data_ = nullptr;
+    length_ = record_size_ = count_ = 0;
+}
+
+CdrRecord CdrSegmentReader::record(size_t index) const {
+    // Поля, которых нет в записи старой версии, остаются нулевыми
+    CdrBinaryRecord bin{};
+    std::memcpy(&bin, data_ + sizeof(CdrSegmentHeader) + index * record_size_,
+                record_size_ < sizeof(bin) ? record_size_ : sizeof(bin));
+    return CdrRecord{bin.imsi, static_cast<int64_t>(bin.timestamp), static_cast<CdrEvent>(bin.event), bin.renews,
+                     static_cast<int64_t>(bin.last_seen)};
+}
@@ -0,0 +1,109 @@
+#ifndef CDR_FORMAT_H
+#define CDR_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "imsi.h"
+
+enum class CdrEvent : uint8_t { Create, Renew, Delete, Shutdown };
+
+const char* cdrEventName(CdrEvent event);
+// false, если имя события неизвестно
+bool parseCdrEventName(const std::string& name, CdrEvent& out);
+
+// Событие CDR в памяти (очередь записи, чтение сегментов)
+struct CdrRecord {
+    uint64_t imsi;
+    int64_t timestamp;   // время события, секунды Unix
+    CdrEvent event;
+    // Счётчики объединения renew (cdr_renew_window_sec): обновлений сессии
+    // без своей записи CDR с предыдущей записи и время последнего обновления.
+    // last_seen == 0 — счётчики не ведутся
+    uint32_t renews = 0;
+    int64_t last_seen = 0;
+};
+
+// Форматирование строк CDR "YYYY-mm-dd HH:MM:SS,<imsi>,<event>\n";
+// при ведущихся счётчиках renew — "...,<event>,<renews>,<last_seen>\n".
+// Строка времени кэшируется на секунду: localtime_r/strftime вызываются
+// только при смене секунды, а не на каждую запись.
+class CdrFormatter {
+public:
+    static constexpr size_t kMaxLine = 96;
+
+    // Записывает строку в out (не меньше kMaxLine байт), возвращает её длину
+    size_t format(const CdrRecord& record, char* out);
+
+private:
+    struct CachedTime {
+        int64_t second = -1;
+        char text[20] = {};
+    };
+
+    // 19 символов "YYYY-mm-dd HH:MM:SS"
+    static void formatTime(int64_t seconds, CachedTime& cache, char* out);
+
+    // Время события и last_seen кэшируются отдельно: у записей одного
+    // тика очистки они различаются, но каждое почти не меняется
+    CachedTime timestamp_;
+    CachedTime last_seen_;
+};
+
+// Двоичный формат CDR: файл-сегмент = заголовок + записи фиксированной длины.
+// Все поля little-endian. Размер записи хранится в заголовке, чтобы читатель
+// мог пропускать поля, добавленные в будущих версиях.
+// Версия 2 добавила счётчики объединения renew (16 → 24 байта на запись);
+// сегменты версии 1 читаются с нулевыми счётчиками.
+constexpr char kCdrSegmentMagic[8] = {'P', 'G', 'W', 'C', 'D', 'R', '\0', '\0'};
+constexpr uint16_t kCdrSegmentVersion = 2;
+
+struct CdrSegmentHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t reserved;
+    int64_t created;     // время создания сегмента, секунды Unix
+};
+static_assert(sizeof(CdrSegmentHeader) == 24, "CDR segment header layout");
+
+struct CdrBinaryRecord {
+    uint64_t imsi;       // Imsi::packed
+    uint32_t timestamp;  // секунды Unix
+    uint8_t event;       // CdrEvent
+    uint8_t reserved[3];
+    // версия 2
+    uint32_t renews;
+    uint32_t last_seen;  // секунды Unix, 0 — счётчики не ведутся
+};
+static_assert(sizeof(CdrBinaryRecord) == 24, "CDR binary record layout");
+// Размер записи версии 1
+constexpr size_t kCdrBinaryRecordV1Size = 16;
+
+CdrSegmentHeader makeCdrSegmentHeader(int64_t created);
+CdrBinaryRecord toBinaryRecord(const CdrRecord& record);
+
+// Чтение сегмента через mmap. Записи доступны по индексу без копирования файла.
+class CdrSegmentReader {
+public:
+    CdrSegmentReader() = default;
+    ~CdrSegmentReader();
+    CdrSegmentReader(const CdrSegmentReader&) = delete;
+    CdrSegmentReader& operator=(const CdrSegmentReader&) = delete;
+
+    // false и текст ошибки в error, если файл не открывается или повреждён
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    const CdrSegmentHeader& header() const { return *reinterpret_cast<const CdrSegmentHeader*>(data_); }
+    size_t size() const { return count_; }
+    CdrRecord record(size_t index) const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t length_ = 0;
+    size_t record_size_ = 0;
+    size_t count_ = 0;
+};
+
+#endif
@@ -1,5 +1,9 @@
 #include "config.h"
+#include "cdr_format.h"
+#include "protocol.h"
+#include "utils.h"
 #include <fstream>
+#include <set>
 #include <stdexcept>
 
 
@@ -19,12 +23,158 @@ ServerConfig loadServerConfig(const std::string& filename) {
     config.cdr_file = j["cdr_file"];
     config.http_port = j["http_port"];
     config.graceful_shutdown_rate = j["graceful_shutdown_rate"];
+    if (config.graceful_shutdown_rate < 1) {
+        throw std::runtime_error("graceful_shutdown_rate must be >= 1");
+    }
     config.log_file = j["log_file"];
     config.log_level = j["log_level"];
     // Загрузка черного списка
     for (const auto& bl : j["blacklist"]) {
         config.blacklist.push_back(bl.get<std::string>());
     }
+    config.blacklist_file = j.value("blacklist_file", std::string());
+    config.blacklist_bloom = j.value("blacklist_bloom", true);
+    // Необязательные параметры многопоточного приёма UDP
+    config.udp_workers = j.value("udp_workers", 1);
+    if (config.udp_workers < 1) {
+        throw std::runtime_error("udp_workers must be >= 1");
+    }
+    config.udp_batch_size = j.value("udp_batch_size", 32);
+    if (config.udp_batch_size < 1 || config.udp_batch_size > 1024) {
+        throw std::runtime_error("udp_batch_size must be in [1, 1024]");
+    }
+    config.udp_backend = j.value("udp_backend", std::string("socket"));
+    if (config.udp_backend != "socket" && config.udp_backend != "io_uring") {
+        throw std::runtime_error("udp_backend must be 'socket' or 'io_uring'");
+    }
+    config.session_shards = j.value("session_shards", 64);
+    config.session_capacity = j.value("session_capacity", 100000L);
+    if (config.session_shards < 1 || config.session_capacity < 0) {
+        throw std::runtime_error("session_shards must be >= 1 and session_capacity >= 0");
+    }
+    // Защита от перегрузки
+    config.max_sessions = j.value("max_sessions", 0L);
+    config.new_session_rate = j.value("new_session_rate", 0);
+    config.new_session_burst = j.value("new_session_burst", 0);
+    config.overload_queue_delay_ms = j.value("overload_queue_delay_ms", 0);
+    if (config.max_sessions < 0 || config.new_session_rate < 0 || config.new_session_burst < 0 ||
+        config.overload_queue_delay_ms < 0) {
+        throw std::runtime_error("max_sessions, new_session_rate, new_session_burst and "
+                                 "overload_queue_delay_ms must be >= 0");
+    }
+    // Асинхронная запись CDR
+    config.cdr_ring_size = j.value("cdr_ring_size", 65536);
+    config.cdr_fsync = j.value("cdr_fsync", std::string("none"));
+    config.cdr_fsync_interval_ms = j.value("cdr_fsync_interval_ms", 1000);
+    config.cdr_overflow = j.value("cdr_overflow", std::string("block"));
+    config.cdr_block_timeout_ms = j.value("cdr_block_timeout_ms", 1000);
+    config.cdr_format = j.value("cdr_format", std::string("text"));
+    config.cdr_segment_bytes = j.value("cdr_segment_bytes", 64L << 20);
+    config.cdr_segment_sec = j.value("cdr_segment_sec", 3600);
+    config.cdr_renew_window_sec = j.value("cdr_renew_window_sec", 0);
+    config.snapshot_file = j.value("snapshot_file", std::string());
+    config.snapshot_interval_sec = j.value("snapshot_interval_sec", 60);
+    config.snapshot_keep_sessions = j.value("snapshot_keep_sessions", false);
+    if (config.snapshot_keep_sessions && config.snapshot_file.empty()) {
+        throw std::runtime_error("snapshot_keep_sessions requires snapshot_file");
+    }
+    // Режим журнала
+    config.log_mode = j.value("log_mode", std::string("sync"));
+    config.log_queue_size = j.value("log_queue_size", 8192);
+    config.log_overflow = j.value("log_overflow", std::string("block"));
+    config.log_flush_interval_sec = j.value("log_flush_interval_sec", 1);
+    config.log_event_rate = j.value("log_event_rate", 0);
+    if (config.log_mode != "sync" && config.log_mode != "async") {
+        throw std::runtime_error("log_mode must be 'sync' or 'async'");
+    }
+    if (config.log_overflow != "block" && config.log_overflow != "overrun_oldest") {
+        throw std::runtime_error("log_overflow must be 'block' or 'overrun_oldest'");
+    }
+    if (config.log_queue_size < 1 || config.log_flush_interval_sec < 1 || config.log_event_rate < 0) {
+        throw std::runtime_error("log_queue_size and log_flush_interval_sec must be >= 1, log_event_rate >= 0");
+    }
+    if (config.cdr_ring_size < 2) {
+        throw std::runtime_error("cdr_ring_size must be >= 2");
+    }
+    if (config.cdr_block_timeout_ms < 0) {
+        throw std::runtime_error("cdr_block_timeout_ms must be >= 0");
+    }
+    if (config.cdr_renew_window_sec < 0) {
+        throw std::runtime_error("cdr_renew_window_sec must be >= 0");
+    }
+    // Сегмент меньше заголовка с одной записью открывался бы на каждую запись
+    constexpr long kMinSegmentBytes = sizeof(CdrSegmentHeader) + sizeof(CdrBinaryRecord);
+    if (config.cdr_segment_bytes < 0 || (config.cdr_segment_bytes > 0 && config.cdr_segment_bytes < kMinSegmentBytes)) {
+        throw std::runtime_error("cdr_segment_bytes must be 0 or >= " + std::to_string(kMinSegmentBytes));
+    }
+    if (config.cdr_segment_sec < 0) {
+        throw std::runtime_error("cdr_segment_sec must be >= 0");
+    }
+    if (j.contains("udp_cpus")) {
+        for (const auto& cpu : j["udp_cpus"]) {
+            config.udp_cpus.push_back(cpu.get<int>());
+        }
+    }
+    // Режим низкой задержки: UDP-потоки не засыпают и занимают по ядру,
+    // служебные потоки работают на своих ядрах
+    config.udp_busy_poll = j.value("udp_busy_poll", false);
+    config.udp_busy_poll_usec = j.value("udp_busy_poll_usec", 50);
+    if (j.contains("housekeeping_cpus")) {
+        for (const auto& cpu : j["housekeeping_cpus"]) {
+            config.housekeeping_cpus.push_back(cpu.get<int>());
+        }
+    }
+    if (config.udp_busy_poll_usec < 0) {
+        throw std::runtime_error("udp_busy_poll_usec must be >= 0");
+    }
+    std::set<int> udp_cpus(config.udp_cpus.begin(), config.udp_cpus.end());
+    for (int cpu : config.housekeeping_cpus) {
+        if (udp_cpus.count(cpu)) {
+            throw std::runtime_error("housekeeping_cpus must not overlap udp_cpus");
+        }
+    }
+    if (config.udp_busy_poll) {
+        if (config.udp_backend != "socket") {
+            throw std::runtime_error("udp_busy_poll requires udp_backend 'socket'");
+        }
+        // Поток в цикле опроса не отдаёт ядро: два таких потока на одном ядре
+        // делят его по квантам планировщика, и задержка растёт до миллисекунд
+        if (config.udp_cpus.size() < static_cast<size_t>(config.udp_workers) ||
+            udp_cpus.size() != config.udp_cpus.size()) {
+            throw std::runtime_error("udp_busy_poll requires a distinct udp_cpus entry for every UDP worker");
+        }
+    }
+    // Кластер
+    config.cluster_self = j.value("cluster_self", std::string());
+    config.cluster_peer_timeout_ms = j.value("cluster_peer_timeout_ms", 200);
+    if (config.cluster_peer_timeout_ms < 1) {
+        throw std::runtime_error("cluster_peer_timeout_ms must be >= 1");
+    }
+    if (j.contains("cluster_members")) {
+        std::set<std::string> ids;
+        for (const auto& m : j["cluster_members"]) {
+            ClusterMemberConfig member;
+            member.id = m.at("id").get<std::string>();
+            member.udp = m.at("udp").get<std::string>();
+            member.peer = m.at("peer").get<std::string>();
+            member.http = m.at("http").get<std::string>();
+            if (member.id.empty() || !ids.insert(member.id).second) {
+                throw std::runtime_error("cluster member ids must be unique and non-empty");
+            }
+            std::string host;
+            int port;
+            for (const std::string* address : {&member.udp, &member.peer, &member.http}) {
+                if (!parseHostPort(*address, host, port)) {
+                    throw std::runtime_error("cluster member " + member.id + ": bad address '" + *address +
+                                             "', expected ip:port");
+                }
+            }
+            config.cluster_members.push_back(std::move(member));
+        }
+        if (!config.cluster_members.empty() && !ids.count(config.cluster_self)) {
+            throw std::runtime_error("cluster_self must be one of cluster_members");
+        }
+    }
     return config;
 }
 
@@ -42,5 +192,15 @@ ClientConfig loadClientConfig(const std::string& filename) {
     config.server_port = j["server_port"];
     config.log_file = j["log_file"];
     config.log_level = j["log_level"];
+    config.request_timeout_ms = j.value("request_timeout_ms", 1000);
+    config.request_retries = j.value("request_retries", 2);
+    config.batch_window = j.value("batch_window", 64);
+    if (config.request_timeout_ms < 1 || config.request_retries < 0 || config.batch_window < 1) {
+        throw std::runtime_error("request_timeout_ms and batch_window must be >= 1, request_retries >= 0");
+    }
+    config.imsis_per_datagram = j.value("imsis_per_datagram", 1);
+    if (config.imsis_per_datagram < 1 || config.imsis_per_datagram > static_cast<int>(kMaxBatchImsis)) {
+        throw std::runtime_error("imsis_per_datagram must be in [1, " + std::to_string(kMaxBatchImsis) + "]");
+    }
     return config;
 }
\ No newline at end of file
@@ -5,6 +5,14 @@
 #include <string>
 #include <vector>
 
+// Участник кластера (см. cluster.h); адреса — "ip:port"
+struct ClusterMemberConfig {
+    std::string id;
+    std::string udp;    // приём запросов абонентов
+    std::string peer;   // сокет связи с другими участниками
+    std::string http;   // HTTP API
+};
+
 struct ServerConfig {
     std::string udp_ip;
     int udp_port;
@@ -15,6 +23,42 @@ struct ServerConfig {
     std::string log_file;
     std::string log_level;
     std::vector<std::string> blacklist;
+    std::string blacklist_file;     // необязательный файл с IMSI (по одному на строку), перечитывается по SIGHUP
+    bool blacklist_bloom = true;    // фильтр Блума перед поиском по чёрному списку
+    int udp_workers = 1;            // число UDP-потоков, каждый со своим SO_REUSEPORT-сокетом
+    std::vector<int> udp_cpus;      // необязательная привязка UDP-потоков к ядрам (по индексу потока)
+    int udp_batch_size = 32;        // максимум датаграмм за один recvmmsg/sendmmsg
+    std::string udp_backend = "socket"; // socket | io_uring (при отсутствии поддержки — socket)
+    bool udp_busy_poll = false;     // UDP-потоки опрашивают сокеты в цикле, не засыпая (только socket)
+    int udp_busy_poll_usec = 50;    // SO_BUSY_POLL для сокетов в этом режиме (0 — не задавать)
+    std::vector<int> housekeeping_cpus; // ядра служебных потоков: HTTP, очистка, CDR, журнал
+    int session_shards = 64;        // число шардов таблицы сессий (округляется до степени двойки)
+    long session_capacity = 100000; // ожидаемое число сессий: таблица выделяется сразу под него
+    long max_sessions = 0;          // предел числа сессий, сверх него новым — "busy" (0 — без предела)
+    int new_session_rate = 0;       // новых сессий в секунду на сервер (0 — без ограничения)
+    int new_session_burst = 0;      // ёмкость ведра токенов новых сессий (0 — равна new_session_rate)
+    int overload_queue_delay_ms = 0; // порог задержки в очереди сокета для перегрузки (0 — выключено)
+    int cdr_ring_size = 65536;      // ёмкость очереди записей CDR
+    std::string cdr_fsync = "none"; // none | batch | interval
+    int cdr_fsync_interval_ms = 1000;
+    std::string cdr_overflow = "block"; // block | drop — поведение при заполненной очереди
+    int cdr_block_timeout_ms = 1000; // block: предел ожидания места, затем запись отбрасывается (0 — без предела)
+    std::string cdr_format = "text";    // text | binary (ротируемые сегменты, см. pgw_cdr)
+    long cdr_segment_bytes = 64L << 20;
+    int cdr_segment_sec = 3600;
+    int cdr_renew_window_sec = 0;   // окно объединения записей renew одной сессии (0 — каждое обновление)
+    std::string snapshot_file;      // снимок сессий для тёплого перезапуска (пусто — выключен)
+    int snapshot_interval_sec = 60; // период записи снимка во время работы (0 — только при остановке)
+    bool snapshot_keep_sessions = false; // при остановке не удалять сессии, а оставить их в снимке
+    std::string log_mode = "sync";  // sync | async (очередь и отдельный поток записи spdlog)
+    int log_queue_size = 8192;      // ёмкость очереди async-журнала, сообщений
+    std::string log_overflow = "block"; // block | overrun_oldest — при заполненной очереди
+    int log_flush_interval_sec = 1;     // период сброса async-журнала на диск, секунды
+    int log_event_rate = 0;         // сообщений о сессиях в секунду каждого вида на поток (0 — все)
+    // Кластер: пустой список участников — кластер выключен
+    std::string cluster_self;       // id этого экземпляра в cluster_members
+    std::vector<ClusterMemberConfig> cluster_members;
+    int cluster_peer_timeout_ms = 200; // ожидание ответа владельца IMSI
 };
 
 struct ClientConfig {
@@ -22,6 +66,13 @@ struct ClientConfig {
     int server_port;
     std::string log_file;
     std::string log_level;
+    // Ожидание ответа и повторы; окно — запросов в полёте в пакетном режиме
+    int request_timeout_ms = 1000;
+    int request_retries = 2;
+    int batch_window = 64;
+    // IMSI в одной датаграмме: 1 — исходный 8-байтовый формат,
+    // больше — пакетный протокол (protocol.h)
+    int imsis_per_datagram = 1;
 };
 
 ServerConfig loadServerConfig(const std::string& filename);
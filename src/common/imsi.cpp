@@ -0,0 +1,100 @@
+#include "imsi.h"
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kLowNibbles = 0x0F0F0F0F0F0F0F0FULL;
+constexpr uint64_t kHighNibbles = 0xF0F0F0F0F0F0F0F0ULL;
+constexpr uint64_t kSix = 0x0606060606060606ULL;
+constexpr uint64_t kFiller = 0x0FULL;
+constexpr uint8_t kNotDigit = 0x10;
+
+// Символ -> значение цифры, kNotDigit для всего остального
+constexpr std::array<uint8_t, 256> makeDigitTable() {
+    std::array<uint8_t, 256> table{};
+    for (size_t c = 0; c < table.size(); ++c) {
+        table[c] = (c >= '0' && c <= '9') ? static_cast<uint8_t>(c - '0') : kNotDigit;
+    }
+    return table;
+}
+
+// Байт BCD -> две цифры ASCII (старший полубайт первым)
+constexpr std::array<std::array<char, 2>, 256> makePairTable() {
+    std::array<std::array<char, 2>, 256> table{};
+    for (size_t b = 0; b < table.size(); ++b) {
+        table[b][0] = static_cast<char>('0' + (b >> 4));
+        table[b][1] = static_cast<char>('0' + (b & 0x0F));
+    }
+    return table;
+}
+
+constexpr auto kDigitTable = makeDigitTable();
+constexpr auto kPairTable = makePairTable();
+
+uint64_t loadBigEndian(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+void storeBigEndian(uint64_t v, uint8_t* p) {
+    v = __builtin_bswap64(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+}
+
+ImsiError decodeImsiBcd(const uint8_t* bcd, size_t size, Imsi& out) noexcept {
+    if (size != kImsiBcdSize) return ImsiError::InvalidLength;
+    uint64_t v = loadBigEndian(bcd);
+    // Полубайт > 9 при прибавлении 6 даёт перенос в старшую половину байта.
+    // Заполнитель (младший полубайт последнего байта) из проверки исключён.
+    uint64_t low = v & kLowNibbles & ~kFiller;
+    uint64_t high = (v >> 4) & kLowNibbles;
+    if (((low + kSix) | (high + kSix)) & kHighNibbles) return ImsiError::InvalidDigit;
+    out.packed = v | kFiller;
+    return ImsiError::Ok;
+}
+
+void encodeImsiBcd(Imsi imsi, uint8_t* out) noexcept {
+    storeBigEndian(imsi.packed, out);
+}
+
+ImsiError parseImsi(const char* digits, size_t length, Imsi& out) noexcept {
+    if (length != kImsiDigits) return ImsiError::InvalidLength;
+    uint64_t v = 0;
+    uint8_t bad = 0;
+    for (size_t i = 0; i < kImsiDigits; ++i) {
+        uint8_t d = kDigitTable[static_cast<unsigned char>(digits[i])];
+        bad |= d;
+        v = (v << 4) | (d & 0x0F);
+    }
+    if (bad & kNotDigit) return ImsiError::InvalidDigit;
+    out.packed = (v << 4) | kFiller;
+    return ImsiError::Ok;
+}
+
+void formatImsi(Imsi imsi, char* out) noexcept {
+    uint8_t bcd[kImsiBcdSize];
+    storeBigEndian(imsi.packed, bcd);
+    for (size_t i = 0; i < kImsiBcdSize - 1; ++i) {
+        std::memcpy(out + 2 * i, kPairTable[bcd[i]].data(), 2);
+    }
+    out[kImsiDigits - 1] = kPairTable[bcd[kImsiBcdSize - 1]][0];
+}
+
+std::string imsiToString(Imsi imsi) {
+    std::string s(kImsiDigits, '0');
+    formatImsi(imsi, &s[0]);
+    return s;
+}
+
+const char* imsiErrorMessage(ImsiError error) noexcept {
+    switch (error) {
+        case ImsiError::Ok: return "OK";
+        case ImsiError::InvalidLength: return "invalid length";
+        case ImsiError::InvalidDigit: return "invalid digit";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,72 @@
+#ifndef IMSI_H
+#define IMSI_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+constexpr size_t kImsiDigits = 15;
+constexpr size_t kImsiBcdSize = 8;
+
+// IMSI, упакованный в uint64_t: 8 байт BCD в порядке big-endian,
+// младший полубайт — заполнитель 0xF. Такое значение получается из
+// датаграммы одной загрузкой и проверкой, без разбора по символам.
+struct Imsi {
+    uint64_t packed = 0;
+
+    constexpr bool valid() const { return packed != 0; }
+    friend constexpr bool operator==(Imsi a, Imsi b) { return a.packed == b.packed; }
+    friend constexpr bool operator!=(Imsi a, Imsi b) { return a.packed != b.packed; }
+    friend constexpr bool operator<(Imsi a, Imsi b) { return a.packed < b.packed; }
+};
+
+enum class ImsiError {
+    Ok,
+    InvalidLength,
+    InvalidDigit,
+};
+
+// Декодирование 8 байт BCD. Полубайт-заполнитель не проверяется и
+// нормализуется к 0xF, все 15 цифр проверяются разом (SWAR).
+ImsiError decodeImsiBcd(const uint8_t* bcd, size_t size, Imsi& out) noexcept;
+
+// Запись 8 байт BCD в out
+void encodeImsiBcd(Imsi imsi, uint8_t* out) noexcept;
+
+// Разбор строки из 15 десятичных цифр
+ImsiError parseImsi(const char* digits, size_t length, Imsi& out) noexcept;
+
+// Запись 15 цифр в out (без завершающего нуля)
+void formatImsi(Imsi imsi, char* out) noexcept;
+
+std::string imsiToString(Imsi imsi);
+
+// Цифры IMSI на стеке — для логов без выделения памяти
+struct ImsiText {
+    explicit ImsiText(Imsi imsi) { formatImsi(imsi, digits); }
+    std::string_view view() const { return {digits, kImsiDigits}; }
+    char digits[kImsiDigits];
+};
+const char* imsiErrorMessage(ImsiError error) noexcept;
+
+// Перемешивание битов ключа (финализатор MurmurHash3): соседние IMSI
+// отличаются в младших полубайтах и без него легли бы в соседние слоты
+inline uint64_t mixImsiHash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+namespace std {
+template <>
+struct hash<Imsi> {
+    size_t operator()(Imsi imsi) const noexcept { return std::hash<uint64_t>()(imsi.packed); }
+};
+}
+
+#endif
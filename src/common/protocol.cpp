@@ -0,0 +1,45 @@
+#include "protocol.h"
+
+const char* imsiStatusName(ImsiStatus status) {
+    switch (status) {
+        case ImsiStatus::Created: return "created";
+        case ImsiStatus::Refreshed: return "refresh";
+        case ImsiStatus::Rejected: return "rejected";
+        case ImsiStatus::Busy: return "busy";
+        case ImsiStatus::Invalid: return "invalid";
+    }
+    return "unknown";
+}
+
+void writeBatchHeader(uint8_t count, uint32_t seq, uint8_t* out) {
+    out[0] = kBatchMagic[0];
+    out[1] = kBatchMagic[1];
+    out[2] = kBatchVersion;
+    out[3] = count;
+    out[4] = static_cast<uint8_t>(seq >> 24);
+    out[5] = static_cast<uint8_t>(seq >> 16);
+    out[6] = static_cast<uint8_t>(seq >> 8);
+    out[7] = static_cast<uint8_t>(seq);
+}
+
+static bool parseHeader(const uint8_t* data, size_t size, BatchHeader& out) {
+    if (size < kBatchHeaderSize || data[0] != kBatchMagic[0] || data[1] != kBatchMagic[1] ||
+        data[2] != kBatchVersion || data[3] == 0 || data[3] > kMaxBatchImsis) {
+        return false;
+    }
+    out.count = data[3];
+    out.seq = (uint32_t(data[4]) << 24) | (uint32_t(data[5]) << 16) | (uint32_t(data[6]) << 8) | data[7];
+    return true;
+}
+
+bool parseBatchRequest(const uint8_t* data, size_t size, BatchHeader& out) {
+    return parseHeader(data, size, out) && size == kBatchHeaderSize + size_t(out.count) * kImsiBcdSize;
+}
+
+bool parseBatchReply(const uint8_t* data, size_t size, BatchHeader& out) {
+    if (!parseHeader(data, size, out) || size != kBatchHeaderSize + out.count) return false;
+    for (size_t i = 0; i < out.count; ++i) {
+        if (data[kBatchHeaderSize + i] > static_cast<uint8_t>(ImsiStatus::Invalid)) return false;
+    }
+    return true;
+}
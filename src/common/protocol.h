@@ -0,0 +1,53 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include "imsi.h"
+
+// UDP-протокол pgw_server.
+//
+// Исходный формат: датаграмма ровно из 8 байт BCD одного IMSI, ответ —
+// строка "created", "refresh", "rejected" или "busy".
+//
+// Пакетный формат (версия 1) — для концентраторов, обслуживающих много
+// абонентов: одна датаграмма несёт до kMaxBatchImsis IMSI, ответ — одна
+// датаграмма с кодом состояния на каждый IMSI в том же порядке.
+//   запрос: 'P' 'B' | версия (1) | число IMSI N | номер запроса (4 байта, big-endian) | N × 8 байт BCD
+//   ответ:  'P' 'B' | версия (1) | N            | номер запроса                     | N × 1 байт ImsiStatus
+// Пакетная датаграмма не короче 16 байт, поэтому не путается с исходной.
+// Номер запроса клиент выбирает сам, сервер возвращает его без изменений.
+
+constexpr uint8_t kBatchMagic[2] = {'P', 'B'};
+constexpr uint8_t kBatchVersion = 1;
+constexpr size_t kBatchHeaderSize = 8;
+// 8 + 150 × 8 = 1208 байт: запрос помещается в один кадр Ethernet (MTU 1500)
+constexpr size_t kMaxBatchImsis = 150;
+constexpr size_t kMaxBatchRequest = kBatchHeaderSize + kMaxBatchImsis * kImsiBcdSize;
+constexpr size_t kMaxBatchReply = kBatchHeaderSize + kMaxBatchImsis;
+
+enum class ImsiStatus : uint8_t {
+    Created = 0,
+    Refreshed = 1,
+    Rejected = 2,   // чёрный список
+    Busy = 3,       // перегрузка или ограничения новых сессий
+    Invalid = 4,    // некорректный BCD
+};
+
+// Слово ответа исходного формата ("created", "refresh", ...; для Invalid — "invalid")
+const char* imsiStatusName(ImsiStatus status);
+
+struct BatchHeader {
+    uint8_t count = 0;
+    uint32_t seq = 0;
+};
+
+void writeBatchHeader(uint8_t count, uint32_t seq, uint8_t* out);
+
+// Проверка пакетного запроса: сигнатура, версия, 1 ≤ N ≤ kMaxBatchImsis
+// и длина ровно kBatchHeaderSize + N × 8
+bool parseBatchRequest(const uint8_t* data, size_t size, BatchHeader& out);
+// То же для ответа: длина kBatchHeaderSize + N, коды состояния известны
+bool parseBatchReply(const uint8_t* data, size_t size, BatchHeader& out);
+
+#endif
@@ -7,4 +7,7 @@
 std::vector<uint8_t> imsiStringToBcd(const std::string& imsi);
 std::string bcdToImsiString(const std::vector<uint8_t>& bcd);
 
+// Разбор "a.b.c.d:port" (IPv4, порт 1..65535)
+bool parseHostPort(const std::string& text, std::string& host, int& port);
+
 #endif
\ No newline at end of file
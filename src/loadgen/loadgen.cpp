@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "config.h"
+#include "imsi.h"
+#include "metrics.h"
+#include "protocol.h"
+
+// Генератор нагрузки для pgw_server: несколько потоков, у каждого свои
+// неблокирующие UDP-сокеты, запросы уходят пачками через sendmmsg,
+// ответы забираются recvmmsg. Нагрузка открытая (open-loop): запрос k
+// потока отправляется в момент start + k / rate независимо от ответов,
+// задержка считается от запланированного момента, поэтому очередь на
+// стороне сервера не прячется. С --rate 0 каждый сокет держит --window
+// запросов в полёте и отправляет новый сразу по приходу ответа.
+//
+// В исходном протоколе нет номера запроса: сервер отвечает на адрес
+// отправителя, а ответы одного сокета приходят в порядке обработки.
+// Поэтому ответ сопоставляется с самым старым неотвеченным запросом своего
+// сокета. С --batch-protocol каждый запрос — пакетная датаграмма с одним
+// IMSI и своим номером, и ответ находит запрос по номеру: поздний ответ
+// на снятый по таймауту запрос и ответы не по порядку (кластер) не
+// сдвигают задержки соседних запросов. Запрос без ответа за --timeout-ms
+// считается потерянным.
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr size_t kMaxBatch = 256;
+constexpr size_t kMaxInflightPerSocket = 4096;
+
+struct Options {
+    std::string config;
+    int threads = 2;
+    int sockets = 4;
+    double rate = 0;            // запросов в секунду на все потоки, 0 — максимум
+    int duration_sec = 10;
+    int window = 64;
+    int timeout_ms = 1000;
+    int batch = 32;
+    std::string population = "uniform";
+    size_t imsi_count = 1000000;
+    uint64_t first_imsi = 1010000000000ULL;   // 001010000000000
+    double zipf_s = 1.0;
+    std::string replay;
+    uint64_t seed = 1;
+    bool batch_protocol = false;
+};
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " <config_client.json> [options]\n"
+              << "  --threads N        потоков (2)\n"
+              << "  --sockets N        сокетов на поток (4)\n"
+              << "  --rate R           запросов/с на все потоки, 0 — максимум (0)\n"
+              << "  --duration SEC     длительность (10)\n"
+              << "  --window N         запросов в полёте на сокет при --rate 0 (64)\n"
+              << "  --timeout-ms MS    ожидание ответа (1000)\n"
+              << "  --batch N          датаграмм на sendmmsg/recvmmsg (32)\n"
+              << "  --population P     uniform | zipf | replay (uniform)\n"
+              << "  --imsi-count N     размер множества IMSI для uniform/zipf (1000000)\n"
+              << "  --first-imsi IMSI  первый IMSI множества (001010000000000)\n"
+              << "  --zipf-s S         показатель распределения Ципфа (1.0)\n"
+              << "  --replay FILE      cdr.log, из которого берутся IMSI запросов create/renew\n"
+              << "  --seed N           зерно генератора (1)\n"
+              << "  --batch-protocol   пакетный протокол, ответы сопоставляются по номеру запроса" << std::endl;
+}
+
+// Множество запросов: 8 байт BCD на IMSI
+struct Population {
+    enum class Kind { Uniform, Zipf, Replay } kind = Kind::Uniform;
+    std::vector<std::array<uint8_t, kImsiBcdSize>> payloads;
+    std::vector<double> zipf_cdf;
+};
+
+bool addImsi(const char* digits, size_t length, Population& pop) {
+    Imsi imsi;
+    if (parseImsi(digits, length, imsi) != ImsiError::Ok) return false;
+    std::array<uint8_t, kImsiBcdSize> bcd;
+    encodeImsiBcd(imsi, bcd.data());
+    pop.payloads.push_back(bcd);
+    return true;
+}
+
+bool buildPopulation(const Options& o, Population& pop) {
+    if (o.population == "replay") {
+        pop.kind = Population::Kind::Replay;
+        std::ifstream in(o.replay);
+        if (!in.is_open()) {
+            std::cerr << "Cannot open replay file: " << o.replay << std::endl;
+            return false;
+        }
+        // Строка cdr.log: "YYYY-mm-dd HH:MM:SS,<imsi>,<event>[,<renews>,<last_seen>]";
+        // запросам соответствуют create и renew
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t c1 = line.find(',');
+            size_t c2 = c1 == std::string::npos ? c1 : line.find(',', c1 + 1);
+            if (c2 == std::string::npos) continue;
+            size_t c3 = line.find(',', c2 + 1);
+            std::string event = line.substr(c2 + 1, c3 == std::string::npos ? c3 : c3 - c2 - 1);
+            if (event != "create" && event != "renew") continue;
+            addImsi(line.data() + c1 + 1, c2 - c1 - 1, pop);
+        }
+        if (pop.payloads.empty()) {
+            std::cerr << "No create/renew records in " << o.replay << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (o.population != "uniform" && o.population != "zipf") {
+        std::cerr << "Unknown population '" << o.population << "'" << std::endl;
+        return false;
+    }
+    pop.kind = o.population == "zipf" ? Population::Kind::Zipf : Population::Kind::Uniform;
+    pop.payloads.reserve(o.imsi_count);
+    char digits[32];
+    for (size_t i = 0; i < o.imsi_count; ++i) {
+        int n = std::snprintf(digits, sizeof(digits), "%015llu",
+                              static_cast<unsigned long long>(o.first_imsi + i));
+        if (!addImsi(digits, static_cast<size_t>(n), pop)) {
+            std::cerr << "IMSI range overflows 15 digits" << std::endl;
+            return false;
+        }
+    }
+    if (pop.kind == Population::Kind::Zipf) {
+        // Ранг r выбирается с вероятностью ~ 1 / r^s: CDF и двоичный поиск
+        pop.zipf_cdf.resize(o.imsi_count);
+        double sum = 0;
+        for (size_t r = 0; r < o.imsi_count; ++r) {
+            sum += 1.0 / std::pow(static_cast<double>(r + 1), o.zipf_s);
+            pop.zipf_cdf[r] = sum;
+        }
+        for (double& v : pop.zipf_cdf) v /= sum;
+    }
+    return true;
+}
+
+// Выбор следующего IMSI потока
+class ImsiSource {
+public:
+    ImsiSource(const Population& pop, uint64_t seed, size_t replay_offset)
+        : pop_(pop), rng_(seed), replay_pos_(replay_offset % pop.payloads.size()) {}
+
+    const uint8_t* next() {
+        size_t index = 0;
+        switch (pop_.kind) {
+            case Population::Kind::Uniform:
+                index = static_cast<size_t>(rng_() % pop_.payloads.size());
+                break;
+            case Population::Kind::Zipf: {
+                double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng_);
+                index = static_cast<size_t>(std::lower_bound(pop_.zipf_cdf.begin(), pop_.zipf_cdf.end(), u) -
+                                            pop_.zipf_cdf.begin());
+                if (index >= pop_.payloads.size()) index = pop_.payloads.size() - 1;
+                break;
+            }
+            case Population::Kind::Replay:
+                index = replay_pos_;
+                if (++replay_pos_ == pop_.payloads.size()) replay_pos_ = 0;
+                break;
+        }
+        return pop_.payloads[index].data();
+    }
+
+private:
+    const Population& pop_;
+    std::mt19937_64 rng_;
+    size_t replay_pos_;
+};
+
+struct WorkerResult {
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t created = 0;
+    uint64_t refreshed = 0;
+    uint64_t rejected = 0;
+    uint64_t busy = 0;
+    uint64_t other = 0;
+    uint64_t timeouts = 0;
+    uint64_t unmatched = 0;
+    uint64_t skipped = 0;      // open-loop: очередь сокета заполнена, запрос не отправлен
+    LatencyHistogram latency;  // наносекунды
+};
+
+// Запросы сокета в порядке отправки, начиная с самого старого неотвеченного.
+// Номера запросов идут подряд, поэтому запрос с номером seq лежит в слоте
+// seq - номер первого; отвеченные по номеру запросы за неотвеченным
+// остаются в кольце, пока не ответят на него или он не истечёт.
+struct SocketState {
+    struct Slot {
+        int64_t t = 0;          // момент отправки (запланированный при --rate)
+        uint32_t seq = 0;
+        bool pending = false;
+    };
+
+    int fd = -1;
+    std::vector<Slot> inflight = std::vector<Slot>(kMaxInflightPerSocket);
+    size_t head = 0;
+    size_t count = 0;           // слотов в кольце
+    size_t pending = 0;         // запросов без ответа
+    uint32_t next_seq = 0;
+
+    void push(int64_t t) {
+        inflight[(head + count) % kMaxInflightPerSocket] = Slot{t, next_seq++, true};
+        ++count;
+        ++pending;
+    }
+    const Slot& front() const { return inflight[head]; }
+    void pop() {
+        if (inflight[head].pending) --pending;
+        head = (head + 1) % kMaxInflightPerSocket;
+        --count;
+    }
+    // Ответ с номером seq: false, если такого запроса нет в полёте
+    // (снят по таймауту, уже отвечен или номер чужой)
+    bool answer(uint32_t seq, int64_t& t) {
+        if (count == 0) return false;
+        uint32_t offset = seq - inflight[head].seq;
+        if (offset >= count) return false;
+        Slot& slot = inflight[(head + offset) % kMaxInflightPerSocket];
+        if (!slot.pending) return false;
+        slot.pending = false;
+        --pending;
+        t = slot.t;
+        while (count > 0 && !inflight[head].pending) pop();
+        return true;
+    }
+};
+
+int64_t nanosSince(Clock::time_point start, Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t - start).count();
+}
+
+void runWorker(int id, const Options& o, const Population& pop, const sockaddr_in& server,
+               Clock::time_point start, WorkerResult& r) {
+    std::vector<SocketState> sockets(o.sockets);
+    std::vector<pollfd> pfds(o.sockets);
+    for (int i = 0; i < o.sockets; ++i) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) < 0) {
+            std::perror("socket/connect");
+            return;
+        }
+        sockets[i].fd = fd;
+        pfds[i] = {fd, POLLIN, 0};
+    }
+
+    ImsiSource source(pop, o.seed * 7919 + static_cast<uint64_t>(id),
+                      pop.payloads.size() / static_cast<size_t>(o.threads) * static_cast<size_t>(id));
+    const size_t batch = static_cast<size_t>(o.batch);
+    // В пакетном протоколе IMSI идёт после заголовка с номером запроса
+    const size_t imsi_offset = o.batch_protocol ? kBatchHeaderSize : 0;
+    std::vector<std::array<uint8_t, kBatchHeaderSize + kImsiBcdSize>> tx_bufs(batch);
+    std::vector<iovec> tx_iov(batch);
+    std::vector<mmsghdr> tx_msgs(batch);
+    std::vector<std::array<char, 64>> rx_bufs(batch);
+    std::vector<iovec> rx_iov(batch);
+    std::vector<mmsghdr> rx_msgs(batch);
+    for (size_t i = 0; i < batch; ++i) {
+        tx_iov[i] = {tx_bufs[i].data(), imsi_offset + kImsiBcdSize};
+        rx_iov[i] = {rx_bufs[i].data(), rx_bufs[i].size()};
+    }
+
+    const double rate = o.rate / o.threads;                     // запросов/с на поток
+    const int64_t timeout_ns = int64_t(o.timeout_ms) * 1000000;
+    const int64_t end_ns = int64_t(o.duration_sec) * 1000000000;
+    uint64_t issued = 0;   // open-loop: запросов, чей момент отправки уже обработан
+    size_t rr = 0;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        int64_t now_ns = nanosSince(start, now);
+        bool sending = now_ns < end_ns;
+        bool busy = false;
+
+        // Отправка
+        if (sending) {
+            uint64_t due = 0;
+            if (rate > 0) {
+                due = static_cast<uint64_t>(static_cast<double>(now_ns) * rate / 1e9) - issued;
+            } else {
+                for (const auto& s : sockets) due += static_cast<uint64_t>(o.window) - std::min<uint64_t>(s.pending, o.window);
+            }
+            for (size_t attempts = 0; due > 0 && attempts < sockets.size(); ++attempts) {
+                SocketState& s = sockets[rr];
+                rr = (rr + 1) % sockets.size();
+                size_t room = kMaxInflightPerSocket - s.count;
+                if (rate <= 0) room = std::min(room, static_cast<size_t>(o.window) - std::min<size_t>(s.pending, o.window));
+                size_t n = std::min<uint64_t>({due, batch, room});
+                if (n == 0) continue;
+                for (size_t i = 0; i < n; ++i) {
+                    if (o.batch_protocol) writeBatchHeader(1, s.next_seq + static_cast<uint32_t>(i), tx_bufs[i].data());
+                    std::memcpy(tx_bufs[i].data() + imsi_offset, source.next(), kImsiBcdSize);
+                    tx_msgs[i].msg_hdr = msghdr{};
+                    tx_msgs[i].msg_hdr.msg_iov = &tx_iov[i];
+                    tx_msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int sent = sendmmsg(s.fd, tx_msgs.data(), static_cast<unsigned>(n), 0);
+                if (sent <= 0) break;   // буфер сокета заполнен: повторим на следующем круге
+                for (int i = 0; i < sent; ++i) {
+                    // задержка open-loop считается от запланированного момента
+                    int64_t t = rate > 0 ? static_cast<int64_t>(static_cast<double>(issued + i) * 1e9 / rate) : now_ns;
+                    s.push(t);
+                }
+                issued += static_cast<uint64_t>(sent);
+                r.sent += static_cast<uint64_t>(sent);
+                due -= static_cast<uint64_t>(sent);
+                busy = true;
+            }
+            // Все очереди open-loop заполнены: такие запросы пропускаются, чтобы не сдвигать расписание
+            if (rate > 0 && due > 0) {
+                bool all_full = std::all_of(sockets.begin(), sockets.end(),
+                                            [](const SocketState& s) { return s.count == kMaxInflightPerSocket; });
+                if (all_full) {
+                    r.skipped += due;
+                    issued += due;
+                }
+            }
+        }
+
+        // Приём
+        for (auto& s : sockets) {
+            while (s.pending > 0 || !sending) {
+                for (size_t i = 0; i < batch; ++i) {
+                    rx_msgs[i].msg_hdr = msghdr{};
+                    rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+                    rx_msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int got = recvmmsg(s.fd, rx_msgs.data(), static_cast<unsigned>(batch), MSG_DONTWAIT, nullptr);
+                if (got <= 0) break;
+                int64_t t = nanosSince(start, Clock::now());
+                for (int i = 0; i < got; ++i) {
+                    ++r.received;
+                    if (o.batch_protocol) {
+                        const auto* data = reinterpret_cast<const uint8_t*>(rx_bufs[i].data());
+                        BatchHeader hdr;
+                        if (!parseBatchReply(data, rx_msgs[i].msg_len, hdr) || hdr.count != 1) {
+                            ++r.other;
+                            ++r.unmatched;
+                            continue;
+                        }
+                        switch (static_cast<ImsiStatus>(data[kBatchHeaderSize])) {
+                            case ImsiStatus::Created: ++r.created; break;
+                            case ImsiStatus::Refreshed: ++r.refreshed; break;
+                            case ImsiStatus::Rejected: ++r.rejected; break;
+                            case ImsiStatus::Busy: ++r.busy; break;
+                            default: ++r.other; break;
+                        }
+                        int64_t sent_at = 0;
+                        if (!s.answer(hdr.seq, sent_at)) {
+                            ++r.unmatched;
+                            continue;
+                        }
+                        r.latency.record(static_cast<uint64_t>(t > sent_at ? t - sent_at : 0));
+                        continue;
+                    }
+                    std::string_view reply(rx_bufs[i].data(), rx_msgs[i].msg_len);
+                    if (reply == "created") ++r.created;
+                    else if (reply == "refresh") ++r.refreshed;
+                    else if (reply == "rejected") ++r.rejected;
+                    else if (reply == "busy") ++r.busy;
+                    else ++r.other;
+                    if (s.count == 0) {
+                        ++r.unmatched;
+                        continue;
+                    }
+                    int64_t latency = t - s.front().t;
+                    r.latency.record(static_cast<uint64_t>(latency > 0 ? latency : 0));
+                    s.pop();
+                }
+                busy = true;
+            }
+        }
+
+        // Истёкшие ожидания
+        size_t outstanding = 0;
+        for (auto& s : sockets) {
+            while (s.count > 0 && now_ns - s.front().t > timeout_ns) {
+                r.timeouts += s.front().pending;
+                s.pop();
+            }
+            outstanding += s.pending;
+        }
+        if (!sending && (outstanding == 0 || now_ns > end_ns + timeout_ns)) {
+            r.timeouts += outstanding;
+            break;
+        }
+
+        if (!busy) {
+            // Ждём ответа или момента следующей отправки, не дольше 1 мс
+            int wait_ms = 1;
+            if (sending && rate > 0) {
+                double next_ns = static_cast<double>(issued + 1) * 1e9 / rate;
+                wait_ms = next_ns - static_cast<double>(now_ns) < 1e6 ? 0 : 1;
+            }
+            if (wait_ms > 0 || outstanding > 0) poll(pfds.data(), pfds.size(), wait_ms);
+        }
+    }
+    for (auto& s : sockets) close(s.fd);
+}
+
+// Скорости считаются по длительности отправки, без времени ожидания последних ответов
+void printReport(const Options& o, const std::vector<std::unique_ptr<WorkerResult>>& results, double elapsed) {
+    const double seconds = o.duration_sec;
+    WorkerResult total;
+    HistogramSnapshot latency;
+    for (const auto& r : results) {
+        total.sent += r->sent;
+        total.received += r->received;
+        total.created += r->created;
+        total.refreshed += r->refreshed;
+        total.rejected += r->rejected;
+        total.busy += r->busy;
+        total.other += r->other;
+        total.timeouts += r->timeouts;
+        total.unmatched += r->unmatched;
+        total.skipped += r->skipped;
+        r->latency.mergeInto(latency);
+    }
+    std::printf("population %s, threads %d x %d sockets, rate %s, %d s (elapsed %.1f s), %s protocol\n",
+                o.population.c_str(), o.threads, o.sockets,
+                o.rate > 0 ? std::to_string(static_cast<long long>(o.rate)).c_str() : "max", o.duration_sec, elapsed,
+                o.batch_protocol ? "batch" : "legacy");
+    std::printf("sent       %12llu  (%.0f/s)\n", static_cast<unsigned long long>(total.sent), total.sent / seconds);
+    std::printf("received   %12llu  (%.0f/s)\n", static_cast<unsigned long long>(total.received),
+                total.received / seconds);
+    std::printf("  created  %12llu\n  refresh  %12llu\n  rejected %12llu\n  busy     %12llu\n  other    %12llu\n",
+                static_cast<unsigned long long>(total.created), static_cast<unsigned long long>(total.refreshed),
+                static_cast<unsigned long long>(total.rejected), static_cast<unsigned long long>(total.busy),
+                static_cast<unsigned long long>(total.other));
+    std::printf("timeouts   %12llu\nunmatched  %12llu\nskipped    %12llu\n",
+                static_cast<unsigned long long>(total.timeouts), static_cast<unsigned long long>(total.unmatched),
+                static_cast<unsigned long long>(total.skipped));
+    if (latency.count == 0) return;
+    std::printf("\nlatency: mean %.1f us, max %.1f us\n", static_cast<double>(latency.sum) / latency.count / 1e3,
+                static_cast<double>(latency.quantile(1.0)) / 1e3);
+    std::printf("%12s %12s %14s\n", "value_us", "percentile", "total_count");
+    for (double q : {0.0, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.995, 0.999, 0.9999, 1.0}) {
+        uint64_t value = latency.quantile(q);
+        std::printf("%12.1f %12.6f %14llu\n", static_cast<double>(value) / 1e3, q,
+                    static_cast<unsigned long long>(latency.countAtMost(value)));
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options o;
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 1;
+    }
+    o.config = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--batch-protocol") {
+            o.batch_protocol = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "--threads") o.threads = std::stoi(value);
+            else if (arg == "--sockets") o.sockets = std::stoi(value);
+            else if (arg == "--rate") o.rate = std::stod(value);
+            else if (arg == "--duration") o.duration_sec = std::stoi(value);
+            else if (arg == "--window") o.window = std::stoi(value);
+            else if (arg == "--timeout-ms") o.timeout_ms = std::stoi(value);
+            else if (arg == "--batch") o.batch = std::stoi(value);
+            else if (arg == "--population") o.population = value;
+            else if (arg == "--imsi-count") o.imsi_count = std::stoull(value);
+            else if (arg == "--first-imsi") o.first_imsi = std::stoull(value);
+            else if (arg == "--zipf-s") o.zipf_s = std::stod(value);
+            else if (arg == "--replay") {
+                o.replay = value;
+                o.population = "replay";
+            } else if (arg == "--seed") o.seed = std::stoull(value);
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return 1;
+        }
+    }
+    if (o.threads < 1 || o.sockets < 1 || o.window < 1 || o.window > static_cast<int>(kMaxInflightPerSocket) ||
+        o.batch < 1 || o.batch > static_cast<int>(kMaxBatch) || o.imsi_count == 0 || o.rate < 0 ||
+        o.duration_sec < 1 || o.timeout_ms < 1) {
+        std::cerr << "Invalid options" << std::endl;
+        return 1;
+    }
+
+    ClientConfig config;
+    try {
+        config = loadClientConfig(o.config);
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading config: " << e.what() << std::endl;
+        return 1;
+    }
+    sockaddr_in server{};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(config.server_port);
+    if (inet_pton(AF_INET, config.server_ip.c_str(), &server.sin_addr) <= 0) {
+        std::cerr << "Invalid server IP: " << config.server_ip << std::endl;
+        return 1;
+    }
+
+    Population pop;
+    if (!buildPopulation(o, pop)) return 1;
+
+    std::vector<std::unique_ptr<WorkerResult>> results;
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i < o.threads; ++i) {
+        results.push_back(std::make_unique<WorkerResult>());
+        threads.emplace_back(runWorker, i, std::cref(o), std::cref(pop), std::cref(server), start,
+                             std::ref(*results.back()));
+    }
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    printReport(o, results, seconds);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "blacklist.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+// 16 бит фильтра на запись и 7 бит на ключ: для блочного фильтра
+// это около 0.1% ложных срабатываний
+constexpr size_t kBloomBitsPerKey = 16;
+constexpr unsigned kBloomHashes = 7;
+constexpr size_t kBloomBlockWords = 8;
+constexpr size_t kBloomBlockBits = kBloomBlockWords * 64;
+
+// Некорректных строк в логе не больше этого числа, остальные только считаются
+constexpr size_t kMaxReportedErrors = 10;
+
+}
+
+Blacklist::Blacklist(std::vector<uint64_t> keys, bool bloom) : keys_(std::move(keys)) {
+    std::sort(keys_.begin(), keys_.end());
+    keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+    if (!bloom || keys_.empty()) return;
+
+    size_t blocks = 1;
+    while (blocks * kBloomBlockBits < keys_.size() * kBloomBitsPerKey) blocks <<= 1;
+    bloom_.assign(blocks * kBloomBlockWords, 0);
+    bloom_block_mask_ = blocks - 1;
+    for (uint64_t key : keys_) bloomInsert(key);
+}
+
+// Младшие биты хэша выбирают блок, второй хэш даёт 7 позиций по 9 бит внутри блока
+void Blacklist::bloomInsert(uint64_t key) {
+    uint64_t h = mixImsiHash(key);
+    uint64_t* block = &bloom_[(h & bloom_block_mask_) * kBloomBlockWords];
+    uint64_t bits = mixImsiHash(h ^ 0x9e3779b97f4a7c15ULL);
+    for (unsigned i = 0; i < kBloomHashes; ++i, bits >>= 9) {
+        unsigned bit = static_cast<unsigned>(bits & (kBloomBlockBits - 1));
+        block[bit >> 6] |= uint64_t(1) << (bit & 63);
+    }
+}
+
+bool Blacklist::bloomMayContain(uint64_t key) const noexcept {
+    uint64_t h = mixImsiHash(key);
+    const uint64_t* block = &bloom_[(h & bloom_block_mask_) * kBloomBlockWords];
+    uint64_t bits = mixImsiHash(h ^ 0x9e3779b97f4a7c15ULL);
+    for (unsigned i = 0; i < kBloomHashes; ++i, bits >>= 9) {
+        unsigned bit = static_cast<unsigned>(bits & (kBloomBlockBits - 1));
+        if (!(block[bit >> 6] & (uint64_t(1) << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+bool Blacklist::contains(Imsi imsi) const noexcept {
+    if (keys_.empty()) return false;
+    if (!bloom_.empty() && !bloomMayContain(imsi.packed)) return false;
+    return std::binary_search(keys_.begin(), keys_.end(), imsi.packed);
+}
+
+std::vector<uint64_t> loadBlacklistFile(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw std::runtime_error("Cannot open blacklist file: " + path);
+    }
+    std::vector<uint64_t> keys;
+    std::string line;
+    size_t line_no = 0;
+    size_t errors = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') continue;
+        size_t end = line.find_last_not_of(" \t\r") + 1;
+        Imsi imsi;
+        ImsiError err = parseImsi(line.data() + begin, end - begin, imsi);
+        if (err != ImsiError::Ok) {
+            if (errors++ < kMaxReportedErrors)
+                spdlog::warn("{}:{}: blacklist entry skipped: {}", path, line_no, imsiErrorMessage(err));
+            continue;
+        }
+        keys.push_back(imsi.packed);
+    }
+    if (errors > kMaxReportedErrors)
+        spdlog::warn("{}: {} invalid blacklist entries skipped in total", path, errors);
+    return keys;
+}
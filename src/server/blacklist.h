@@ -0,0 +1,66 @@
+#ifndef BLACKLIST_H
+#define BLACKLIST_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../common/imsi.h"
+
+// Неизменяемый чёрный список: отсортированный массив упакованных IMSI
+// и необязательный блочный фильтр Блума перед ним. Фильтр отвечает на
+// типичный отрицательный запрос одним промахом кэша (все биты ключа
+// лежат в одном 64-байтном блоке); бинарный поиск нужен только для
+// попаданий и редких ложных срабатываний.
+class Blacklist {
+public:
+    Blacklist() = default;
+    // Дубликаты отбрасываются; bloom = false — только бинарный поиск
+    Blacklist(std::vector<uint64_t> keys, bool bloom);
+
+    bool contains(Imsi imsi) const noexcept;
+    size_t size() const { return keys_.size(); }
+    bool hasBloom() const { return !bloom_.empty(); }
+
+private:
+    bool bloomMayContain(uint64_t key) const noexcept;
+    void bloomInsert(uint64_t key);
+
+    std::vector<uint64_t> keys_;
+    std::vector<uint64_t> bloom_;   // блоки по 8 слов (512 бит)
+    uint64_t bloom_block_mask_ = 0;
+};
+
+// Чтение файла чёрного списка: один IMSI на строку, пустые строки
+// и строки с '#' в начале пропускаются, некорректные — с предупреждением.
+// std::runtime_error, если файл не открывается.
+std::vector<uint64_t> loadBlacklistFile(const std::string& path);
+
+// Текущий чёрный список для UDP-потоков. Перезагрузка собирает новый
+// список целиком и подменяет указатель; потоки сравнивают номер версии
+// (одно relaxed-чтение на пакет датаграмм) и берут новый указатель только
+// после подмены, так что обработка пакетов не останавливается.
+class BlacklistHolder {
+public:
+    explicit BlacklistHolder(std::shared_ptr<const Blacklist> initial)
+        : current_(std::move(initial)) {}
+
+    BlacklistHolder(const BlacklistHolder&) = delete;
+    BlacklistHolder& operator=(const BlacklistHolder&) = delete;
+
+    std::shared_ptr<const Blacklist> current() const { return std::atomic_load(&current_); }
+    uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    void replace(std::shared_ptr<const Blacklist> next) {
+        std::atomic_store(&current_, std::move(next));
+        version_.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    std::shared_ptr<const Blacklist> current_;
+    std::atomic<uint64_t> version_{0};
+};
+
+#endif
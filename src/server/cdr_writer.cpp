@@ -0,0 +1,283 @@
+#include "cdr_writer.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+constexpr size_t kBufferSize = 1 << 20;
+constexpr size_t kMaxRecordsPerDrain = 4096;
+// Страховочный таймаут ожидания: даже пропущенное пробуждение задержит запись не дольше
+constexpr auto kIdleWait = std::chrono::milliseconds(100);
+
+}
+
+CdrFsyncPolicy parseCdrFsyncPolicy(const std::string& value) {
+    if (value == "none") return CdrFsyncPolicy::None;
+    if (value == "batch") return CdrFsyncPolicy::Batch;
+    if (value == "interval") return CdrFsyncPolicy::Interval;
+    throw std::invalid_argument("Unknown cdr_fsync policy: " + value);
+}
+
+CdrOverflowPolicy parseCdrOverflowPolicy(const std::string& value) {
+    if (value == "block") return CdrOverflowPolicy::Block;
+    if (value == "drop") return CdrOverflowPolicy::Drop;
+    throw std::invalid_argument("Unknown cdr_overflow policy: " + value);
+}
+
+CdrOutputFormat parseCdrOutputFormat(const std::string& value) {
+    if (value == "text") return CdrOutputFormat::Text;
+    if (value == "binary") return CdrOutputFormat::Binary;
+    throw std::invalid_argument("Unknown cdr_format: " + value);
+}
+
+CdrWriter::CdrWriter(const CdrWriterOptions& options)
+    : options_(options), ring_(options.ring_size), buffer_(kBufferSize),
+      last_fsync_(std::chrono::steady_clock::now()) {
+    if (options_.format == CdrOutputFormat::Binary) {
+        openSegment();
+        return;
+    }
+    fd_ = ::open(options_.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open CDR file: " + options_.path + ": " + std::strerror(errno));
+    }
+}
+
+// Новый сегмент: имя из времени создания и порядкового номера, сразу с заголовком
+void CdrWriter::openSegment() {
+    segment_opened_ = std::time(nullptr);
+    std::tm tm{};
+    localtime_r(&segment_opened_, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    std::string path = options_.path + "." + stamp + "-" + std::to_string(segment_seq_++) + ".cdrb";
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open CDR segment: " + path + ": " + std::strerror(errno));
+    }
+    CdrSegmentHeader header = makeCdrSegmentHeader(segment_opened_);
+    if (::write(fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header))) {
+        ::close(fd);
+        throw std::runtime_error("Cannot write CDR segment header: " + path);
+    }
+    if (fd_ >= 0) {
+        if (options_.fsync != CdrFsyncPolicy::None) ::fdatasync(fd_);
+        ::close(fd_);
+    }
+    fd_ = fd;
+    segment_written_ = 0;
+    segments_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Ротация перед записью incoming байт: по размеру сегмента или по его возрасту.
+// Пустой сегмент не ротируется.
+void CdrWriter::maybeRotate(size_t incoming) {
+    if (options_.format != CdrOutputFormat::Binary || segment_written_ + buffer_used_ == 0) return;
+    bool too_big = options_.segment_bytes > 0 &&
+                   segment_written_ + buffer_used_ + incoming > options_.segment_bytes;
+    bool too_old = options_.segment_sec > 0 &&
+                   std::time(nullptr) - segment_opened_ >= options_.segment_sec;
+    if (!too_big && !too_old) return;
+    flushBuffer();
+    try {
+        openSegment();
+    } catch (const std::exception& e) {
+        // продолжаем писать в старый сегмент, попробуем снова при следующей записи
+        spdlog::error("CDR rotation failed: {}", e.what());
+    }
+}
+
+CdrWriter::~CdrWriter() {
+    stop();
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void CdrWriter::start() {
+    if (running_.exchange(true)) return;
+    thread_ = std::thread(&CdrWriter::run, this);
+}
+
+void CdrWriter::stop() {
+    if (!running_.exchange(false)) return;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_cv_.notify_one();
+    }
+    thread_.join();
+}
+
+bool CdrWriter::push(Imsi imsi, CdrEvent event, std::time_t timestamp, uint32_t renews, std::time_t last_seen) {
+    CdrRecord record{imsi.packed, static_cast<int64_t>(timestamp), event, renews, static_cast<int64_t>(last_seen)};
+    if (!ring_.tryPush(record)) {
+        if (options_.overflow == CdrOverflowPolicy::Drop) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (!waitForSpace(1, [&] { return ring_.tryPush(record); })) return false;
+    }
+    wakeConsumer();
+    return true;
+}
+
+size_t CdrWriter::pushBatch(const CdrRecord* records, size_t count) {
+    // Половина кольца: при Block пачка гарантированно дождётся места
+    const size_t chunk_max = std::max<size_t>(1, ring_.capacity() / 2);
+    size_t accepted = 0;
+    for (size_t done = 0; done < count;) {
+        size_t chunk = std::min(count - done, chunk_max);
+        if (ring_.tryPushBatch(records + done, chunk)) {
+            accepted += chunk;
+        } else if (options_.overflow == CdrOverflowPolicy::Drop) {
+            // места на всю часть нет: записи по одной, пока входят
+            size_t i = done;
+            while (i < done + chunk && ring_.tryPush(records[i])) ++i;
+            accepted += i - done;
+            dropped_.fetch_add(done + chunk - i, std::memory_order_relaxed);
+        } else if (waitForSpace(chunk, [&] { return ring_.tryPushBatch(records + done, chunk); })) {
+            accepted += chunk;
+        }
+        done += chunk;
+        wakeConsumer();
+    }
+    return accepted;
+}
+
+// Производитель отмечается в producers_waiting_ до проверки кольца под
+// space_mutex_, поток записи после освобождения места проверяет счётчик
+// и будит под тем же мьютексом — пробуждение не теряется (ср. wakeConsumer)
+template <typename TryPush>
+bool CdrWriter::waitForSpace(size_t count, TryPush&& try_push) {
+    const bool bounded = options_.block_timeout_ms > 0;
+    if (bounded && block_expired_.load(std::memory_order_relaxed)) {
+        dropped_.fetch_add(count, std::memory_order_relaxed);
+        block_timeouts_.fetch_add(count, std::memory_order_relaxed);
+        return false;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.block_timeout_ms);
+    producers_waiting_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool pushed = false;
+    {
+        std::unique_lock<std::mutex> lock(space_mutex_);
+        while (!(pushed = try_push())) {
+            wakeConsumer();
+            if (!bounded) {
+                space_cv_.wait(lock);
+            } else if (space_cv_.wait_until(lock, deadline) == std::cv_status::timeout) {
+                pushed = try_push();
+                break;
+            }
+        }
+    }
+    producers_waiting_.fetch_sub(1, std::memory_order_relaxed);
+    if (!pushed) {
+        block_expired_.store(true, std::memory_order_relaxed);
+        dropped_.fetch_add(count, std::memory_order_relaxed);
+        block_timeouts_.fetch_add(count, std::memory_order_relaxed);
+    }
+    return pushed;
+}
+
+void CdrWriter::wakeProducers() {
+    block_expired_.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producers_waiting_.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(space_mutex_);
+        space_cv_.notify_all();
+    }
+}
+
+// Поток записи засыпает, только выставив consumer_waiting_ и ещё раз
+// проверив кольцо; производитель после вставки проверяет флаг. Пара
+// seq_cst-барьеров гарантирует, что хотя бы одна сторона увидит другую.
+void CdrWriter::wakeConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_waiting_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_cv_.notify_one();
+    }
+}
+
+void CdrWriter::run() {
+    while (true) {
+        if (drainRing() > 0) {
+            // пишем, когда кольцо опустело или буфер заполнился (см. drainRing)
+            if (!ring_.hasData()) flushBuffer();
+            continue;
+        }
+        if (!running_.load(std::memory_order_acquire)) break;
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        consumer_waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ring_.hasData() && running_.load(std::memory_order_acquire)) {
+            wake_cv_.wait_for(lock, kIdleWait);
+        }
+        consumer_waiting_.store(false, std::memory_order_relaxed);
+        lock.unlock();
+
+        maybeRotate(0);
+        if (options_.fsync == CdrFsyncPolicy::Interval &&
+            std::chrono::steady_clock::now() - last_fsync_ >= std::chrono::milliseconds(options_.fsync_interval_ms)) {
+            ::fdatasync(fd_);
+            last_fsync_ = std::chrono::steady_clock::now();
+        }
+    }
+    // Остаток после stop()
+    while (drainRing() > 0) {}
+    flushBuffer();
+    if (options_.fsync != CdrFsyncPolicy::None) ::fdatasync(fd_);
+}
+
+size_t CdrWriter::drainRing() {
+    size_t count = 0;
+    CdrRecord record;
+    while (count < kMaxRecordsPerDrain && ring_.tryPop(record)) {
+        appendRecord(record);
+        ++count;
+    }
+    ring_.publishHead();
+    written_.fetch_add(count, std::memory_order_relaxed);
+    if (count > 0) wakeProducers();
+    return count;
+}
+
+void CdrWriter::appendRecord(const CdrRecord& record) {
+    if (options_.format == CdrOutputFormat::Binary) {
+        maybeRotate(sizeof(CdrBinaryRecord));
+        if (buffer_used_ + sizeof(CdrBinaryRecord) > buffer_.size()) flushBuffer();
+        CdrBinaryRecord bin = toBinaryRecord(record);
+        std::memcpy(buffer_.data() + buffer_used_, &bin, sizeof(bin));
+        buffer_used_ += sizeof(bin);
+        return;
+    }
+    if (buffer_used_ + CdrFormatter::kMaxLine > buffer_.size()) flushBuffer();
+    buffer_used_ += formatter_.format(record, buffer_.data() + buffer_used_);
+}
+
+void CdrWriter::flushBuffer() {
+    size_t offset = 0;
+    while (offset < buffer_used_) {
+        ssize_t n = ::write(fd_, buffer_.data() + offset, buffer_used_ - offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            spdlog::error("CDR write to {} failed: {}", options_.path, std::strerror(errno));
+            break;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    segment_written_ += offset;
+    buffer_used_ = 0;
+    auto now = std::chrono::steady_clock::now();
+    if (options_.fsync == CdrFsyncPolicy::Batch ||
+        (options_.fsync == CdrFsyncPolicy::Interval &&
+         now - last_fsync_ >= std::chrono::milliseconds(options_.fsync_interval_ms))) {
+        ::fdatasync(fd_);
+        last_fsync_ = now;
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef CDR_WRITER_H
+#define CDR_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../common/cdr_format.h"
+#include "../common/imsi.h"
+#include "mpsc_ring.h"
+
+enum class CdrFsyncPolicy { None, Batch, Interval };
+enum class CdrOverflowPolicy { Block, Drop };
+enum class CdrOutputFormat { Text, Binary };
+
+// Разбор значений из конфигурации; std::invalid_argument при неизвестном значении
+CdrFsyncPolicy parseCdrFsyncPolicy(const std::string& value);
+CdrOverflowPolicy parseCdrOverflowPolicy(const std::string& value);
+CdrOutputFormat parseCdrOutputFormat(const std::string& value);
+
+struct CdrWriterOptions {
+    std::string path;
+    size_t ring_size = 65536;
+    CdrFsyncPolicy fsync = CdrFsyncPolicy::None;
+    int fsync_interval_ms = 1000;
+    CdrOverflowPolicy overflow = CdrOverflowPolicy::Block;
+    // Block: сколько производитель ждёт места, прежде чем отбросить запись
+    // (0 — без ограничения)
+    int block_timeout_ms = 1000;
+    // Binary: записи CdrBinaryRecord в сегменты "<path>.<YYYYmmdd-HHMMSS>-<n>.cdrb",
+    // новый сегмент начинается по размеру или по возрасту (0 — без ограничения)
+    CdrOutputFormat format = CdrOutputFormat::Text;
+    size_t segment_bytes = 64 << 20;
+    int segment_sec = 3600;
+};
+
+// Асинхронная запись CDR. Производители (UDP, очистка, завершение) кладут
+// записи в lock-free MPSC-кольцо, фоновый поток забирает их пачками,
+// форматирует в большой буфер и пишет его одним write().
+// При переполнении кольца запись либо ждёт освобождения места (Block),
+// либо отбрасывается с увеличением счётчика dropped (Drop). Ожидающий
+// производитель спит на condition variable, а не крутится; если поток
+// записи не освободил место за block_timeout_ms (медленный диск), запись
+// отбрасывается, и до первого освобождения места следующие отбрасываются
+// сразу — UDP-потоки не стоят на каждой записи (счётчик block_timeouts).
+// В двоичном режиме вместо текста пишутся записи фиксированной длины
+// в ротируемые сегменты (см. cdr_format.h).
+class CdrWriter {
+public:
+    // std::runtime_error, если файл не открывается
+    explicit CdrWriter(const CdrWriterOptions& options);
+    ~CdrWriter();
+
+    CdrWriter(const CdrWriter&) = delete;
+    CdrWriter& operator=(const CdrWriter&) = delete;
+
+    void start();
+    // Дописывает всё, что осталось в кольце, и останавливает поток
+    void stop();
+
+    // renews, last_seen — счётчики объединения renew (см. CdrRecord)
+    bool push(Imsi imsi, CdrEvent event, std::time_t timestamp, uint32_t renews = 0, std::time_t last_seen = 0);
+    // Пачка записей: место в кольце резервируется одним CAS на часть пачки,
+    // поток записи будится один раз на часть. Возвращает число принятых записей
+    // (меньше count только при Drop).
+    size_t pushBatch(const CdrRecord* records, size_t count);
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    // Записи, отброшенные в режиме Block по истечении block_timeout_ms (входят в dropped)
+    uint64_t blockTimeouts() const { return block_timeouts_.load(std::memory_order_relaxed); }
+    size_t pending() const { return ring_.size(); }
+    size_t capacity() const { return ring_.capacity(); }
+    uint64_t segments() const { return segments_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    size_t drainRing();
+    void flushBuffer();
+    void wakeConsumer();
+    void wakeProducers();
+    // Block: ожидание места для count записей, вставляемых try_push();
+    // false — истёк block_timeout_ms, записи учтены как отброшенные
+    template <typename TryPush>
+    bool waitForSpace(size_t count, TryPush&& try_push);
+    void appendRecord(const CdrRecord& record);
+    void openSegment();
+    void maybeRotate(size_t incoming);
+
+    CdrWriterOptions options_;
+    int fd_ = -1;
+    MpscRing<CdrRecord> ring_;
+    CdrFormatter formatter_;
+    std::vector<char> buffer_;
+    size_t buffer_used_ = 0;
+    std::chrono::steady_clock::time_point last_fsync_;
+    size_t segment_written_ = 0;
+    std::time_t segment_opened_ = 0;
+    unsigned segment_seq_ = 0;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> consumer_waiting_{false};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    // Производители, ждущие места в кольце (Block)
+    std::atomic<int> producers_waiting_{0};
+    std::mutex space_mutex_;
+    std::condition_variable space_cv_;
+    // Ожидание истекло, а места так и не появилось: отбрасывать без ожидания
+    std::atomic<bool> block_expired_{false};
+
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> block_timeouts_{0};
+    std::atomic<uint64_t> segments_{0};
+};
+
+#endif
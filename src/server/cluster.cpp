@@ -0,0 +1,272 @@
+#include "cluster.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+#include "../common/imsi.h"
+#include "../common/protocol.h"
+#include "../common/utils.h"
+#include "log_limiter.h"
+
+// Ключ IMSI на кольце отличается от ключа выбора шарда таблицы сессий
+// (mixImsiHash без соли): иначе IMSI одного участника попадали бы в
+// малую часть шардов
+constexpr uint64_t kRingSalt = 0x9E3779B97F4A7C15ULL;
+// Период проверки истёкших запросов при отсутствии ответов
+constexpr int kPeerPollMs = 100;
+
+static sockaddr_in endpointOf(const std::string& text, const std::string& id) {
+    std::string host;
+    int port = 0;
+    if (!parseHostPort(text, host, port)) {
+        throw std::runtime_error("cluster member " + id + ": bad address '" + text + "'");
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    return addr;
+}
+
+std::vector<ClusterMember> clusterMembersFrom(const std::vector<ClusterMemberConfig>& config) {
+    std::vector<ClusterMember> members;
+    for (const ClusterMemberConfig& c : config) {
+        ClusterMember m;
+        m.id = c.id;
+        m.udp = endpointOf(c.udp, c.id);
+        m.peer = endpointOf(c.peer, c.id);
+        if (!parseHostPort(c.http, m.http_host, m.http_port)) {
+            throw std::runtime_error("cluster member " + c.id + ": bad address '" + c.http + "'");
+        }
+        members.push_back(std::move(m));
+    }
+    return members;
+}
+
+// FNV-1a: точки участника зависят только от его id, а не от порядка в списке
+static uint64_t hashId(const std::string& id) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : id) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+HashRing::HashRing(const std::vector<std::string>& ids) : members_(ids.size()) {
+    points_.reserve(ids.size() * kVirtualNodes);
+    for (size_t m = 0; m < ids.size(); ++m) {
+        uint64_t base = hashId(ids[m]);
+        for (size_t v = 0; v < kVirtualNodes; ++v) {
+            points_.emplace_back(mixImsiHash(base + v * kRingSalt), static_cast<uint32_t>(m));
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+size_t HashRing::ownerOf(uint64_t imsi) const {
+    if (points_.empty()) return 0;
+    uint64_t key = mixImsiHash(imsi ^ kRingSalt);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(key, uint32_t(0)));
+    return it == points_.end() ? points_.front().second : it->second;
+}
+
+std::vector<double> HashRing::shares() const {
+    std::vector<double> out(members_, 0.0);
+    if (points_.empty()) return out;
+    // Ключи (предыдущая точка, точка] принадлежат участнику точки;
+    // дуга через ноль — первой точке
+    uint64_t prev = points_.back().first;
+    for (const auto& [point, member] : points_) {
+        out[member] += static_cast<double>(point - prev) / 18446744073709551616.0;
+        prev = point;
+    }
+    return out;
+}
+
+ClusterForwarder::ClusterForwarder(std::vector<ClusterMember> members, size_t self,
+                                   std::chrono::milliseconds timeout)
+    : members_(std::move(members)),
+      self_(self),
+      ring_([this] {
+          std::vector<std::string> ids;
+          for (const ClusterMember& m : members_) ids.push_back(m.id);
+          return ids;
+      }()),
+      timeout_(timeout) {}
+
+ClusterForwarder::~ClusterForwarder() {
+    if (sock_ >= 0) close(sock_);
+}
+
+bool ClusterForwarder::open(std::string& error) {
+    sock_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock_ < 0) {
+        error = std::string("socket: ") + strerror(errno);
+        return false;
+    }
+    const sockaddr_in& addr = members_[self_].peer;
+    if (bind(sock_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        error = std::string("bind: ") + strerror(errno);
+        close(sock_);
+        sock_ = -1;
+        return false;
+    }
+    return true;
+}
+
+bool ClusterForwarder::fromPeer(const sockaddr_in& from) const {
+    for (size_t i = 0; i < members_.size(); ++i) {
+        if (i != self_ && members_[i].peer.sin_port == from.sin_port &&
+            members_[i].peer.sin_addr.s_addr == from.sin_addr.s_addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ClusterForwarder::forward(std::vector<Deferred>& deferred, std::vector<Item>& items, Clock::time_point now) {
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.owner < b.owner; });
+    // Датаграммы собираются под мьютексом, отправляются после: ответ,
+    // пришедший раньше возврата sendto, уже найдёт свой запрос
+    std::vector<std::pair<size_t, std::vector<uint8_t>>> out;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<uint64_t> ids(deferred.size());
+        for (size_t i = 0; i < deferred.size(); ++i) {
+            ids[i] = next_pending_++;
+            pending_.emplace(ids[i], std::move(deferred[i]));
+        }
+        const Clock::time_point deadline = now + timeout_;
+        size_t k = 0;
+        while (k < items.size()) {
+            size_t owner = items[k].owner;
+            size_t n = 0;
+            while (k + n < items.size() && items[k + n].owner == owner && n < kMaxBatchImsis) ++n;
+            uint32_t seq = next_seq_++;
+            Forward& f = forwards_[seq];
+            std::vector<uint8_t> datagram(kBatchHeaderSize + n * kImsiBcdSize);
+            writeBatchHeader(static_cast<uint8_t>(n), seq, datagram.data());
+            for (size_t j = 0; j < n; ++j) {
+                const Item& item = items[k + j];
+                encodeImsiBcd(Imsi{item.imsi}, &datagram[kBatchHeaderSize + j * kImsiBcdSize]);
+                f.slots.push_back(Slot{ids[item.deferred], item.pos});
+            }
+            order_.emplace_back(deadline, seq);
+            out.emplace_back(owner, std::move(datagram));
+            ++stats_.forwards;
+            stats_.forwarded_imsis += n;
+            k += n;
+        }
+    }
+    uint64_t errors = 0;
+    for (const auto& [owner, datagram] : out) {
+        const sockaddr_in& to = members_[owner].udp;
+        if (sendto(sock_, datagram.data(), datagram.size(), 0, reinterpret_cast<const sockaddr*>(&to),
+                   sizeof(to)) < 0) {
+            ++errors;
+        }
+    }
+    // Запрос без отправки истечёт по таймауту, как потерянный
+    if (errors) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.send_errors += errors;
+    }
+}
+
+void ClusterForwarder::complete(Deferred& d) {
+    if (d.legacy) {
+        const char* word = imsiStatusName(static_cast<ImsiStatus>(d.reply[0]));
+        sendto(d.sock, word, std::strlen(word), 0, reinterpret_cast<const sockaddr*>(&d.client), sizeof(d.client));
+    } else {
+        sendto(d.sock, d.reply.data(), d.reply.size(), 0, reinterpret_cast<const sockaddr*>(&d.client),
+               sizeof(d.client));
+    }
+    ++stats_.completed;
+}
+
+void ClusterForwarder::onReply(const uint8_t* data, size_t size) {
+    BatchHeader hdr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = parseBatchReply(data, size, hdr) ? forwards_.find(hdr.seq) : forwards_.end();
+    if (it == forwards_.end() || it->second.slots.size() != hdr.count) {
+        ++stats_.late_replies;
+        return;
+    }
+    ++stats_.replies;
+    // Ответ клиенту отправляется под мьютексом: detach не закроет сокет посреди отправки
+    for (size_t j = 0; j < hdr.count; ++j) {
+        const Slot& slot = it->second.slots[j];
+        auto p = pending_.find(slot.pending);
+        if (p == pending_.end()) continue;   // другой запрос этого ответа истёк
+        p->second.reply[slot.pos] = data[kBatchHeaderSize + j];
+        if (--p->second.remaining == 0) {
+            complete(p->second);
+            pending_.erase(p);
+        }
+    }
+    forwards_.erase(it);
+}
+
+size_t ClusterForwarder::expire(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t expired = 0;
+    while (!order_.empty() && order_.front().first <= now) {
+        auto it = forwards_.find(order_.front().second);
+        order_.pop_front();
+        if (it == forwards_.end()) continue;    // ответ уже получен
+        for (const Slot& slot : it->second.slots) pending_.erase(slot.pending);
+        forwards_.erase(it);
+        ++expired;
+    }
+    stats_.timeouts += expired;
+    return expired;
+}
+
+void ClusterForwarder::detach(int sock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        it = it->second.sock == sock ? pending_.erase(it) : std::next(it);
+    }
+}
+
+void ClusterForwarder::run(int shutdown_fd, const std::atomic<bool>& stop) {
+    auto logger = spdlog::default_logger();
+    pollfd fds[2] = {{sock_, POLLIN, 0}, {shutdown_fd, POLLIN, 0}};
+    const int poll_ms = std::min<int>(kPeerPollMs, static_cast<int>(timeout_.count()));
+    uint8_t buf[kMaxBatchReply + 1];
+    LogRateLimiter timeout_log(1);
+    uint64_t suppressed = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        int ready = poll(fds, 2, poll_ms);
+        if (ready < 0 && errno != EINTR) {
+            logger->error("Cluster peer poll failed: {}", strerror(errno));
+            break;
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            for (;;) {
+                ssize_t n = recv(sock_, buf, sizeof(buf), 0);
+                if (n < 0) break;
+                onReply(buf, static_cast<size_t>(n));
+            }
+        }
+        auto now = Clock::now();
+        size_t expired = expire(now);
+        if (expired && timeout_log.allow(now, suppressed)) {
+            logger->warn("Cluster: {} forwarded requests got no reply in {} ms{}", expired, timeout_.count(),
+                         suppressedNote(suppressed));
+        }
+    }
+}
+
+ClusterStats ClusterForwarder::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ClusterStats out = stats_;
+    out.pending = pending_.size();
+    return out;
+}
@@ -0,0 +1,159 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include "../common/config.h"
+
+// Кластер из нескольких экземпляров pgw_server со статическим списком
+// участников. Каждый IMSI принадлежит одному участнику — по согласованному
+// хешированию упакованного IMSI (HashRing), поэтому при добавлении или
+// удалении участника переезжает только его доля абонентов.
+//
+// Датаграмма, пришедшая не владельцу, не отбрасывается: IMSI других
+// участников передаются владельцам пакетными запросами (protocol.h) с
+// сокета связи этого участника на их UDP-адрес абонентов. Владелец
+// обрабатывает их как обычный пакетный запрос и отвечает на адрес
+// сокета связи; датаграммы с сокетов связи участников владелец никуда не
+// пересылает. Когда ответят владельцы всех IMSI датаграммы, поток связи
+// отправляет клиенту ответ с того же UDP-сокета, на который пришёл запрос:
+// для клиента кластер выглядит как один сервер. Порядок ответов одному
+// клиенту при этом не сохраняется — ответы исходного формата можно
+// сопоставлять по порядку только с одним запросом в полёте.
+
+struct ClusterMember {
+    std::string id;
+    sockaddr_in udp{};
+    sockaddr_in peer{};
+    std::string http_host;
+    int http_port = 0;
+};
+
+// Участники из конфига; std::runtime_error при неверном адресе
+std::vector<ClusterMember> clusterMembersFrom(const std::vector<ClusterMemberConfig>& config);
+
+// Кольцо согласованного хеширования: kVirtualNodes точек на участника
+class HashRing {
+public:
+    static constexpr size_t kVirtualNodes = 128;
+
+    explicit HashRing(const std::vector<std::string>& ids);
+
+    // Индекс участника-владельца IMSI
+    size_t ownerOf(uint64_t imsi) const;
+    // Доля пространства ключей каждого участника
+    std::vector<double> shares() const;
+
+private:
+    size_t members_;
+    // (точка на кольце, участник), по возрастанию точки
+    std::vector<std::pair<uint64_t, uint32_t>> points_;
+};
+
+// Счётчики связи с участниками
+struct ClusterStats {
+    uint64_t forwards = 0;          // пакетных запросов отправлено владельцам
+    uint64_t forwarded_imsis = 0;
+    uint64_t replies = 0;           // ответов владельцев принято
+    uint64_t completed = 0;         // отложенных ответов отправлено клиентам
+    uint64_t timeouts = 0;          // запросов владельцам без ответа за таймаут
+    uint64_t late_replies = 0;      // ответы на неизвестные или истёкшие запросы
+    uint64_t send_errors = 0;
+    uint64_t pending = 0;           // отложенных ответов клиентам сейчас
+};
+
+// Пересылка IMSI владельцам и сборка отложенных ответов клиентам.
+// Пересылки вызываются из UDP-потоков (один захват мьютекса на пакет
+// датаграмм), ответы владельцев принимает поток связи (run).
+class ClusterForwarder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ClusterForwarder(std::vector<ClusterMember> members, size_t self, std::chrono::milliseconds timeout);
+    ~ClusterForwarder();
+    ClusterForwarder(const ClusterForwarder&) = delete;
+    ClusterForwarder& operator=(const ClusterForwarder&) = delete;
+
+    // Сокет связи на адресе peer этого участника; false — причина в error
+    bool open(std::string& error);
+
+    const std::vector<ClusterMember>& members() const { return members_; }
+    size_t self() const { return self_; }
+    const HashRing& ring() const { return ring_; }
+    size_t ownerOf(uint64_t imsi) const { return ring_.ownerOf(imsi); }
+    // Датаграмма с сокета связи другого участника — её IMSI обрабатываются здесь
+    bool fromPeer(const sockaddr_in& from) const;
+
+    // Ответ клиенту, ожидающий кодов состояния от владельцев
+    struct Deferred {
+        sockaddr_in client{};
+        int sock = -1;                  // UDP-сокет, на который пришёл запрос
+        bool legacy = false;            // исходный формат: ответ — слово состояния
+        std::vector<uint8_t> reply;     // пакетный ответ с кодами своих IMSI или один код
+        size_t remaining = 0;           // IMSI, ждущих ответа владельцев
+    };
+    // IMSI для владельца: deferred — индекс в переданном векторе,
+    // pos — позиция его кода состояния в Deferred::reply
+    struct Item {
+        size_t owner;
+        size_t deferred;
+        size_t pos;
+        uint64_t imsi;
+    };
+
+    // Передача IMSI владельцам пакетами до kMaxBatchImsis; deferred
+    // перемещаются внутрь, items сортируются по владельцу
+    void forward(std::vector<Deferred>& deferred, std::vector<Item>& items, Clock::time_point now);
+    // Ответ владельца, принятый на сокет связи
+    void onReply(const uint8_t* data, size_t size);
+    // Запросы владельцам без ответа дольше таймаута: ответы их клиентам
+    // отбрасываются, клиент повторит запрос. Возвращает число истёкших.
+    size_t expire(Clock::time_point now);
+    // UDP-поток закрывает сокет: отложенные ответы через него отбрасываются
+    void detach(int sock);
+
+    // Поток связи: приём ответов владельцев и истечение запросов, пока не
+    // установлен stop; shutdown_fd (eventfd) будит поток
+    void run(int shutdown_fd, const std::atomic<bool>& stop);
+
+    ClusterStats stats() const;
+
+private:
+    struct Slot {
+        uint64_t pending;
+        size_t pos;
+    };
+    struct Forward {
+        std::vector<Slot> slots;    // в порядке IMSI запроса
+    };
+
+    // Под mutex_
+    void complete(Deferred& d);
+
+    std::vector<ClusterMember> members_;
+    size_t self_;
+    HashRing ring_;
+    std::chrono::milliseconds timeout_;
+    int sock_ = -1;
+
+    mutable std::mutex mutex_;
+    uint64_t next_pending_ = 0;
+    uint32_t next_seq_ = 0;
+    std::unordered_map<uint64_t, Deferred> pending_;
+    std::unordered_map<uint32_t, Forward> forwards_;
+    // Номера запросов в порядке отправки: срок у всех один, поэтому
+    // истёкшие всегда в начале
+    std::deque<std::pair<Clock::time_point, uint32_t>> order_;
+    ClusterStats stats_;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef LOG_LIMITER_H
+#define LOG_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Ограничение частоты однотипных сообщений журнала: не больше rate
+// сообщений за секунду. Число подавленных сообщений возвращается при
+// первом разрешённом сообщении следующей секунды, чтобы его можно было
+// дописать к строке. Объект принадлежит одному потоку; rate = 0 — без ограничения.
+class LogRateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit LogRateLimiter(uint32_t rate = 0) : rate_(rate) {}
+
+    // true — сообщение можно писать; suppressed — сколько сообщений
+    // подавлено с момента последнего разрешённого
+    bool allow(Clock::time_point now, uint64_t& suppressed) {
+        suppressed = 0;
+        if (rate_ == 0) return true;
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        if (second != window_) {
+            window_ = second;
+            used_ = 0;
+        }
+        if (used_ >= rate_) {
+            ++suppressed_;
+            return false;
+        }
+        ++used_;
+        suppressed = suppressed_;
+        suppressed_ = 0;
+        return true;
+    }
+
+private:
+    uint32_t rate_;
+    int64_t window_ = -1;
+    uint32_t used_ = 0;
+    uint64_t suppressed_ = 0;
+};
+
+// Хвост строки журнала о подавленных LogRateLimiter сообщениях
+inline std::string suppressedNote(uint64_t suppressed) {
+    return suppressed ? " (+" + std::to_string(suppressed) + " similar suppressed)" : std::string();
+}
+
+#endif
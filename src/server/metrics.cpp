@@ -0,0 +1,108 @@
+#include "metrics.h"
+#include <cstdio>
+
+namespace {
+
+// Границы le экспортируемой гистограммы: 2^10 нс (≈1 мкс) ... 2^36 нс (≈69 с)
+constexpr unsigned kFirstExportBit = 10;
+constexpr unsigned kLastExportBit = 36;
+
+std::string formatDouble(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t value) noexcept {
+    if (value > kMaxValue) value = kMaxValue;
+    if (value < 2 * kSubBuckets) return static_cast<size_t>(value);
+    unsigned msb = 63u - static_cast<unsigned>(__builtin_clzll(value));
+    unsigned shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + static_cast<size_t>((value >> shift) - kSubBuckets);
+}
+
+uint64_t LatencyHistogram::bucketUpper(size_t bucket) noexcept {
+    if (bucket < 2 * kSubBuckets) return bucket;
+    unsigned shift = static_cast<unsigned>(bucket / kSubBuckets) - 1;
+    uint64_t mantissa = kSubBuckets + bucket % kSubBuckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::mergeInto(HistogramSnapshot& out) const {
+    if (out.counts.size() != kBuckets) out.counts.assign(kBuckets, 0);
+    for (size_t i = 0; i < kBuckets; ++i) out.counts[i] += counts_[i].load(std::memory_order_relaxed);
+    out.count += count_.load(std::memory_order_relaxed);
+    out.sum += sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t HistogramSnapshot::quantile(double q) const {
+    // Сумма по корзинам, а не count: их читают не одновременно
+    uint64_t total = 0;
+    for (uint64_t c : counts) total += c;
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return LatencyHistogram::bucketUpper(i);
+    }
+    return LatencyHistogram::kMaxValue;
+}
+
+uint64_t HistogramSnapshot::countAtMost(uint64_t bound) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < counts.size() && LatencyHistogram::bucketUpper(i) <= bound; ++i) total += counts[i];
+    return total;
+}
+
+void PrometheusWriter::header(const char* name, const char* type, const char* help) {
+    out_ += "# HELP ";
+    out_ += name;
+    out_ += ' ';
+    out_ += help;
+    out_ += "\n# TYPE ";
+    out_ += name;
+    out_ += ' ';
+    out_ += type;
+    out_ += '\n';
+}
+
+void PrometheusWriter::sample(const char* name, const std::string& labels, uint64_t value) {
+    out_ += name;
+    if (!labels.empty()) out_ += '{' + labels + '}';
+    out_ += ' ';
+    out_ += std::to_string(value);
+    out_ += '\n';
+}
+
+void PrometheusWriter::sample(const char* name, const std::string& labels, double value) {
+    out_ += name;
+    if (!labels.empty()) out_ += '{' + labels + '}';
+    out_ += ' ';
+    out_ += formatDouble(value);
+    out_ += '\n';
+}
+
+void PrometheusWriter::histogram(const char* name, const char* help, const HistogramSnapshot& ns) {
+    std::string base(name);
+    header(name, "histogram", help);
+    for (unsigned bit = kFirstExportBit; bit <= kLastExportBit; ++bit) {
+        uint64_t bound = (uint64_t(1) << bit) - 1;
+        sample((base + "_bucket").c_str(), "le=\"" + formatDouble(static_cast<double>(bound + 1) / 1e9) + "\"",
+               ns.countAtMost(bound));
+    }
+    uint64_t total = 0;
+    for (uint64_t c : ns.counts) total += c;
+    sample((base + "_bucket").c_str(), "le=\"+Inf\"", total);
+    sample((base + "_sum").c_str(), "", static_cast<double>(ns.sum) / 1e9);
+    sample((base + "_count").c_str(), "", total);
+
+    std::string quantile_name = base + "_quantile";
+    header(quantile_name.c_str(), "gauge", "Upper bound of the latency quantile, seconds");
+    for (double q : {0.5, 0.9, 0.99, 0.999}) {
+        sample(quantile_name.c_str(), "quantile=\"" + formatDouble(q) + "\"",
+               static_cast<double>(ns.quantile(q)) / 1e9);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Метрики сервера. Каждый счётчик и гистограмма принадлежат одному потоку
+// и лежат в своей кэш-линии: поток-владелец обновляет их обычными
+// relaxed load/store без атомарных RMW, а HTTP-поток только читает и
+// суммирует значения в момент запроса /metrics.
+
+// Увеличение счётчика, у которого единственный писатель
+inline void bumpCounter(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Срез гистограммы для расчёта квантилей и экспорта
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    // Верхняя граница значения для квантиля q ∈ [0, 1]
+    uint64_t quantile(double q) const;
+    // Число значений не больше bound
+    uint64_t countAtMost(uint64_t bound) const;
+};
+
+// Гистограмма в стиле HDR: log-linear корзины, 16 линейных подкорзин
+// на каждую степень двойки, то есть относительная погрешность не больше
+// 1/16 во всём диапазоне. Значения больше kMaxValue попадают в последнюю корзину.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr unsigned kSubBuckets = 1u << kSubBucketBits;
+    static constexpr unsigned kMaxShift = 32;
+    static constexpr size_t kBuckets = kSubBuckets * (kMaxShift + 2);
+    static constexpr uint64_t kMaxValue = (uint64_t(2) * kSubBuckets << kMaxShift) - 1;
+
+    static size_t bucketOf(uint64_t value) noexcept;
+    // Наибольшее значение, попадающее в корзину
+    static uint64_t bucketUpper(size_t bucket) noexcept;
+
+    // Только из потока-владельца
+    void record(uint64_t value, uint64_t count = 1) noexcept {
+        bumpCounter(counts_[bucketOf(value)], count);
+        bumpCounter(count_, count);
+        bumpCounter(sum_, value * count);
+    }
+
+    // Из любого потока: прибавляет текущие значения к out
+    void mergeInto(HistogramSnapshot& out) const;
+
+private:
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+// Метрики одного UDP-потока
+struct alignas(64) WorkerMetrics {
+    std::atomic<uint64_t> rx_packets{0};
+    std::atomic<uint64_t> rx_syscalls{0};
+    std::atomic<uint64_t> tx_packets{0};
+    std::atomic<uint64_t> tx_syscalls{0};
+    std::atomic<uint64_t> tx_errors{0};         // ответы, которые ядро не приняло к отправке
+    std::atomic<uint64_t> created{0};
+    std::atomic<uint64_t> refreshed{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> decode_errors{0};
+    std::atomic<uint64_t> size_errors{0};
+    std::atomic<uint64_t> cdr_dropped{0};
+    // обновления сессий без записи renew (объединены, cdr_renew_window_sec)
+    std::atomic<uint64_t> cdr_coalesced{0};
+    // пакетные запросы (см. protocol.h) и IMSI в них
+    std::atomic<uint64_t> batch_datagrams{0};
+    std::atomic<uint64_t> batch_imsis{0};
+    // кластер: IMSI, переданные владельцам, и IMSI, принятые от других участников
+    std::atomic<uint64_t> cluster_forwarded{0};
+    std::atomic<uint64_t> cluster_peer_imsis{0};
+    // ответы "busy" по причинам (см. overload.h)
+    std::atomic<uint64_t> shed_queue{0};
+    std::atomic<uint64_t> shed_capacity{0};
+    std::atomic<uint64_t> shed_rate{0};
+    // датчики: поток перегружен (0/1), задержка в очереди последнего пакета, нс,
+    // и момент её измерения (steady_clock, нс): без датаграмм датчики не обновляются
+    std::atomic<uint64_t> overloaded{0};
+    std::atomic<uint64_t> queue_delay_ns{0};
+    std::atomic<uint64_t> queue_delay_at_ns{0};
+    // от возврата recvmmsg до отправки ответа, наносекунды
+    alignas(64) LatencyHistogram latency;
+    // от приёма ядром (SO_TIMESTAMPNS) до возврата recvmmsg, наносекунды
+    alignas(64) LatencyHistogram queue_delay;
+};
+
+// Метрики потока очистки
+struct alignas(64) CleanupMetrics {
+    std::atomic<uint64_t> expired{0};
+    std::atomic<uint64_t> cdr_dropped{0};
+    // длительность одного тика очистки, наносекунды
+    alignas(64) LatencyHistogram tick;
+};
+
+// Текстовый формат Prometheus (exposition format 0.0.4)
+class PrometheusWriter {
+public:
+    void header(const char* name, const char* type, const char* help);
+    void sample(const char* name, const std::string& labels, uint64_t value);
+    void sample(const char* name, const std::string& labels, double value);
+    // Гистограмма в секундах по срезу в наносекундах: корзины le по степеням
+    // двойки от 1 мкс и отдельная метрика <name>_quantile с p50/p90/p99/p999
+    void histogram(const char* name, const char* help, const HistogramSnapshot& ns);
+
+    const std::string& text() const { return out_; }
+
+private:
+    std::string out_;
+};
+
+#endif
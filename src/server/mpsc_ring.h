@@ -0,0 +1,117 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Ограниченная lock-free очередь «много производителей — один потребитель»
+// (схема Вьюкова: у каждой ячейки свой счётчик последовательности).
+// Производители резервируют ячейку CAS-ом по хвосту, потребитель читает
+// голову без атомарных RMW. Ёмкость округляется до степени двойки.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // false — очередь заполнена
+    bool tryPush(const T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // count элементов подряд за один CAS по хвосту; false — свободных ячеек
+    // меньше count, ничего не вставлено. Потребитель освобождает ячейки по
+    // порядку, поэтому достаточно проверить последнюю из резервируемых.
+    bool tryPushBatch(const T* values, size_t count) {
+        if (count == 0) return true;
+        if (count > mask_ + 1) return false;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t last = pos + count - 1;
+            size_t seq = cells_[last & mask_].seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(last);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                    for (size_t i = 0; i < count; ++i) {
+                        Cell& cell = cells_[(pos + i) & mask_];
+                        cell.value = values[i];
+                        cell.seq.store(pos + i + 1, std::memory_order_release);
+                    }
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Только из потока-потребителя; false — очередь пуста
+    bool tryPop(T& out) {
+        Cell& cell = cells_[head_ & mask_];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if (seq != head_ + 1) return false;
+        out = cell.value;
+        cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    // Только из потока-потребителя: есть ли готовый элемент в голове
+    bool hasData() const {
+        return cells_[head_ & mask_].seq.load(std::memory_order_acquire) == head_ + 1;
+    }
+
+    // Приблизительное число элементов (для метрик)
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_published_.load(std::memory_order_relaxed);
+        return tail >= head ? tail - head : 0;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Потребитель публикует позицию головы для size(), обычно раз на пачку
+    void publishHead() { head_published_.store(head_, std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0;
+    std::atomic<size_t> head_published_{0};
+};
+
+#endif
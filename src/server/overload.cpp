@@ -0,0 +1,47 @@
+#include "overload.h"
+
+const char* shedReasonName(ShedReason reason) {
+    switch (reason) {
+        case ShedReason::Queue: return "queue";
+        case ShedReason::Capacity: return "capacity";
+        case ShedReason::Rate: return "rate";
+    }
+    return "unknown";
+}
+
+AdmissionControl::AdmissionControl(const OverloadOptions& options) : options_(options) {
+    if (options_.new_session_rate != 0) {
+        uint32_t burst = options_.new_session_burst ? options_.new_session_burst : options_.new_session_rate;
+        interval_ns_ = 1000000000LL / options_.new_session_rate;
+        if (interval_ns_ == 0) interval_ns_ = 1;
+        tolerance_ns_ = interval_ns_ * (int64_t(burst) - 1);
+    }
+}
+
+bool AdmissionControl::takeToken(Clock::time_point now) {
+    if (interval_ns_ == 0) return true;
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+    for (;;) {
+        // Пустое ведро: запрос пришёл раньше, чем накопился следующий токен
+        int64_t base = tat > now_ns ? tat : now_ns;
+        if (base - now_ns > tolerance_ns_) return false;
+        if (tat_ns_.compare_exchange_weak(tat, base + interval_ns_, std::memory_order_relaxed)) return true;
+    }
+}
+
+bool AdmissionControl::reserveSession() {
+    if (options_.max_sessions == 0) return true;
+    if (sessions_.fetch_add(1, std::memory_order_relaxed) < options_.max_sessions) return true;
+    sessions_.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+void AdmissionControl::releaseSessions(uint64_t count) {
+    if (options_.max_sessions == 0 || count == 0) return;
+    sessions_.fetch_sub(count, std::memory_order_relaxed);
+}
+
+void AdmissionControl::setSessions(uint64_t count) {
+    sessions_.store(count, std::memory_order_relaxed);
+}
@@ -0,0 +1,103 @@
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Защита от перегрузки. Запрос, который создал бы новую сессию, получает
+// ответ "busy" вместо обработки, если:
+//   - UDP-поток перегружен: самая старая датаграмма пакета ждала в очереди
+//     сокета дольше queue_delay_ms (время приёма — метка ядра SO_TIMESTAMPNS);
+//   - сессий уже max_sessions;
+//   - исчерпано ведро токенов новых сессий (new_session_rate, new_session_burst).
+// Обновления существующих сессий и отказы по чёрному списку обслуживаются
+// всегда: они дешевле создания и не дают истечь уже подключённым абонентам.
+struct OverloadOptions {
+    uint64_t max_sessions = 0;          // 0 — без ограничения
+    uint32_t new_session_rate = 0;      // новых сессий в секунду на сервер, 0 — без ограничения
+    uint32_t new_session_burst = 0;     // ёмкость ведра, 0 — равна new_session_rate
+    uint32_t queue_delay_ms = 0;        // порог задержки в очереди сокета, 0 — не отслеживается
+};
+
+enum class ShedReason { Queue, Capacity, Rate };
+
+const char* shedReasonName(ShedReason reason);
+
+// Допуск новых сессий, общий для всех UDP-потоков. Ведро токенов
+// реализовано как GCRA: всё его состояние — теоретическое время прихода
+// следующего запроса (TAT) в одном атомике, допуск — один CAS.
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit AdmissionControl(const OverloadOptions& options);
+
+    const OverloadOptions& options() const { return options_; }
+    // Нужна ли проверка новых сессий помимо перегрузки потока
+    bool limited() const { return options_.max_sessions != 0 || options_.new_session_rate != 0; }
+
+    // Токен на одну новую сессию; true, если ограничения скорости нет
+    bool takeToken(Clock::time_point now);
+
+    // Место под новую сессию в пределах max_sessions; true, если предела
+    // нет. Счётчик общий для всех UDP-потоков: место занимается
+    // fetch_add, превышение откатывается, поэтому потоки вместе не
+    // допускают больше max_sessions. Место, сессия под которое так и не
+    // создана, и удалённые сессии возвращаются releaseSessions.
+    bool reserveSession();
+    void releaseSessions(uint64_t count);
+    // Сессии, уже лежащие в таблице (восстановленные из снимка)
+    void setSessions(uint64_t count);
+    uint64_t sessions() const { return sessions_.load(std::memory_order_relaxed); }
+
+private:
+    OverloadOptions options_;
+    int64_t interval_ns_ = 0;           // 1 / rate
+    int64_t tolerance_ns_ = 0;          // (burst - 1) / rate
+    alignas(64) std::atomic<int64_t> tat_ns_{0};
+    alignas(64) std::atomic<uint64_t> sessions_{0};
+};
+
+// Состояние перегрузки одного UDP-потока с гистерезисом: вход при задержке
+// выше порога, выход — когда она держится ниже половины порога не меньше
+// hold. Без выдержки поток, сбросивший новые сессии, сразу разбирает
+// очередь и снова их принимает, и состояние переключается десятки раз в секунду.
+// Объект принадлежит одному потоку.
+class OverloadDetector {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit OverloadDetector(uint32_t queue_delay_ms, Clock::duration hold = std::chrono::seconds(1))
+        : high_ns_(int64_t(queue_delay_ms) * 1000000), low_ns_(high_ns_ / 2), hold_(hold) {}
+
+    bool enabled() const { return high_ns_ != 0; }
+    bool overloaded() const { return overloaded_; }
+
+    // true, если состояние изменилось
+    bool update(int64_t queue_delay_ns, Clock::time_point now) {
+        if (!enabled()) return false;
+        if (!overloaded_) {
+            if (queue_delay_ns <= high_ns_) return false;
+            overloaded_ = true;
+            last_high_ = now;
+            return true;
+        }
+        if (queue_delay_ns > low_ns_) {
+            last_high_ = now;
+            return false;
+        }
+        if (now - last_high_ < hold_) return false;
+        overloaded_ = false;
+        return true;
+    }
+
+private:
+    int64_t high_ns_;
+    int64_t low_ns_;
+    Clock::duration hold_;
+    bool overloaded_ = false;
+    Clock::time_point last_high_{};
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "request_handler.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <arpa/inet.h>
+
+RequestHandler::RequestHandler(SessionTable& sessions, CdrWriter& cdr, const BlacklistHolder& blacklist,
+                               AdmissionControl& admission, WorkerMetrics& metrics, int log_event_rate)
+    : sessions_(sessions),
+      cdr_(cdr),
+      blacklist_(blacklist),
+      admission_(admission),
+      metrics_(metrics),
+      logger_(spdlog::default_logger()),
+      log_debug_(logger_->should_log(spdlog::level::debug)),
+      blacklist_version_(blacklist.version()),
+      bl_(blacklist.current()),
+      overload_(admission.options().queue_delay_ms),
+      created_log_(static_cast<uint32_t>(log_event_rate)),
+      refreshed_log_(static_cast<uint32_t>(log_event_rate)),
+      rejected_log_(static_cast<uint32_t>(log_event_rate)),
+      bad_packet_log_(static_cast<uint32_t>(log_event_rate)),
+      busy_log_(static_cast<uint32_t>(log_event_rate)) {}
+
+void RequestHandler::trackQueueDelay(const Datagram* datagrams, size_t count, SessionTable::Clock::time_point now) {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const int64_t now_ns = int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    int64_t oldest = -1;
+    for (size_t i = 0; i < count; ++i) {
+        if (datagrams[i].rx_ns == 0) continue;
+        int64_t delay = now_ns - datagrams[i].rx_ns;
+        if (delay < 0) delay = 0;   // часы реального времени переставили
+        metrics_.queue_delay.record(static_cast<uint64_t>(delay));
+        if (delay > oldest) oldest = delay;
+    }
+    if (oldest < 0) return;
+    metrics_.queue_delay_ns.store(static_cast<uint64_t>(oldest), std::memory_order_relaxed);
+    metrics_.queue_delay_at_ns.store(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count(),
+        std::memory_order_relaxed);
+    if (!overload_.update(oldest, now)) return;
+    metrics_.overloaded.store(overload_.overloaded(), std::memory_order_relaxed);
+    if (overload_.overloaded()) {
+        logger_->warn("Overload: queue delay {} ms, new sessions get 'busy'", oldest / 1000000);
+    } else {
+        logger_->info("Overload cleared: queue delay {} ms", oldest / 1000000);
+    }
+}
+
+bool RequestHandler::forwardRemote(size_t index, size_t status_pos, const Imsi& imsi) {
+    size_t owner = cluster_->ownerOf(imsi.packed);
+    if (owner == cluster_->self()) return false;
+    forward_items_.push_back(ClusterForwarder::Item{owner, index, status_pos, imsi.packed});
+    return true;
+}
+
+void RequestHandler::forwardDeferred(const Datagram* datagrams, size_t count, SessionTable::Clock::time_point now) {
+    deferred_.clear();
+    deferred_of_.assign(count, kLegacy);
+    for (ClusterForwarder::Item& item : forward_items_) {
+        size_t i = item.deferred;
+        if (deferred_of_[i] == kLegacy) {
+            deferred_of_[i] = deferred_.size();
+            ClusterForwarder::Deferred d;
+            d.client = *datagrams[i].from;
+            d.sock = reply_sock_;
+            size_t offset = reply_offsets_[i];
+            d.legacy = offset == kLegacy;
+            if (d.legacy) {
+                d.reply.assign(1, static_cast<uint8_t>(ImsiStatus::Invalid));
+            } else {
+                // Коды своих IMSI уже записаны, остальные заполнят ответы владельцев
+                d.reply.assign(reply_buf_.begin() + offset,
+                               reply_buf_.begin() + offset + kBatchHeaderSize + reply_buf_[offset + 3]);
+            }
+            deferred_.push_back(std::move(d));
+        }
+        ClusterForwarder::Deferred& d = deferred_[deferred_of_[i]];
+        ++d.remaining;
+        item.pos = d.legacy ? 0 : item.pos - reply_offsets_[i];
+        item.deferred = deferred_of_[i];
+    }
+    bumpCounter(metrics_.cluster_forwarded, forward_items_.size());
+    cluster_->forward(deferred_, forward_items_, now);
+}
+
+bool RequestHandler::decodeBatch(const Datagram& d, size_t index, bool local_only,
+                                 SessionTable::Clock::time_point now) {
+    BatchHeader hdr;
+    if (!parseBatchRequest(d.data, d.size, hdr)) return false;
+    const size_t offset = reply_buf_.size();
+    reply_buf_.resize(offset + kBatchHeaderSize + hdr.count, static_cast<uint8_t>(ImsiStatus::Invalid));
+    writeBatchHeader(hdr.count, hdr.seq, &reply_buf_[offset]);
+    reply_offsets_[index] = offset;
+    bumpCounter(metrics_.batch_datagrams);
+    bumpCounter(metrics_.batch_imsis, hdr.count);
+    if (cluster_ && local_only) bumpCounter(metrics_.cluster_peer_imsis, hdr.count);
+    uint64_t suppressed = 0;
+    const uint8_t* bcd = d.data + kBatchHeaderSize;
+    for (size_t j = 0; j < hdr.count; ++j, bcd += kImsiBcdSize) {
+        Imsi imsi;
+        ImsiError err = decodeImsiBcd(bcd, kImsiBcdSize, imsi);
+        if (err != ImsiError::Ok) {
+            // Остальные IMSI запроса обрабатываются, этот получает Invalid
+            if (bad_packet_log_.allow(now, suppressed)) {
+                logger_->warn("BCD decode error in batch {} item {}: {}{}", hdr.seq, j, imsiErrorMessage(err),
+                              suppressedNote(suppressed));
+            }
+            bumpCounter(metrics_.decode_errors);
+            continue;
+        }
+        if (!local_only && forwardRemote(index, offset + kBatchHeaderSize + j, imsi)) continue;
+        decoded_.push_back(Decoded{index, offset + kBatchHeaderSize + j, sessions_.shardOf(imsi.packed), imsi,
+                                   bl_->contains(imsi), ImsiStatus::Invalid, ShedReason::Queue});
+    }
+    return true;
+}
+
+size_t RequestHandler::handle(const Datagram* datagrams, size_t count, Reply* replies) {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t suppressed = 0;
+    if (blacklist_.version() != blacklist_version_) {
+        blacklist_version_ = blacklist_.version();
+        bl_ = blacklist_.current();
+    }
+
+    trackQueueDelay(datagrams, count, now);
+
+    // Декодирование и проверка чёрного списка — вне блокировки шардов
+    decoded_.clear();
+    reply_buf_.clear();
+    reply_offsets_.assign(count, kLegacy);
+    forward_items_.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const Datagram& d = datagrams[i];
+        replies[i] = Reply{nullptr, 0};
+        // IMSI от других участников кластера уже у владельца и не пересылаются
+        const bool local_only = !cluster_ || cluster_->fromPeer(*d.from);
+        if (log_debug_) {
+            char addr[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &d.from->sin_addr, addr, sizeof(addr));
+            logger_->debug("Received {} bytes from {}:{}", d.size, addr, ntohs(d.from->sin_port));
+        }
+        if (d.truncated || (d.size != kImsiBcdSize && !decodeBatch(d, i, local_only, now))) {
+            if (bad_packet_log_.allow(now, suppressed)) {
+                logger_->warn("Packet size {} is neither 8 nor a valid batch request{}", d.size,
+                              suppressedNote(suppressed));
+            }
+            bumpCounter(metrics_.size_errors);
+            continue;
+        }
+        if (reply_offsets_[i] != kLegacy) continue;
+        Imsi imsi;
+        ImsiError err = decodeImsiBcd(d.data, d.size, imsi);
+        if (err != ImsiError::Ok) {
+            if (bad_packet_log_.allow(now, suppressed)) {
+                logger_->warn("BCD decode error: {}{}", imsiErrorMessage(err), suppressedNote(suppressed));
+            }
+            bumpCounter(metrics_.decode_errors);
+            continue;
+        }
+        if (log_debug_) logger_->debug("Decoded IMSI {}", ImsiText(imsi).view());
+        if (!local_only && forwardRemote(i, kLegacy, imsi)) continue;
+        decoded_.push_back(Decoded{i, kLegacy, sessions_.shardOf(imsi.packed), imsi, bl_->contains(imsi),
+                                   ImsiStatus::Invalid, ShedReason::Queue});
+    }
+
+    // Группировка по шардам: каждый шард блокируется один раз на пакет.
+    // Внутри шарда — порядок приёма: повтор IMSI в пакете получает "created"
+    // и "refresh" (и записи CDR) в том же порядке, что и датаграммы
+    std::sort(decoded_.begin(), decoded_.end(), [](const Decoded& a, const Decoded& b) {
+        if (a.shard != b.shard) return a.shard < b.shard;
+        if (a.index != b.index) return a.index < b.index;
+        return a.status_pos < b.status_pos;
+    });
+    auto now_c = std::time(nullptr);
+    uint64_t cdr_dropped = 0;
+    // Новые сессии проверяются, только если их сейчас можно не допустить:
+    // тогда перед созданием нужен лишний поиск в шарде
+    const bool overloaded = overload_.overloaded();
+    const bool check_new = overloaded || admission_.limited();
+    // При объединении renew записи CDR несут счётчики (см. CdrRecord)
+    const std::time_t last_seen = sessions_.coalescesRenews() ? now_c : 0;
+    uint64_t coalesced = 0;
+    size_t k = 0;
+    while (k < decoded_.size()) {
+        size_t shard = decoded_[k].shard;
+        sessions_.withShard(shard, [&](SessionTable::Shard& s) {
+            for (; k < decoded_.size() && decoded_[k].shard == shard; ++k) {
+                Decoded& d = decoded_[k];
+                if (d.blacklisted) {
+                    d.status = ImsiStatus::Rejected;
+                } else if (check_new && !s.find(d.imsi.packed)) {
+                    bool shed = true;
+                    if (overloaded) {
+                        d.shed = ShedReason::Queue;
+                    } else if (!admission_.reserveSession()) {
+                        d.shed = ShedReason::Capacity;
+                    } else if (!admission_.takeToken(now)) {
+                        admission_.releaseSessions(1);
+                        d.shed = ShedReason::Rate;
+                    } else {
+                        shed = false;
+                    }
+                    if (shed) {
+                        d.status = ImsiStatus::Busy;
+                    } else {
+                        s.touch(d.imsi.packed, now);
+                        cdr_dropped += !cdr_.push(d.imsi, CdrEvent::Create, now_c);
+                        d.status = ImsiStatus::Created;
+                    }
+                } else {
+                    uint32_t renews = 0;
+                    switch (s.touch(d.imsi.packed, now, &renews)) {
+                        case SessionTable::TouchResult::Refreshed:
+                            cdr_dropped += !cdr_.push(d.imsi, CdrEvent::Renew, now_c, renews, last_seen);
+                            d.status = ImsiStatus::Refreshed;
+                            break;
+                        case SessionTable::TouchResult::Coalesced:
+                            ++coalesced;
+                            d.status = ImsiStatus::Refreshed;
+                            break;
+                        case SessionTable::TouchResult::Created:
+                            cdr_dropped += !cdr_.push(d.imsi, CdrEvent::Create, now_c);
+                            d.status = ImsiStatus::Created;
+                            break;
+                    }
+                }
+            }
+        });
+    }
+    if (cdr_dropped) bumpCounter(metrics_.cdr_dropped, cdr_dropped);
+    if (coalesced) bumpCounter(metrics_.cdr_coalesced, coalesced);
+
+    size_t answered = 0;
+    for (const Decoded& d : decoded_) {
+        if (d.status_pos == kLegacy) {
+            const char* word = imsiStatusName(d.status);
+            replies[d.index] = Reply{reinterpret_cast<const uint8_t*>(word), std::strlen(word)};
+            ++answered;
+        } else {
+            reply_buf_[d.status_pos] = static_cast<uint8_t>(d.status);
+        }
+        switch (d.status) {
+            case ImsiStatus::Rejected:
+                if (rejected_log_.allow(now, suppressed)) {
+                    logger_->info("Subscriber {} rejected (blacklist){}", ImsiText(d.imsi).view(),
+                                  suppressedNote(suppressed));
+                }
+                bumpCounter(metrics_.rejected);
+                break;
+            case ImsiStatus::Busy:
+                if (busy_log_.allow(now, suppressed)) {
+                    logger_->info("Subscriber {} busy ({}){}", ImsiText(d.imsi).view(), shedReasonName(d.shed),
+                                  suppressedNote(suppressed));
+                }
+                switch (d.shed) {
+                    case ShedReason::Queue: bumpCounter(metrics_.shed_queue); break;
+                    case ShedReason::Capacity: bumpCounter(metrics_.shed_capacity); break;
+                    case ShedReason::Rate: bumpCounter(metrics_.shed_rate); break;
+                }
+                break;
+            case ImsiStatus::Refreshed:
+                if (refreshed_log_.allow(now, suppressed)) {
+                    logger_->info("Session refreshed for IMSI {}{}", ImsiText(d.imsi).view(),
+                                  suppressedNote(suppressed));
+                }
+                bumpCounter(metrics_.refreshed);
+                break;
+            default:
+                if (created_log_.allow(now, suppressed)) {
+                    logger_->info("Session created for IMSI {}{}", ImsiText(d.imsi).view(),
+                                  suppressedNote(suppressed));
+                }
+                bumpCounter(metrics_.created);
+                break;
+        }
+    }
+    if (!forward_items_.empty()) forwardDeferred(datagrams, count, now);
+    // Буфер пакетных ответов больше не растёт: указатели берутся в конце
+    for (size_t i = 0; i < count; ++i) {
+        size_t offset = reply_offsets_[i];
+        if (offset == kLegacy) continue;
+        if (!forward_items_.empty() && deferred_of_[i] != kLegacy) continue;
+        replies[i] = Reply{&reply_buf_[offset], kBatchHeaderSize + reply_buf_[offset + 3]};
+        ++answered;
+    }
+    return answered;
+}
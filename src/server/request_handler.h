@@ -0,0 +1,122 @@
+#ifndef REQUEST_HANDLER_H
+#define REQUEST_HANDLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+#include <spdlog/spdlog.h>
+#include "../common/imsi.h"
+#include "../common/protocol.h"
+#include "session_table.h"
+#include "cdr_writer.h"
+#include "blacklist.h"
+#include "metrics.h"
+#include "log_limiter.h"
+#include "overload.h"
+#include "cluster.h"
+
+// Максимальный размер принимаемой датаграммы — самый длинный пакетный запрос
+// (см. protocol.h); датаграмма длиннее обрезается ядром и отбрасывается
+constexpr size_t kMaxDatagram = kMaxBatchRequest;
+// Максимальный размер ответа
+constexpr size_t kMaxReply = kMaxBatchReply;
+
+// Принятая датаграмма, откуда бы она ни пришла (recvmmsg или io_uring)
+struct Datagram {
+    const uint8_t* data;
+    size_t size;
+    bool truncated;            // не поместилась в буфер приёма
+    const sockaddr_in* from;
+    int64_t rx_ns;             // время приёма ядром (CLOCK_REALTIME, SO_TIMESTAMPNS), 0 — неизвестно
+};
+
+// Ответ на датаграмму; data == nullptr — ответа нет
+struct Reply {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Обработка запросов одного UDP-потока, общая для всех способов приёма:
+// декодирование, проверка чёрного списка, допуск новых сессий, обновление
+// сессий (каждый шард блокируется один раз на пакет), CDR, журнал и
+// счётчики потока.
+// Объект принадлежит одному потоку.
+class RequestHandler {
+public:
+    RequestHandler(SessionTable& sessions, CdrWriter& cdr, const BlacklistHolder& blacklist,
+                   AdmissionControl& admission, WorkerMetrics& metrics, int log_event_rate);
+
+    // replies[i] — ответ на datagrams[i]; data == nullptr, если датаграмма
+    // отброшена (неверный размер или BCD исходного формата). Ответы на
+    // пакетные запросы лежат во внутреннем буфере и действительны до
+    // следующего вызова. Возвращает число ответов.
+    size_t handle(const Datagram* datagrams, size_t count, Reply* replies);
+
+    // Кластер: IMSI других участников передаются владельцам, датаграмма
+    // с ними получает ответ позже — его отправляет поток связи с reply_sock
+    void setCluster(ClusterForwarder* cluster, int reply_sock) {
+        cluster_ = cluster;
+        reply_sock_ = reply_sock;
+    }
+
+private:
+    // Для IMSI исходного формата: ответ — строка
+    static constexpr size_t kLegacy = SIZE_MAX;
+
+    struct Decoded {
+        size_t index;       // индекс датаграммы в пакете
+        size_t status_pos;  // позиция кода состояния в reply_buf_ или kLegacy
+        size_t shard;
+        Imsi imsi;
+        bool blacklisted;
+        ImsiStatus status;
+        ShedReason shed;    // причина ответа "busy"
+    };
+
+    // Разбор пакетного запроса datagrams[index]: заголовок ответа в
+    // reply_buf_, IMSI — в decoded_
+    bool decodeBatch(const Datagram& d, size_t index, bool local_only, SessionTable::Clock::time_point now);
+    // IMSI другого участника кластера: запоминается для передачи владельцу
+    bool forwardRemote(size_t index, size_t status_pos, const Imsi& imsi);
+    // Отложенные ответы на датаграммы с IMSI других участников и передача
+    // этих IMSI владельцам
+    void forwardDeferred(const Datagram* datagrams, size_t count, SessionTable::Clock::time_point now);
+
+    // Задержка датаграмм в очереди сокета: гистограмма и состояние перегрузки
+    void trackQueueDelay(const Datagram* datagrams, size_t count, SessionTable::Clock::time_point now);
+
+    SessionTable& sessions_;
+    CdrWriter& cdr_;
+    const BlacklistHolder& blacklist_;
+    AdmissionControl& admission_;
+    WorkerMetrics& metrics_;
+    std::shared_ptr<spdlog::logger> logger_;
+    bool log_debug_;
+    // Свой указатель на чёрный список; после перезагрузки подменяется
+    // при обработке следующего пакета датаграмм
+    uint64_t blacklist_version_;
+    std::shared_ptr<const Blacklist> bl_;
+    std::vector<Decoded> decoded_;
+    // Ответы на пакетные запросы текущего пакета датаграмм
+    std::vector<uint8_t> reply_buf_;
+    std::vector<size_t> reply_offsets_;
+    // Кластер: IMSI для владельцев (deferred — индекс датаграммы, затем
+    // отложенного ответа; pos — позиция в reply_buf_, затем в ответе)
+    ClusterForwarder* cluster_ = nullptr;
+    int reply_sock_ = -1;
+    std::vector<ClusterForwarder::Item> forward_items_;
+    std::vector<ClusterForwarder::Deferred> deferred_;
+    std::vector<size_t> deferred_of_;
+    OverloadDetector overload_;
+    // Сообщения о каждой датаграмме — не чаще log_event_rate в секунду каждого вида
+    LogRateLimiter created_log_;
+    LogRateLimiter refreshed_log_;
+    LogRateLimiter rejected_log_;
+    LogRateLimiter bad_packet_log_;
+    LogRateLimiter busy_log_;
+};
+
+#endif
@@ -2,26 +2,101 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <map>
-#include <set>
+#include <algorithm>
 #include <chrono>
-#include <fstream>
+#include <functional>
 #include <httplib.h>
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include "../common/config.h"
-#include "../common/utils.h"
-#include <iomanip>
+#include "../common/imsi.h"
+#include "session_table.h"
+#include "cdr_writer.h"
+#include "blacklist.h"
+#include "session_snapshot.h"
+#include "metrics.h"
+#include "log_limiter.h"
+#include "request_handler.h"
+#include "udp_loop.h"
+#include "overload.h"
+#include "cluster.h"
+#include "shutdown_drain.h"
 #include <ctime>
+#include <csignal>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/sock_diag.h>
+#include <pthread.h>
+#include <sched.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <string_view>
 
-struct Session {
-    std::chrono::steady_clock::time_point creation_time;
-};
+// Максимум IMSI в одном запросе /check_subscribers
+constexpr size_t kMaxBatchLookup = 100000;
+
+// Выгрузка /sessions: слотов таблицы на один шаг обхода и сессий на один chunk
+constexpr size_t kExportScanSlots = 1024;
+constexpr size_t kExportChunkSessions = 4096;
+
+// SIGHUP: запрос на перечитывание чёрного списка, выполняется потоком очистки.
+// Обработчик будит поток через eventfd (write допустим в обработчике сигнала).
+static std::atomic<bool> g_blacklist_reload_requested{false};
+static int g_reload_fd = -1;
+
+static void onSighup(int) {
+    g_blacklist_reload_requested.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    if (g_reload_fd >= 0) (void)!write(g_reload_fd, &one, sizeof(one));
+}
+
+// Набор ядер CPU из списка номеров; номера вне [0, CPU_SETSIZE) пропускаются
+static cpu_set_t cpuSetOf(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return set;
+}
+
+// Привязка потока к набору ядер CPU; при ошибке её код в errno
+static bool pinThreadToCpus(pthread_t thread, const cpu_set_t& set) {
+    int rc = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rc != 0) errno = rc;
+    return rc == 0;
+}
+
+static std::string cpuList(const std::vector<int>& cpus) {
+    std::string out;
+    for (int cpu : cpus) {
+        if (!out.empty()) out += ',';
+        out += std::to_string(cpu);
+    }
+    return out;
+}
+
+// Очередь приёма сокета (SO_MEMINFO): занятые байты и предел rcvbuf;
+// false, если сокета нет или ядро не ответило
+static bool socketQueueBytes(int sock, uint32_t& used, uint32_t& limit) {
+    if (sock < 0) return false;
+    uint32_t info[SK_MEMINFO_VARS] = {};
+    socklen_t len = sizeof(info);
+    if (getsockopt(sock, SOL_SOCKET, SO_MEMINFO, info, &len) < 0) return false;
+    used = info[SK_MEMINFO_RMEM_ALLOC];
+    limit = info[SK_MEMINFO_RCVBUF];
+    return true;
+}
 
 int main(int argc, char* argv[]) {
     if (argc != 2) {
@@ -39,6 +114,25 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // Служебные потоки (HTTP, очистка, запись CDR, снимок, async-журнал
+    // spdlog, связь кластера) наследуют привязку главного потока, поэтому
+    // она задаётся до их создания. UDP-потоки без своего ядра в udp_cpus
+    // получают остальные ядра процесса.
+    cpu_set_t worker_cpus;
+    if (sched_getaffinity(0, sizeof(worker_cpus), &worker_cpus) < 0) CPU_ZERO(&worker_cpus);
+    bool housekeeping_pinned = false;
+    int housekeeping_errno = 0;
+    if (!config.housekeeping_cpus.empty()) {
+        cpu_set_t housekeeping = cpuSetOf(config.housekeeping_cpus);
+        housekeeping_pinned = pinThreadToCpus(pthread_self(), housekeeping);
+        housekeeping_errno = errno;
+        if (housekeeping_pinned) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &housekeeping)) CPU_CLR(cpu, &worker_cpus);
+            }
+        }
+    }
+
     // Настройка логгера
     bool enable_debug = (config.log_level == "DEBUG");
     auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
@@ -48,45 +142,225 @@ int main(int argc, char* argv[]) {
     // В файл: всегда логируется всё
     file_sink->set_level(spdlog::level::debug);
 
-    auto logger = std::make_shared<spdlog::logger>(
-        "pgw_logger",
-        spdlog::sinks_init_list{console_sink, file_sink}
-    );
-    logger->set_level(spdlog::level::debug);
-    logger->flush_on(spdlog::level::info);
+    std::shared_ptr<spdlog::logger> logger;
+    if (config.log_mode == "async") {
+        // Запись в файл и консоль — в отдельном потоке spdlog через ограниченную
+        // очередь. Сброс на диск по таймеру, предупреждения и ошибки — сразу.
+        spdlog::init_thread_pool(static_cast<size_t>(config.log_queue_size), 1);
+        auto overflow = config.log_overflow == "overrun_oldest" ? spdlog::async_overflow_policy::overrun_oldest
+                                                                : spdlog::async_overflow_policy::block;
+        logger = std::make_shared<spdlog::async_logger>(
+            "pgw_logger", spdlog::sinks_init_list{console_sink, file_sink}, spdlog::thread_pool(), overflow);
+        // debug-сообщения не форматируются вовсе, если они не нужны
+        logger->set_level(enable_debug ? spdlog::level::debug : spdlog::level::info);
+        logger->flush_on(spdlog::level::warn);
+        spdlog::flush_every(std::chrono::seconds(config.log_flush_interval_sec));
+    } else {
+        logger = std::make_shared<spdlog::logger>(
+            "pgw_logger",
+            spdlog::sinks_init_list{console_sink, file_sink}
+        );
+        logger->set_level(spdlog::level::debug);
+        logger->flush_on(spdlog::level::info);
+    }
     spdlog::set_default_logger(logger);
 
     logger->info("Server starting: UDP {}:{}  HTTP port {}  CDR file {}  log_level={}",
                  config.udp_ip, config.udp_port, config.http_port, config.cdr_file, config.log_level);
-    logger->debug("Config: timeout={}s, graceful_rate={} sess/sec",
-                  config.session_timeout_sec, config.graceful_shutdown_rate);
+    logger->debug("Config: timeout={}s, graceful_rate={} sess/sec, udp_workers={}, udp_batch_size={}",
+                  config.session_timeout_sec, config.graceful_shutdown_rate, config.udp_workers,
+                  config.udp_batch_size);
+    logger->debug("Logging: mode={}, queue={}, overflow={}, flush_interval={}s, event_rate={}/s",
+                  config.log_mode, config.log_queue_size, config.log_overflow, config.log_flush_interval_sec,
+                  config.log_event_rate);
+    if (housekeeping_pinned) {
+        logger->info("Housekeeping threads pinned to CPUs {}", cpuList(config.housekeeping_cpus));
+    } else if (!config.housekeeping_cpus.empty()) {
+        logger->warn("Failed to pin housekeeping threads to CPUs {}: {}", cpuList(config.housekeeping_cpus),
+                     strerror(housekeeping_errno));
+    }
+    if (config.udp_busy_poll) {
+        logger->info("UDP busy-poll mode: workers on CPUs {}, SO_BUSY_POLL {} us", cpuList(config.udp_cpus),
+                     config.udp_busy_poll_usec);
+    }
+    logger->debug("Overload: max_sessions={}, new_session_rate={}/s, burst={}, queue_delay={} ms",
+                  config.max_sessions, config.new_session_rate, config.new_session_burst,
+                  config.overload_queue_delay_ms);
+
+    std::unique_ptr<CdrWriter> cdr;
+    try {
+        CdrWriterOptions cdr_options;
+        cdr_options.path = config.cdr_file;
+        cdr_options.ring_size = config.cdr_ring_size;
+        cdr_options.fsync = parseCdrFsyncPolicy(config.cdr_fsync);
+        cdr_options.fsync_interval_ms = config.cdr_fsync_interval_ms;
+        cdr_options.overflow = parseCdrOverflowPolicy(config.cdr_overflow);
+        cdr_options.block_timeout_ms = config.cdr_block_timeout_ms;
+        cdr_options.format = parseCdrOutputFormat(config.cdr_format);
+        cdr_options.segment_bytes = static_cast<size_t>(config.cdr_segment_bytes);
+        cdr_options.segment_sec = config.cdr_segment_sec;
+        cdr = std::make_unique<CdrWriter>(cdr_options);
+    } catch (const std::exception& e) {
+        logger->critical("{}", e.what());
+        return 1;
+    }
+    cdr->start();
 
-    std::ofstream cdr_stream(config.cdr_file, std::ios::app);
-    if (!cdr_stream.is_open()) {
-        logger->critical("Cannot open CDR file: {}", config.cdr_file);
+    SessionTable sessions(config.session_shards, config.session_capacity,
+                          std::chrono::seconds(config.session_timeout_sec));
+    sessions.setRenewWindow(std::chrono::seconds(config.cdr_renew_window_sec));
+    // Плавное завершение; ход удаления виден в GET /shutdown
+    ShutdownDrain drain(sessions, static_cast<uint32_t>(config.graceful_shutdown_rate));
+    // Тёплый перезапуск: сессии из снимка восстанавливаются с оставшимся сроком,
+    // абонентам не нужно заново подключаться всем сразу
+    if (!config.snapshot_file.empty()) {
+        auto started = std::chrono::steady_clock::now();
+        try {
+            size_t restored = loadSessionSnapshot(sessions, config.snapshot_file);
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started).count();
+            logger->info("Restored {} sessions from snapshot {} in {} ms", restored, config.snapshot_file, ms);
+        } catch (const std::exception& e) {
+            logger->error("{}; starting with empty session table", e.what());
+        }
+    }
+
+    // Чёрный список: записи из конфига плюс необязательный файл blacklist_file.
+    // При перезагрузке список собирается заново и подменяется целиком;
+    // при ошибке чтения файла остаётся прежний.
+    auto build_blacklist = [&]() {
+        std::vector<uint64_t> keys;
+        for (const auto& entry : config.blacklist) {
+            Imsi imsi;
+            ImsiError err = parseImsi(entry.data(), entry.size(), imsi);
+            if (err != ImsiError::Ok) {
+                logger->warn("Blacklist entry '{}' skipped: {}", entry, imsiErrorMessage(err));
+                continue;
+            }
+            keys.push_back(imsi.packed);
+        }
+        if (!config.blacklist_file.empty()) {
+            std::vector<uint64_t> from_file = loadBlacklistFile(config.blacklist_file);
+            keys.insert(keys.end(), from_file.begin(), from_file.end());
+        }
+        return std::make_shared<const Blacklist>(std::move(keys), config.blacklist_bloom);
+    };
+    std::unique_ptr<BlacklistHolder> blacklist;
+    try {
+        blacklist = std::make_unique<BlacklistHolder>(build_blacklist());
+    } catch (const std::exception& e) {
+        logger->critical("{}", e.what());
         return 1;
     }
+    logger->info("Blacklist loaded: {} entries", blacklist->current()->size());
+    std::mutex blacklist_reload_mutex;
+    auto reload_blacklist = [&](std::string& message) {
+        std::lock_guard<std::mutex> lock(blacklist_reload_mutex);
+        try {
+            auto next = build_blacklist();
+            message = "Blacklist reloaded: " + std::to_string(next->size()) + " entries";
+            blacklist->replace(std::move(next));
+            logger->info("{}", message);
+            return true;
+        } catch (const std::exception& e) {
+            message = std::string("Blacklist reload failed: ") + e.what();
+            logger->error("{}", message);
+            return false;
+        }
+    };
+    // Допуск новых сессий общий для всех UDP-потоков
+    OverloadOptions overload_options;
+    overload_options.max_sessions = static_cast<uint64_t>(config.max_sessions);
+    overload_options.new_session_rate = static_cast<uint32_t>(config.new_session_rate);
+    overload_options.new_session_burst = static_cast<uint32_t>(config.new_session_burst);
+    overload_options.queue_delay_ms = static_cast<uint32_t>(config.overload_queue_delay_ms);
+    AdmissionControl admission(overload_options);
+    admission.setSessions(sessions.size());
 
-    std::map<std::string, Session> sessions;
-    std::set<std::string> blacklist(config.blacklist.begin(), config.blacklist.end());
-    bool shutting_down = false;
+    // Кластер: сокет связи открывается до UDP-потоков, чтобы IMSI других
+    // участников из первых же датаграмм было через что переслать
+    std::unique_ptr<ClusterForwarder> cluster;
+    if (!config.cluster_members.empty()) {
+        std::string error;
+        try {
+            std::vector<ClusterMember> members = clusterMembersFrom(config.cluster_members);
+            size_t self = 0;
+            while (members[self].id != config.cluster_self) ++self;
+            cluster = std::make_unique<ClusterForwarder>(std::move(members), self,
+                                                         std::chrono::milliseconds(config.cluster_peer_timeout_ms));
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        if (!cluster || !cluster->open(error)) {
+            logger->critical("Cluster setup failed: {}", error);
+            return 1;
+        }
+        const ClusterMember& me = cluster->members()[cluster->self()];
+        logger->info("Cluster member '{}' of {}, owns {:.1f}% of IMSIs, peer link on {}", me.id,
+                     cluster->members().size(), cluster->ring().shares()[cluster->self()] * 100,
+                     config.cluster_members[cluster->self()].peer);
+    }
+
+    // Остановка: флаг читается потоками без блокировок, eventfd будит потоки,
+    // ждущие в epoll. Счётчик eventfd не вычитывается, поэтому после
+    // остановки он остаётся готовым для всех потоков сразу.
+    std::atomic<bool> shutting_down{false};
+    int shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    g_reload_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (shutdown_fd < 0 || g_reload_fd < 0) {
+        logger->critical("eventfd failed: {}", strerror(errno));
+        return 1;
+    }
+    auto request_shutdown = [&]() {
+        if (shutting_down.exchange(true)) return;
+        uint64_t one = 1;
+        (void)!write(shutdown_fd, &one, sizeof(one));
+    };
+
+    struct sigaction sa{};
+    sa.sa_handler = onSighup;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, nullptr);
+
+    // Значение проверено при загрузке конфига
+    const UdpBackend udp_backend = parseUdpBackend(config.udp_backend);
     bool shutdown_complete = false;
+    bool workers_stopped = false;       // UDP-потоки и поток кластера завершились
     std::mutex mutex;
     std::condition_variable cv;
-    std::mutex cdr_mutex;
+    // Метрики: у каждого UDP-потока и у потока очистки свои, суммируются при запросе
+    std::vector<std::unique_ptr<WorkerMetrics>> worker_metrics;
+    for (int i = 0; i < config.udp_workers; ++i) worker_metrics.push_back(std::make_unique<WorkerMetrics>());
+    CleanupMetrics cleanup_metrics;
+    // Перегрузка потока для отчётов: флаг потока меняется только при приёме
+    // датаграмм, поэтому без трафика дольше секунды поток считается свободным
+    auto worker_overloaded = [](const WorkerMetrics& m) {
+        if (m.overloaded.load(std::memory_order_relaxed) == 0) return false;
+        auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        return now_ns - static_cast<int64_t>(m.queue_delay_at_ns.load(std::memory_order_relaxed)) < 1000000000;
+    };
+    // Сокеты UDP-потоков — для чтения длины их очередей из HTTP-потока
+    std::vector<std::atomic<int>> worker_socks(config.udp_workers);
+    for (auto& fd : worker_socks) fd.store(-1);
 
-    // UDP функция
-    auto udp_function = [&]() {
-        logger->debug("Starting UDP thread");
-        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    // UDP функция: каждый поток открывает свой сокет на udp_ip:udp_port,
+    // ядро распределяет датаграммы между сокетами группы SO_REUSEPORT
+    auto udp_function = [&](int worker_id) {
+        logger->debug("Starting UDP thread #{}", worker_id);
+        WorkerMetrics& metrics = *worker_metrics[worker_id];
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
         if (sock < 0) {
             logger->critical("Cannot create UDP socket: {}", strerror(errno));
             return;
         }
 
-        timeval tv{1, 0};
-        if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-            logger->warn("Failed to set SO_RCVTIMEO: {}", strerror(errno));
+        int reuse = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+            logger->critical("Failed to set SO_REUSEPORT: {}", strerror(errno));
+            close(sock);
+            return;
         }
 
         sockaddr_in serv_addr{};
@@ -98,180 +372,794 @@ int main(int argc, char* argv[]) {
             close(sock);
             return;
         }
-        logger->info("UDP listening on {}:{}", config.udp_ip, config.udp_port);
-
-        while (true) {
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                if (shutting_down) {
-                    logger->debug("UDP thread stopping");
-                    break;
+        logger->info("UDP thread #{} listening on {}:{} ({})", worker_id, config.udp_ip, config.udp_port,
+                     config.udp_backend);
+        if (!enableRxTimestamps(sock)) {
+            logger->warn("UDP thread #{}: SO_TIMESTAMPNS failed ({}), queue delay is not tracked", worker_id,
+                         strerror(errno));
+        }
+        worker_socks[worker_id].store(sock);
+        if (config.udp_busy_poll && config.udp_busy_poll_usec > 0 &&
+            !enableBusyPoll(sock, config.udp_busy_poll_usec)) {
+            logger->warn("UDP thread #{}: SO_BUSY_POLL failed ({}), polling the socket only", worker_id,
+                         strerror(errno));
+        }
+
+        // Обработка запросов общая для обоих способов приёма
+        RequestHandler handler(sessions, *cdr, *blacklist, admission, metrics, config.log_event_rate);
+        if (cluster) handler.setCluster(cluster.get(), sock);
+        UdpLoopOptions loop;
+        loop.sock = sock;
+        loop.shutdown_fd = shutdown_fd;
+        loop.stop = &shutting_down;
+        loop.batch_size = config.udp_batch_size;
+        loop.busy_poll = config.udp_busy_poll;
+        bool done = false;
+        if (udp_backend == UdpBackend::IoUring) {
+            std::string error;
+            done = runUringLoop(loop, handler, metrics, error);
+            if (!done) logger->warn("UDP thread #{}: io_uring unavailable ({}), using sockets", worker_id, error);
+        }
+        if (!done) runSocketLoop(loop, handler, metrics);
+        logger->debug("UDP thread #{} stopping", worker_id);
+        worker_socks[worker_id].store(-1);
+        if (cluster) cluster->detach(sock);
+        close(sock);
+    };
+
+    // HTTP функция
+    // HTTP работает до конца плавного завершения и останавливается из main
+    httplib::Server svr;
+    bool http_stopped = false;          // под mutex: listen вернул управление
+    // Запросы HTTP API к другим участникам кластера: соединения живут между
+    // запросами (keep-alive). httplib::Client не рассчитан на одновременные
+    // запросы из нескольких потоков, поэтому у каждого участника свой набор
+    // свободных клиентов: обработчик берёт клиент (или создаёт новый, если
+    // все заняты) и возвращает его после успешного ответа
+    struct PeerHttpClients {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<httplib::Client>> idle;
+    };
+    std::vector<PeerHttpClients> peer_http(cluster ? cluster->members().size() : 0);
+    auto peer_call = [&](size_t owner, const std::function<httplib::Result(httplib::Client&)>& call) {
+        const ClusterMember& m = cluster->members()[owner];
+        PeerHttpClients& peer = peer_http[owner];
+        std::unique_ptr<httplib::Client> client;
+        {
+            std::lock_guard<std::mutex> lock(peer.mutex);
+            if (!peer.idle.empty()) {
+                client = std::move(peer.idle.back());
+                peer.idle.pop_back();
+            }
+        }
+        if (!client) {
+            client = std::make_unique<httplib::Client>(m.http_host, m.http_port);
+            client->set_keep_alive(true);
+            client->set_connection_timeout(0, config.cluster_peer_timeout_ms * 1000);
+            client->set_read_timeout(0, config.cluster_peer_timeout_ms * 1000);
+        }
+        httplib::Result result = call(*client);
+        // Клиент с оборванным или зависшим соединением не возвращается в набор
+        if (result && result->status == 200) {
+            std::lock_guard<std::mutex> lock(peer.mutex);
+            peer.idle.push_back(std::move(client));
+        }
+        return result;
+    };
+    auto http_function = [&]() {
+        logger->debug("Starting HTTP thread");
+        svr.Get("/check_subscriber", [&](auto& req, auto& res) {
+            std::string imsi = req.get_param_value("imsi");
+            logger->debug("HTTP /check_subscriber imsi={}", imsi);
+            // некорректный IMSI не может иметь сессии
+            Imsi packed;
+            bool valid = parseImsi(imsi.data(), imsi.size(), packed) == ImsiError::Ok;
+            // В кластере сессия есть только у владельца IMSI: запрос передаётся
+            // ему с local=1, чтобы при расхождении списков участников не зациклиться
+            if (valid && cluster && req.get_param_value("local") != "1") {
+                size_t owner = cluster->ownerOf(packed.packed);
+                if (owner != cluster->self()) {
+                    const ClusterMember& m = cluster->members()[owner];
+                    auto result = peer_call(owner, [&](httplib::Client& client) {
+                        return client.Get("/check_subscriber?imsi=" + imsi + "&local=1");
+                    });
+                    if (!result || result->status != 200) {
+                        logger->warn("HTTP /check_subscriber: owner '{}' of {} unavailable", m.id, imsi);
+                        res.status = 502;
+                        res.set_content("owner " + m.id + " unavailable", "text/plain");
+                        return;
+                    }
+                    res.body = result->body;
+                    return;
                 }
             }
+            res.body = valid && sessions.contains(packed.packed) ? "active" : "not active";
+        });
+        // Пакетная проверка: IMSI по одному на строку или JSON-массив строк.
+        // Ответ в том же формате и порядке; с ?ttl=1 для активных сессий
+        // добавляется оставшийся срок в секундах. В кластере IMSI других
+        // участников проверяются у владельцев одним запросом на участника
+        // (с local=1, как в /check_subscriber).
+        svr.Post("/check_subscribers", [&](const httplib::Request& req, httplib::Response& res) {
+            bool with_ttl = req.get_param_value("ttl") == "1";
+            size_t first = req.body.find_first_not_of(" \t\r\n");
+            bool json = first != std::string::npos && req.body[first] == '[';
+            std::vector<std::string_view> texts;
+            nlohmann::json input;
+            if (json) {
+                input = nlohmann::json::parse(req.body, nullptr, false);
+                if (!input.is_array()) {
+                    res.status = 400;
+                    res.set_content("Body must be a JSON array of IMSI strings", "text/plain");
+                    return;
+                }
+                if (input.size() > kMaxBatchLookup) {
+                    res.status = 413;
+                    res.set_content("Too many IMSIs, limit is " + std::to_string(kMaxBatchLookup), "text/plain");
+                    return;
+                }
+                // Не строка — "invalid"; в ответе в поле imsi возвращается сам элемент
+                for (const auto& item : input) {
+                    texts.push_back(item.is_string() ? std::string_view(item.get_ref<const std::string&>())
+                                                     : std::string_view());
+                }
+            } else {
+                std::string_view body(req.body);
+                while (!body.empty()) {
+                    size_t eol = body.find('\n');
+                    std::string_view line = body.substr(0, eol);
+                    body = eol == std::string_view::npos ? std::string_view() : body.substr(eol + 1);
+                    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+                    while (!line.empty() && line.front() == ' ') line.remove_prefix(1);
+                    if (line.empty()) continue;
+                    if (texts.size() == kMaxBatchLookup) {
+                        res.status = 413;
+                        res.set_content("Too many IMSIs, limit is " + std::to_string(kMaxBatchLookup), "text/plain");
+                        return;
+                    }
+                    texts.push_back(line);
+                }
+            }
+            logger->debug("HTTP /check_subscribers: {} IMSIs", texts.size());
 
-            char buffer[8];
-            sockaddr_in cli_addr{};
-            socklen_t len = sizeof(cli_addr);
-            int n = recvfrom(sock, buffer, sizeof(buffer), 0, (sockaddr*)&cli_addr, &len);
-            if (n < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
-                logger->error("recvfrom error: {}", strerror(errno));
-                continue;
+            // Некорректный IMSI даёт ключ 0, которого в таблице не бывает
+            std::vector<uint64_t> keys(texts.size());
+            for (size_t i = 0; i < texts.size(); ++i) {
+                Imsi imsi;
+                if (parseImsi(texts[i].data(), texts[i].size(), imsi) == ImsiError::Ok) keys[i] = imsi.packed;
             }
-            logger->debug("Received {} bytes from {}:{}", n,
-                          inet_ntoa(cli_addr.sin_addr), ntohs(cli_addr.sin_port));
-            if (n != 8) {
-                logger->warn("Packet size {} != 8", n);
-                continue;
+            std::vector<SessionTable::Session> found;
+            sessions.lookupBatch(keys, found);
+            auto now = std::chrono::steady_clock::now();
+            // unavailable — владелец IMSI в кластере не ответил
+            enum class Lookup : uint8_t { Invalid, NotActive, Active, Unavailable };
+            static const char* const kLookupNames[] = {"invalid", "not active", "active", "unavailable"};
+            std::vector<Lookup> state(texts.size());
+            std::vector<int64_t> ttl(texts.size(), 0);
+            for (size_t i = 0; i < texts.size(); ++i) {
+                if (keys[i] == 0) {
+                    state[i] = Lookup::Invalid;
+                } else if (found[i].imsi == 0) {
+                    state[i] = Lookup::NotActive;
+                } else {
+                    state[i] = Lookup::Active;
+                    auto left = std::chrono::duration_cast<std::chrono::seconds>(found[i].expires_at - now).count();
+                    ttl[i] = left > 0 ? left : 0;
+                }
+            }
+            if (cluster && req.get_param_value("local") != "1") {
+                std::vector<std::vector<size_t>> by_owner(cluster->members().size());
+                for (size_t i = 0; i < texts.size(); ++i) {
+                    if (keys[i] != 0) by_owner[cluster->ownerOf(keys[i])].push_back(i);
+                }
+                for (size_t owner = 0; owner < by_owner.size(); ++owner) {
+                    const std::vector<size_t>& indices = by_owner[owner];
+                    if (owner == cluster->self() || indices.empty()) continue;
+                    std::string body;
+                    body.reserve(indices.size() * 16);
+                    for (size_t i : indices) {
+                        body.append(texts[i]);
+                        body += '\n';
+                    }
+                    auto result = peer_call(owner, [&](httplib::Client& client) {
+                        return client.Post(with_ttl ? "/check_subscribers?local=1&ttl=1" : "/check_subscribers?local=1",
+                                           body, "text/plain");
+                    });
+                    // Ответ владельца — строки "<IMSI> <состояние>[ <ttl>]" в порядке запроса
+                    std::string_view reply = result && result->status == 200 ? std::string_view(result->body)
+                                                                              : std::string_view();
+                    size_t unavailable = 0;
+                    for (size_t i : indices) {
+                        size_t eol = reply.find('\n');
+                        std::string_view line = reply.substr(0, eol);
+                        reply = eol == std::string_view::npos ? std::string_view() : reply.substr(eol + 1);
+                        std::string_view rest = line.size() > texts[i].size() && line.substr(0, texts[i].size()) == texts[i]
+                                                    ? line.substr(texts[i].size() + 1)
+                                                    : std::string_view();
+                        if (rest == "not active") {
+                            state[i] = Lookup::NotActive;
+                        } else if (rest.substr(0, 6) == "active") {
+                            state[i] = Lookup::Active;
+                            ttl[i] = rest.size() > 7 ? std::atoll(std::string(rest.substr(7)).c_str()) : 0;
+                        } else {
+                            state[i] = Lookup::Unavailable;
+                            ++unavailable;
+                        }
+                    }
+                    if (unavailable) {
+                        logger->warn("HTTP /check_subscribers: owner '{}' did not answer for {} IMSIs",
+                                     cluster->members()[owner].id, unavailable);
+                    }
+                }
             }
 
-            std::vector<uint8_t> bcd(buffer, buffer+8);
-            std::string imsi;
-            try {
-                imsi = bcdToImsiString(bcd);
-            } catch (const std::exception& e) {
-                logger->warn("BCD decode error: {}", e.what());
-                continue;
+            if (json) {
+                nlohmann::json out = nlohmann::json::array();
+                for (size_t i = 0; i < texts.size(); ++i) {
+                    nlohmann::json item = {{"imsi", input[i]}, {"status", kLookupNames[static_cast<int>(state[i])]}};
+                    if (with_ttl && state[i] == Lookup::Active) item["ttl"] = ttl[i];
+                    out.push_back(std::move(item));
+                }
+                res.set_content(out.dump(), "application/json");
+                return;
             }
-            logger->debug("Decoded IMSI {}", imsi);
-
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                if (blacklist.count(imsi)) {
-                    sendto(sock, "rejected", 8, 0, (sockaddr*)&cli_addr, len);
-                    logger->info("Subscriber {} rejected (blacklist)", imsi);
-                } else if (sessions.count(imsi)) {
-                    // обновляем время существующей сессии
-                    sessions[imsi].creation_time = std::chrono::steady_clock::now();
-                    {
-                        std::lock_guard<std::mutex> cdr_lock(cdr_mutex);
-                        auto now_c = std::time(nullptr);
-                        cdr_stream << std::put_time(std::localtime(&now_c), "%Y-%m-%d %H:%M:%S")
-                                   << "," << imsi << ",renew\n";
+            std::string out;
+            out.reserve(texts.size() * 32);
+            for (size_t i = 0; i < texts.size(); ++i) {
+                out.append(texts[i]);
+                out += ' ';
+                out += kLookupNames[static_cast<int>(state[i])];
+                if (with_ttl && state[i] == Lookup::Active) {
+                    out += ' ';
+                    out += std::to_string(ttl[i]);
+                }
+                out += '\n';
+            }
+            res.set_content(out, "text/plain");
+        });
+        // Выгрузка всех сессий потоком (chunked): CSV "imsi,age_sec,ttl_sec".
+        // Таблица обходится курсором небольшими участками без блокировок,
+        // память на запрос не зависит от числа сессий. В кластере за своими
+        // сессиями идут выгрузки остальных участников (с local=1) без их
+        // заголовков; если участник не ответил, выгрузка обрывается, и клиент
+        // получает незавершённый ответ, а не неполный список.
+        svr.Get("/sessions", [&](auto& req, auto& res) {
+            logger->info("HTTP /sessions export started");
+            struct Export {
+                uint64_t cursor = 0;
+                bool header_sent = false;
+                bool local_done = false;
+                bool remote = false;
+                size_t member = 0;          // следующий участник кластера
+                std::vector<SessionTable::Session> batch;
+                std::string text;
+            };
+            auto state = std::make_shared<Export>();
+            state->remote = cluster && req.get_param_value("local") != "1";
+            res.set_chunked_content_provider("text/csv", [&, state](size_t, httplib::DataSink& sink) {
+                Export& e = *state;
+                if (e.local_done) {
+                    // Один участник за вызов
+                    if (e.member == cluster->self()) ++e.member;
+                    if (e.member == cluster->members().size()) {
+                        sink.done();
+                        return true;
                     }
-                    logger->info("Session refreshed for IMSI {}", imsi);
-                    sendto(sock, "refreshed", 7, 0, (sockaddr*)&cli_addr, len);
-                } else {
-                    // создание новой сессии...
-                    sessions[imsi] = Session{std::chrono::steady_clock::now()};
-                    {
-                        std::lock_guard<std::mutex> cdr_lock(cdr_mutex);
-                        auto now_c = std::time(nullptr);
-                        cdr_stream << std::put_time(std::localtime(&now_c), "%Y-%m-%d %H:%M:%S")
-                                   << "," << imsi << ",create\n";
+                    const size_t owner = e.member++;
+                    bool header = true;
+                    auto result = peer_call(owner, [&](httplib::Client& client) {
+                        return client.Get(
+                            "/sessions?local=1", [](const httplib::Response& r) { return r.status == 200; },
+                            [&](const char* data, size_t size) {
+                                std::string_view chunk(data, size);
+                                if (header) {
+                                    size_t eol = chunk.find('\n');
+                                    if (eol == std::string_view::npos) return true;
+                                    header = false;
+                                    chunk.remove_prefix(eol + 1);
+                                }
+                                return chunk.empty() || sink.write(chunk.data(), chunk.size());
+                            });
+                    });
+                    if (!result || result->status != 200) {
+                        logger->warn("HTTP /sessions: export from '{}' failed, aborting",
+                                     cluster->members()[owner].id);
+                        return false;
                     }
-                    logger->info("Session created for IMSI {}", imsi);
-                    sendto(sock, "created", 7, 0, (sockaddr*)&cli_addr, len);
+                    return true;
+                }
+                e.text.clear();
+                if (!e.header_sent) {
+                    e.text = "imsi,age_sec,ttl_sec\n";
+                    e.header_sent = true;
+                }
+                e.batch.clear();
+                do {
+                    e.cursor = sessions.scan(e.cursor, kExportScanSlots, e.batch);
+                } while (e.cursor != 0 && e.batch.size() < kExportChunkSessions);
+
+                auto now = std::chrono::steady_clock::now();
+                for (const auto& s : e.batch) {
+                    auto age = std::chrono::duration_cast<std::chrono::seconds>(now - s.created).count();
+                    auto ttl = std::chrono::duration_cast<std::chrono::seconds>(s.expires_at - now).count();
+                    e.text.append(ImsiText(Imsi{s.imsi}).view());
+                    e.text += ',';
+                    e.text += std::to_string(age);
+                    e.text += ',';
+                    e.text += std::to_string(ttl > 0 ? ttl : 0);
+                    e.text += '\n';
+                }
+                if (!e.text.empty() && !sink.write(e.text.data(), e.text.size())) return false;
+                if (e.cursor == 0) {
+                    e.local_done = true;
+                    if (!e.remote) sink.done();
                 }
+                return true;
+            });
+        });
+        svr.Get("/stats", [&](auto&, auto& res) {
+            uint64_t rx_packets = 0, rx_syscalls = 0, tx_packets = 0, tx_syscalls = 0, tx_errors = 0;
+            uint64_t shed_queue = 0, shed_capacity = 0, shed_rate = 0, overloaded = 0;
+            uint64_t batch_datagrams = 0, batch_imsis = 0, cdr_coalesced = 0;
+            uint64_t cluster_forwarded = 0, cluster_peer_imsis = 0;
+            for (const auto& m : worker_metrics) {
+                cluster_forwarded += m->cluster_forwarded.load(std::memory_order_relaxed);
+                cluster_peer_imsis += m->cluster_peer_imsis.load(std::memory_order_relaxed);
+                cdr_coalesced += m->cdr_coalesced.load(std::memory_order_relaxed);
+                batch_datagrams += m->batch_datagrams.load(std::memory_order_relaxed);
+                batch_imsis += m->batch_imsis.load(std::memory_order_relaxed);
+                shed_queue += m->shed_queue.load(std::memory_order_relaxed);
+                shed_capacity += m->shed_capacity.load(std::memory_order_relaxed);
+                shed_rate += m->shed_rate.load(std::memory_order_relaxed);
+                overloaded += worker_overloaded(*m);
+                rx_packets += m->rx_packets.load(std::memory_order_relaxed);
+                rx_syscalls += m->rx_syscalls.load(std::memory_order_relaxed);
+                tx_packets += m->tx_packets.load(std::memory_order_relaxed);
+                tx_syscalls += m->tx_syscalls.load(std::memory_order_relaxed);
+                tx_errors += m->tx_errors.load(std::memory_order_relaxed);
             }
-        }
-        close(sock);
-    };
+            std::ostringstream out;
+            out << "udp_rx_packets " << rx_packets << "\n"
+                << "udp_rx_syscalls " << rx_syscalls << "\n"
+                << "udp_rx_packets_per_syscall "
+                << (rx_syscalls ? static_cast<double>(rx_packets) / rx_syscalls : 0.0) << "\n"
+                << "udp_tx_packets " << tx_packets << "\n"
+                << "udp_tx_syscalls " << tx_syscalls << "\n"
+                << "udp_tx_packets_per_syscall "
+                << (tx_syscalls ? static_cast<double>(tx_packets) / tx_syscalls : 0.0) << "\n"
+                << "udp_tx_errors " << tx_errors << "\n"
+                << "udp_batch_datagrams " << batch_datagrams << "\n"
+                << "udp_batch_imsis " << batch_imsis << "\n"
+                << "cdr_written " << cdr->written() << "\n"
+                << "cdr_dropped " << cdr->dropped() << "\n"
+                << "cdr_block_timeouts " << cdr->blockTimeouts() << "\n"
+                << "cdr_coalesced " << cdr_coalesced << "\n"
+                << "cdr_pending " << cdr->pending() << "\n"
+                << "cdr_segments " << cdr->segments() << "\n"
+                << "blacklist_entries " << blacklist->current()->size() << "\n"
+                << "blacklist_reloads " << blacklist->version() << "\n"
+                << "shed_queue " << shed_queue << "\n"
+                << "shed_capacity " << shed_capacity << "\n"
+                << "shed_rate " << shed_rate << "\n"
+                << "overloaded_workers " << overloaded << "\n";
+            if (cluster) {
+                ClusterStats cs = cluster->stats();
+                out << "cluster_forwarded " << cluster_forwarded << "\n"
+                    << "cluster_peer_imsis " << cluster_peer_imsis << "\n"
+                    << "cluster_forward_timeouts " << cs.timeouts << "\n"
+                    << "cluster_pending_replies " << cs.pending << "\n";
+            }
+            res.set_content(out.str(), "text/plain");
+        });
+        // Prometheus: счётчики по потокам (метка worker), датчики и гистограммы задержек
+        svr.Get("/metrics", [&](auto&, auto& res) {
+            PrometheusWriter out;
+            struct Counter {
+                const char* name;
+                const char* help;
+                std::atomic<uint64_t> WorkerMetrics::*field;
+            };
+            static const Counter counters[] = {
+                {"pgw_udp_rx_packets_total", "Datagrams received", &WorkerMetrics::rx_packets},
+                {"pgw_udp_rx_syscalls_total", "recvmmsg calls that returned data", &WorkerMetrics::rx_syscalls},
+                {"pgw_udp_tx_packets_total", "Replies sent", &WorkerMetrics::tx_packets},
+                {"pgw_udp_tx_syscalls_total", "sendmmsg, sendto or io_uring_enter calls that sent replies",
+                 &WorkerMetrics::tx_syscalls},
+                {"pgw_udp_tx_errors_total", "Replies the kernel refused to send", &WorkerMetrics::tx_errors},
+                {"pgw_sessions_created_total", "Sessions created", &WorkerMetrics::created},
+                {"pgw_sessions_refreshed_total", "Sessions refreshed", &WorkerMetrics::refreshed},
+                {"pgw_requests_rejected_total", "Requests rejected by blacklist", &WorkerMetrics::rejected},
+                {"pgw_decode_errors_total", "Datagrams with invalid BCD", &WorkerMetrics::decode_errors},
+                {"pgw_size_errors_total", "Datagrams with wrong size", &WorkerMetrics::size_errors},
+                {"pgw_udp_batch_datagrams_total", "Multi-IMSI batch requests received",
+                 &WorkerMetrics::batch_datagrams},
+                {"pgw_udp_batch_imsis_total", "IMSIs carried in batch requests", &WorkerMetrics::batch_imsis},
+                {"pgw_cdr_dropped_total", "CDR records dropped on full queue", &WorkerMetrics::cdr_dropped},
+                {"pgw_cdr_coalesced_total", "Session refreshes folded into renew counters",
+                 &WorkerMetrics::cdr_coalesced},
+                {"pgw_cluster_forwarded_imsis_total", "IMSIs forwarded to their owner cluster member",
+                 &WorkerMetrics::cluster_forwarded},
+                {"pgw_cluster_peer_imsis_total", "IMSIs received from other cluster members",
+                 &WorkerMetrics::cluster_peer_imsis},
+            };
+            for (const Counter& c : counters) {
+                out.header(c.name, "counter", c.help);
+                for (size_t i = 0; i < worker_metrics.size(); ++i) {
+                    out.sample(c.name, "worker=\"" + std::to_string(i) + "\"",
+                               (*worker_metrics[i].*c.field).load(std::memory_order_relaxed));
+                }
+                if (c.field == &WorkerMetrics::cdr_dropped) {
+                    out.sample(c.name, "worker=\"cleanup\"",
+                               cleanup_metrics.cdr_dropped.load(std::memory_order_relaxed));
+                }
+            }
+            out.header("pgw_requests_shed_total", "counter", "New-session requests answered 'busy'");
+            for (size_t i = 0; i < worker_metrics.size(); ++i) {
+                const WorkerMetrics& m = *worker_metrics[i];
+                std::string worker = "worker=\"" + std::to_string(i) + "\",reason=";
+                out.sample("pgw_requests_shed_total", worker + "\"queue\"", m.shed_queue.load(std::memory_order_relaxed));
+                out.sample("pgw_requests_shed_total", worker + "\"capacity\"",
+                           m.shed_capacity.load(std::memory_order_relaxed));
+                out.sample("pgw_requests_shed_total", worker + "\"rate\"", m.shed_rate.load(std::memory_order_relaxed));
+            }
+            out.header("pgw_sessions_expired_total", "counter", "Sessions removed by timeout");
+            out.sample("pgw_sessions_expired_total", "", cleanup_metrics.expired.load(std::memory_order_relaxed));
+            out.header("pgw_sessions_shutdown_total", "counter", "Sessions removed by graceful shutdown");
+            out.sample("pgw_sessions_shutdown_total", "", drain.progress(std::chrono::steady_clock::now()).removed);
+            out.header("pgw_cdr_written_total", "counter", "CDR records written by the writer thread");
+            out.sample("pgw_cdr_written_total", "", cdr->written());
+            out.header("pgw_cdr_block_timeouts_total", "counter",
+                       "CDR records dropped after waiting cdr_block_timeout_ms for queue space");
+            out.sample("pgw_cdr_block_timeouts_total", "", cdr->blockTimeouts());
 
-    // HTTP функция
-    auto http_function = [&]() {
-        logger->debug("Starting HTTP thread");
-        httplib::Server svr;
-        svr.Get("/check_subscriber", [&](auto& req, auto& res) {
-            std::string imsi = req.get_param_value("imsi");
-            logger->debug("HTTP /check_subscriber imsi={}", imsi);
-            std::lock_guard<std::mutex> lock(mutex);
-            res.body = sessions.count(imsi) ? "active" : "not active";
+            if (cluster) {
+                ClusterStats cs = cluster->stats();
+                out.header("pgw_cluster_forward_timeouts_total", "counter",
+                           "Forwarded requests with no reply from the owner in time");
+                out.sample("pgw_cluster_forward_timeouts_total", "", cs.timeouts);
+                out.header("pgw_cluster_pending_replies", "gauge", "Client replies waiting for owner members");
+                out.sample("pgw_cluster_pending_replies", "", cs.pending);
+            }
+            out.header("pgw_active_sessions", "gauge", "Sessions in the session table");
+            out.sample("pgw_active_sessions", "", static_cast<uint64_t>(sessions.size()));
+            out.header("pgw_cdr_ring_occupancy", "gauge", "CDR records waiting in the queue");
+            out.sample("pgw_cdr_ring_occupancy", "", static_cast<uint64_t>(cdr->pending()));
+            out.header("pgw_cdr_ring_capacity", "gauge", "CDR queue capacity");
+            out.sample("pgw_cdr_ring_capacity", "", static_cast<uint64_t>(cdr->capacity()));
+            out.header("pgw_blacklist_entries", "gauge", "Entries in the current blacklist");
+            out.sample("pgw_blacklist_entries", "", static_cast<uint64_t>(blacklist->current()->size()));
+            out.header("pgw_overload_state", "gauge", "1 while the UDP worker sheds new sessions on queue delay");
+            for (size_t i = 0; i < worker_metrics.size(); ++i) {
+                out.sample("pgw_overload_state", "worker=\"" + std::to_string(i) + "\"",
+                           uint64_t(worker_overloaded(*worker_metrics[i])));
+            }
+            out.header("pgw_udp_queue_bytes", "gauge", "Bytes in the UDP socket receive queue");
+            for (size_t i = 0; i < worker_socks.size(); ++i) {
+                uint32_t used = 0, limit = 0;
+                if (socketQueueBytes(worker_socks[i].load(), used, limit)) {
+                    out.sample("pgw_udp_queue_bytes", "worker=\"" + std::to_string(i) + "\"", uint64_t(used));
+                }
+            }
+
+            HistogramSnapshot latency;
+            for (const auto& m : worker_metrics) m->latency.mergeInto(latency);
+            out.histogram("pgw_udp_reply_latency_seconds", "Time from recvmmsg return to reply sent", latency);
+            HistogramSnapshot queue_delay;
+            for (const auto& m : worker_metrics) m->queue_delay.mergeInto(queue_delay);
+            out.histogram("pgw_udp_queue_delay_seconds", "Time a datagram waited in the socket queue", queue_delay);
+            HistogramSnapshot tick;
+            cleanup_metrics.tick.mergeInto(tick);
+            out.histogram("pgw_cleanup_tick_seconds", "Duration of one cleanup tick", tick);
+            res.set_content(out.text(), "text/plain; version=0.0.4");
+        });
+        // Состояние защиты от перегрузки: пределы, отказы по причинам, очереди потоков
+        svr.Get("/overload", [&](auto&, auto& res) {
+            const OverloadOptions& o = admission.options();
+            size_t active = sessions.size();
+            nlohmann::json workers = nlohmann::json::array();
+            uint64_t shed_queue = 0, shed_capacity = 0, shed_rate = 0;
+            bool any_overloaded = false;
+            for (size_t i = 0; i < worker_metrics.size(); ++i) {
+                const WorkerMetrics& m = *worker_metrics[i];
+                shed_queue += m.shed_queue.load(std::memory_order_relaxed);
+                shed_capacity += m.shed_capacity.load(std::memory_order_relaxed);
+                shed_rate += m.shed_rate.load(std::memory_order_relaxed);
+                bool overloaded = worker_overloaded(m);
+                any_overloaded = any_overloaded || overloaded;
+                nlohmann::json w = {
+                    {"worker", i},
+                    {"overloaded", overloaded},
+                    {"queue_delay_ms", m.queue_delay_ns.load(std::memory_order_relaxed) / 1e6},
+                };
+                uint32_t used = 0, limit = 0;
+                if (socketQueueBytes(worker_socks[i].load(), used, limit)) {
+                    w["queue_bytes"] = used;
+                    w["queue_limit_bytes"] = limit;
+                }
+                workers.push_back(std::move(w));
+            }
+            const char* state = any_overloaded ? "overloaded"
+                                : o.max_sessions != 0 && active >= o.max_sessions ? "at_capacity"
+                                                                                  : "normal";
+            nlohmann::json out = {
+                {"state", state},
+                {"sessions", active},
+                {"limits", {{"max_sessions", o.max_sessions},
+                            {"new_session_rate", o.new_session_rate},
+                            {"new_session_burst", o.new_session_burst ? o.new_session_burst : o.new_session_rate},
+                            {"queue_delay_ms", o.queue_delay_ms}}},
+                {"shed", {{"queue", shed_queue}, {"capacity", shed_capacity}, {"rate", shed_rate}}},
+                {"workers", std::move(workers)},
+            };
+            res.set_content(out.dump(), "application/json");
+        });
+        // Кластер: участники, их доли IMSI и счётчики связи
+        svr.Get("/cluster", [&](auto&, auto& res) {
+            if (!cluster) {
+                res.set_content(nlohmann::json{{"enabled", false}}.dump(), "application/json");
+                return;
+            }
+            std::vector<double> shares = cluster->ring().shares();
+            nlohmann::json members = nlohmann::json::array();
+            for (size_t i = 0; i < config.cluster_members.size(); ++i) {
+                const ClusterMemberConfig& m = config.cluster_members[i];
+                members.push_back({{"id", m.id}, {"udp", m.udp}, {"peer", m.peer}, {"http", m.http},
+                                   {"share", shares[i]}, {"self", i == cluster->self()}});
+            }
+            ClusterStats cs = cluster->stats();
+            nlohmann::json out = {
+                {"enabled", true},
+                {"self", config.cluster_self},
+                {"members", std::move(members)},
+                {"forwards", cs.forwards},
+                {"forwarded_imsis", cs.forwarded_imsis},
+                {"replies", cs.replies},
+                {"completed", cs.completed},
+                {"timeouts", cs.timeouts},
+                {"late_replies", cs.late_replies},
+                {"send_errors", cs.send_errors},
+                {"pending", cs.pending},
+            };
+            res.set_content(out.dump(), "application/json");
+        });
+        svr.Post("/reload_blacklist", [&](auto&, auto& res) {
+            logger->info("HTTP /reload_blacklist called");
+            std::string message;
+            res.status = reload_blacklist(message) ? 200 : 500;
+            res.set_content(message, "text/plain");
+        });
+        // Ход плавного завершения: удалено, осталось, оценка времени до конца
+        svr.Get("/shutdown", [&](auto&, auto& res) {
+            DrainProgress p = drain.progress(std::chrono::steady_clock::now());
+            const char* state = !shutting_down.load(std::memory_order_relaxed) ? "running"
+                                : config.snapshot_keep_sessions               ? "kept"
+                                : p.finished                                  ? "done"
+                                                                              : "draining";
+            nlohmann::json out = {
+                {"state", state},
+                {"rate", p.rate},
+                {"total", p.total},
+                {"removed", p.removed},
+                {"remaining", p.started ? p.remaining : sessions.size()},
+                {"elapsed_sec", p.elapsed_sec},
+                {"eta_sec", p.started ? p.eta_sec : static_cast<double>(sessions.size()) / p.rate},
+            };
+            res.set_content(out.dump(), "application/json");
         });
         svr.Get("/stop", [&](auto&, auto& res) {
             logger->info("HTTP /stop called");
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                shutting_down = true;
-            }
-            svr.stop();
+            request_shutdown();
             res.status = 200;
             res.body = "Shutdown initiated";
         });
-        if (!svr.listen("0.0.0.0", config.http_port)) {
-            logger->error("HTTP listen failed on port {}", config.http_port);
+        try {
+            if (!svr.listen("0.0.0.0", config.http_port)) {
+                logger->error("HTTP listen failed on port {}", config.http_port);
+            }
+        } catch (const std::exception& e) {
+            logger->error("HTTP server failed: {}", e.what());
         }
+        std::lock_guard<std::mutex> lock(mutex);
+        http_stopped = true;
+        cv.notify_all();
     };
 
     // Cleanup-функция
     auto cleanup_function = [&]() {
         logger->debug("Starting cleanup thread");
-        // Удаление сессий после окончания времени обслуживания
-        while (true) {
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                if (shutting_down) break;
+        // Удаление сессий после окончания времени обслуживания: колесо таймеров
+        // отдаёт только истёкшие сессии, они удаляются и пишутся в CDR пачкой
+        std::vector<SessionTable::Session> expired;
+        // Время последнего обновления для счётчиков renew в записи CDR;
+        // 0 — объединение выключено, строка прежнего формата
+        auto renew_last_seen = [&](const SessionTable::Session& s, std::chrono::steady_clock::time_point now,
+                                   std::time_t now_c) -> std::time_t {
+            if (!sessions.coalescesRenews()) return 0;
+            return now_c - std::chrono::duration_cast<std::chrono::seconds>(now - sessions.lastSeen(s)).count();
+        };
+        LogRateLimiter deleted_log(config.log_event_rate);
+        uint64_t suppressed = 0;
+        // Тики очистки — timerfd с периодом тика таблицы (1 с); поток просыпается
+        // только по таймеру, SIGHUP (g_reload_fd) или остановке (shutdown_fd)
+        int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        itimerspec period{};
+        period.it_interval.tv_sec = 1;
+        period.it_value.tv_sec = 1;
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &period, nullptr) < 0 || epoll_fd < 0 ||
+            !addToEpoll(epoll_fd, timer_fd) || !addToEpoll(epoll_fd, g_reload_fd) ||
+            !addToEpoll(epoll_fd, shutdown_fd)) {
+            logger->critical("Cleanup thread: timer setup failed: {}", strerror(errno));
+            request_shutdown();
+        }
+        while (!shutting_down.load(std::memory_order_relaxed)) {
+            if (waitReadable(epoll_fd, -1) < 0) {
+                logger->error("epoll_wait error: {}", strerror(errno));
+                request_shutdown();
+                break;
             }
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            std::vector<std::string> to_delete;
-            auto now = std::chrono::steady_clock::now();
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                for (auto& [imsi, s] : sessions) {
-                    if (now - s.creation_time > std::chrono::seconds(config.session_timeout_sec))
-                        to_delete.push_back(imsi);
-                }
-                if (to_delete.empty())
-                    logger->debug("No timed‑out sessions this cycle");
+            uint64_t count;
+            if (read(g_reload_fd, &count, sizeof(count)) > 0 &&
+                g_blacklist_reload_requested.exchange(false, std::memory_order_relaxed)) {
+                logger->info("SIGHUP received");
+                std::string message;
+                reload_blacklist(message);
             }
-            for (auto& imsi : to_delete) {
-                {
-                    std::lock_guard<std::mutex> cdr_lock(cdr_mutex);
-                    auto now_c = std::time(nullptr);
-                    cdr_stream << std::put_time(std::localtime(&now_c), "%Y-%m-%d %H:%M:%S")
-                               << "," << imsi << ",delete\n";
-                }
-                {
-                    std::lock_guard<std::mutex> lock(mutex);
-                    sessions.erase(imsi);
-                }
-                logger->info("Session deleted for IMSI {}", imsi);
+            // Пропущенные тики не догоняются: expire сам обрабатывает все наступившие корзины
+            if (read(timer_fd, &count, sizeof(count)) <= 0) continue;
+            auto tick_start = std::chrono::steady_clock::now();
+            expired.clear();
+            sessions.expire(tick_start, expired);
+            if (expired.empty()) {
+                logger->debug("No timed‑out sessions this cycle");
             }
-        }
-        // graceful shutdown
-        logger->info("Graceful shutdown: {} sess/sec", config.graceful_shutdown_rate);
-        while (true) {
-            std::vector<std::string> to_shutdown;
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                if (sessions.empty()) break;
-                int c = 0;
-                for (auto& [imsi, s] : sessions) {
-                    if (c++ >= config.graceful_shutdown_rate) break;
-                    to_shutdown.push_back(imsi);
+            auto now_c = std::time(nullptr);
+            uint64_t cdr_dropped = 0;
+            for (const auto& s : expired) {
+                cdr_dropped += !cdr->push(Imsi{s.imsi}, CdrEvent::Delete, now_c, s.renews,
+                                          renew_last_seen(s, tick_start, now_c));
+                if (deleted_log.allow(tick_start, suppressed)) {
+                    logger->info("Session deleted for IMSI {}{}", ImsiText(Imsi{s.imsi}).view(),
+                                 suppressedNote(suppressed));
                 }
             }
-            if (to_shutdown.empty()) logger->debug("No sessions to shutdown");
-            {
-                std::lock_guard<std::mutex> cdr_lock(cdr_mutex);
-                auto now_c = std::time(nullptr);
-                for (auto& imsi : to_shutdown) {
-                    cdr_stream << std::put_time(std::localtime(&now_c), "%Y-%m-%d %H:%M:%S")
-                               << "," << imsi << ",shutdown\n";
-                    logger->info("Gracefully removed {}", imsi);
-                    std::lock_guard<std::mutex> lock(mutex);
-                    sessions.erase(imsi);
+            admission.releaseSessions(expired.size());
+            bumpCounter(cleanup_metrics.expired, expired.size());
+            bumpCounter(cleanup_metrics.cdr_dropped, cdr_dropped);
+            auto tick_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - tick_start).count();
+            cleanup_metrics.tick.record(static_cast<uint64_t>(tick_ns));
+        }
+        if (epoll_fd >= 0) close(epoll_fd);
+        if (timer_fd >= 0) close(timer_fd);
+        // Удаление — после остановки UDP-потоков и потока кластера: сессия,
+        // созданная ещё обрабатывавшимся запросом, иначе не попала бы ни
+        // в удаление, ни в CDR shutdown
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]{ return workers_stopped; });
+        }
+        // graceful shutdown; с snapshot_keep_sessions сессии остаются
+        // в последнем снимке для тёплого перезапуска и не удаляются
+        if (config.snapshot_keep_sessions) {
+            logger->info("Graceful shutdown: {} sessions kept for warm restart", sessions.size());
+        } else {
+            logger->info("Graceful shutdown: {} sessions at {} sess/sec, ETA {:.0f} s", sessions.size(),
+                         config.graceful_shutdown_rate,
+                         static_cast<double>(sessions.size()) / config.graceful_shutdown_rate);
+        }
+        // Шаги по абсолютному расписанию: время на удаление и запись CDR
+        // не сдвигает следующие шаги, а отставание учитывает ведро токенов
+        std::vector<SessionTable::Session> to_shutdown;
+        std::vector<CdrRecord> records;
+        auto next_step = std::chrono::steady_clock::now();
+        if (!config.snapshot_keep_sessions) drain.start(next_step);
+        while (!config.snapshot_keep_sessions && !drain.finished()) {
+            next_step += drain.period();
+            std::this_thread::sleep_until(next_step);
+            auto now = std::chrono::steady_clock::now();
+            if (next_step < now) next_step = now;
+            to_shutdown.clear();
+            admission.releaseSessions(drain.step(now, to_shutdown));
+            auto now_c = std::time(nullptr);
+            records.clear();
+            for (const auto& s : to_shutdown) {
+                records.push_back(CdrRecord{s.imsi, static_cast<int64_t>(now_c), CdrEvent::Shutdown, s.renews,
+                                            static_cast<int64_t>(renew_last_seen(s, now, now_c))});
+                if (deleted_log.allow(now, suppressed)) {
+                    logger->info("Gracefully removed {}{}", ImsiText(Imsi{s.imsi}).view(),
+                                 suppressedNote(suppressed));
                 }
             }
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            cdr->pushBatch(records.data(), records.size());
+        }
+        if (!config.snapshot_keep_sessions) {
+            DrainProgress p = drain.progress(std::chrono::steady_clock::now());
+            logger->info("Graceful shutdown: {} sessions removed in {:.1f} s", p.removed, p.elapsed_sec);
         }
         {
             std::lock_guard<std::mutex> lock(mutex);
             shutdown_complete = true;
-            cv.notify_one();
+            cv.notify_all();
         }
         logger->info("Graceful shutdown complete");
     };
 
-    std::thread t1(udp_function), t2(http_function), t3(cleanup_function);
+    auto write_snapshot = [&]() {
+        auto started = std::chrono::steady_clock::now();
+        try {
+            size_t count = writeSessionSnapshot(sessions, config.snapshot_file);
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started).count();
+            logger->info("Snapshot of {} sessions written to {} in {} ms", count, config.snapshot_file, ms);
+        } catch (const std::exception& e) {
+            logger->error("{}", e.what());
+        }
+    };
+    // Снимок сессий во время работы; последний пишет main после остановки UDP-потоков
+    auto snapshot_function = [&]() {
+        logger->debug("Starting snapshot thread");
+        // Ожидание на shutdown_fd: либо истёк интервал, либо остановка
+        pollfd stop{shutdown_fd, POLLIN, 0};
+        int timeout_ms = config.snapshot_interval_sec > 0 ? config.snapshot_interval_sec * 1000 : -1;
+        while (!shutting_down.load(std::memory_order_relaxed)) {
+            int ready = poll(&stop, 1, timeout_ms);
+            if (ready < 0 && errno != EINTR) break;
+            if (ready == 0) write_snapshot();
+        }
+    };
+
+    std::vector<std::thread> udp_threads;
+    for (int i = 0; i < config.udp_workers; ++i) {
+        udp_threads.emplace_back(udp_function, i);
+        if (i < static_cast<int>(config.udp_cpus.size())) {
+            int cpu = config.udp_cpus[i];
+            if (pinThreadToCpus(udp_threads.back().native_handle(), cpuSetOf({cpu})))
+                logger->debug("UDP thread #{} pinned to CPU {}", i, cpu);
+            else
+                logger->warn("Failed to pin UDP thread #{} to CPU {}", i, cpu);
+        } else if (housekeeping_pinned && CPU_COUNT(&worker_cpus) > 0 &&
+                   !pinThreadToCpus(udp_threads.back().native_handle(), worker_cpus)) {
+            logger->warn("Failed to move UDP thread #{} off housekeeping CPUs", i);
+        }
+    }
+    std::thread t2(http_function), t3(cleanup_function);
+    std::thread t4, t5;
+    if (!config.snapshot_file.empty()) t4 = std::thread(snapshot_function);
+    if (cluster) t5 = std::thread([&]() { cluster->run(shutdown_fd, shutting_down); });
+    for (auto& t : udp_threads) t.join();
+    if (t5.joinable()) t5.join();
     {
         std::unique_lock<std::mutex> lock(mutex);
+        workers_stopped = true;
+        cv.notify_all();
         cv.wait(lock, [&]{ return shutdown_complete; });
     }
-    t1.join(); t2.join(); t3.join();
+    // Последний снимок — когда сессии никто не меняет: удаление закончено,
+    // UDP-потоки и поток кластера остановлены. Без snapshot_keep_sessions
+    // закрытые записью shutdown сессии в него не попадают и после
+    // перезапуска не восстанавливаются
+    if (t4.joinable()) {
+        t4.join();
+        write_snapshot();
+    }
+    // stop до начала listen не останавливает сервер, поэтому повторяется,
+    // пока поток HTTP не сообщит о выходе из listen (в том числе с ошибкой)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!http_stopped) {
+            svr.stop();
+            cv.wait_for(lock, std::chrono::milliseconds(10), [&]{ return http_stopped; });
+        }
+    }
+    t2.join(); t3.join();
 
+    close(shutdown_fd);
+    int reload_fd = g_reload_fd;
+    g_reload_fd = -1;
+    close(reload_fd);
     logger->info("All done, exiting");
-    cdr_stream.close();
+    cdr->stop();
     spdlog::shutdown();
     return 0;
 }
@@ -0,0 +1,157 @@
+#include "session_snapshot.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = SessionTable::Clock;
+
+int64_t wallNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int64_t toMs(Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+void writeAll(int fd, const void* data, size_t size, const std::string& path) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Snapshot write failed: " + path + ": " + std::strerror(errno));
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+}
+
+// По 64-битным словам: сумма не зависит от выравнивания и быстро
+// считается на миллионах записей
+uint64_t snapshotChecksum(const SnapshotRecord* records, size_t count, uint64_t seed) {
+    uint64_t h = seed;
+    for (size_t i = 0; i < count; ++i) {
+        const SnapshotRecord& r = records[i];
+        for (uint64_t word : {r.imsi, static_cast<uint64_t>(r.created_ms), static_cast<uint64_t>(r.expires_ms)}) {
+            h = (h ^ word) * 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+    }
+    return h;
+}
+
+size_t writeSessionSnapshot(SessionTable& table, const std::string& path) {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open snapshot file: " + tmp + ": " + std::strerror(errno));
+    }
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.record_size = sizeof(SnapshotRecord);
+    uint64_t checksum = kSnapshotChecksumSeed;
+    size_t count = 0;
+    std::vector<SnapshotRecord> records;
+    try {
+        // Место под заголовок; счётчик и сумма известны только в конце
+        writeAll(fd, &header, sizeof(header), tmp);
+        for (size_t shard = 0; shard < table.shardCount(); ++shard) {
+            records.clear();
+            table.readShard(shard, [&](const SessionTable::Shard& s) {
+                Clock::time_point now = Clock::now();
+                int64_t wall_ms = wallNowMs();
+                records.reserve(s.size());
+                s.forEach([&](const SessionTable::Session& rec) {
+                    records.push_back(SnapshotRecord{rec.imsi, wall_ms - toMs(now - rec.created),
+                                                     wall_ms + toMs(rec.expires_at - now)});
+                });
+            });
+            checksum = snapshotChecksum(records.data(), records.size(), checksum);
+            count += records.size();
+            writeAll(fd, records.data(), records.size() * sizeof(SnapshotRecord), tmp);
+        }
+        header.written_ms = wallNowMs();
+        header.count = count;
+        header.checksum = checksum;
+        if (::pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || ::fsync(fd) < 0) {
+            throw std::runtime_error("Snapshot write failed: " + tmp + ": " + std::strerror(errno));
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) < 0) {
+        ::unlink(tmp.c_str());
+        throw std::runtime_error("Cannot rename snapshot to " + path + ": " + std::strerror(errno));
+    }
+    return count;
+}
+
+size_t loadSessionSnapshot(SessionTable& table, const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return 0;
+        throw std::runtime_error("Cannot open snapshot file: " + path + ": " + std::strerror(errno));
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Snapshot " + path + " is truncated");
+    }
+    size_t length = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Snapshot mmap failed: " + path + ": " + std::strerror(errno));
+    }
+    madvise(data, length, MADV_SEQUENTIAL);
+
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const SnapshotRecord* records =
+        reinterpret_cast<const SnapshotRecord*>(static_cast<const char*>(data) + sizeof(SnapshotHeader));
+    std::string error;
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0) {
+        error = "bad magic";
+    } else if (header.version != kSnapshotVersion || header.record_size != sizeof(SnapshotRecord)) {
+        error = "unsupported version " + std::to_string(header.version);
+    } else if (header.count != (length - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord) ||
+               (length - sizeof(SnapshotHeader)) % sizeof(SnapshotRecord) != 0) {
+        error = "size does not match record count";
+    } else if (snapshotChecksum(records, header.count) != header.checksum) {
+        error = "checksum mismatch";
+    }
+    if (!error.empty()) {
+        munmap(data, length);
+        throw std::runtime_error("Snapshot " + path + " rejected: " + error);
+    }
+
+    Clock::time_point now = Clock::now();
+    int64_t wall_ms = wallNowMs();
+    int64_t timeout_ms = toMs(table.timeout());
+    size_t restored = 0;
+    for (size_t i = 0; i < header.count; ++i) {
+        const SnapshotRecord& r = records[i];
+        int64_t remaining_ms = r.expires_ms - wall_ms;
+        if (remaining_ms <= 0 || r.imsi == 0) continue;
+        if (remaining_ms > timeout_ms) remaining_ms = timeout_ms;
+        Clock::time_point created = now - std::chrono::milliseconds(wall_ms - r.created_ms);
+        if (table.insert(r.imsi, created, now + std::chrono::milliseconds(remaining_ms))) ++restored;
+    }
+    munmap(data, length);
+    return restored;
+}
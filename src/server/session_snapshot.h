@@ -0,0 +1,50 @@
+#ifndef SESSION_SNAPSHOT_H
+#define SESSION_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "session_table.h"
+
+// Снимок таблицы сессий для тёплого перезапуска: заголовок и записи
+// фиксированной длины. Сроки хранятся в миллисекундах Unix (steady_clock
+// не переживает перезапуск), целостность проверяется контрольной суммой
+// по всем записям.
+constexpr char kSnapshotMagic[8] = {'P', 'G', 'W', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint16_t kSnapshotVersion = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t reserved;
+    int64_t written_ms;   // время записи снимка
+    uint64_t count;
+    uint64_t checksum;    // snapshotChecksum по всем записям
+};
+static_assert(sizeof(SnapshotHeader) == 40, "snapshot header layout");
+
+struct SnapshotRecord {
+    uint64_t imsi;        // Imsi::packed
+    int64_t created_ms;
+    int64_t expires_ms;
+};
+static_assert(sizeof(SnapshotRecord) == 24, "snapshot record layout");
+
+// Сумма считается частями: результат по первой части передаётся в seed следующей
+constexpr uint64_t kSnapshotChecksumSeed = 0xcbf29ce484222325ULL;
+uint64_t snapshotChecksum(const SnapshotRecord* records, size_t count, uint64_t seed = kSnapshotChecksumSeed);
+
+// Пишет снимок во временный файл и атомарно переименовывает его в path.
+// Шарды копируются по одному под своей блокировкой, на диск данные уходят
+// уже без блокировок, так что приём UDP ждёт не дольше копирования шарда.
+// Возвращает число сессий; std::runtime_error при ошибке ввода-вывода.
+size_t writeSessionSnapshot(SessionTable& table, const std::string& path);
+
+// Восстанавливает сессии из снимка (файл отображается в память).
+// Оставшийся срок считается по настенным часам и ограничивается
+// таймаутом таблицы, истёкшие за время простоя сессии пропускаются.
+// 0, если файла нет; std::runtime_error, если снимок повреждён.
+size_t loadSessionSnapshot(SessionTable& table, const std::string& path);
+
+#endif
@@ -0,0 +1,469 @@
+#include "session_table.h"
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+size_t roundUpPow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// Максимальная заполненность шарда: числитель/знаменатель (3/4)
+constexpr size_t kLoadNum = 3;
+constexpr size_t kLoadDen = 4;
+constexpr size_t kMinShardCapacity = 16;
+
+// Ссылки списков колеса: kNil — конец списка; у головы списка в wheel_prev
+// вместо индекса слота хранится номер корзины с флагом kHead
+constexpr uint32_t kNil = UINT32_MAX;
+constexpr uint32_t kHead = 0x80000000u;
+// renew_at сессии, у которой ещё не было записанного renew: окно объединения
+// открывает первое обновление, а не создание
+constexpr uint32_t kNoRenewWindow = UINT32_MAX;
+
+// Неудачных попыток чтения до перехода на yield (писатель держит шард долго)
+constexpr unsigned kReadSpins = 64;
+
+// Ключей на одну проверку версии в пакетном поиске: чем больше серия,
+// тем вероятнее, что её придётся повторить из-за писателя
+constexpr size_t kReadBatch = 32;
+
+}
+
+SessionTable::SessionTable(size_t shard_count, size_t expected_sessions,
+                           Clock::duration timeout, Clock::duration tick)
+    : timeout_(timeout), tick_(tick), epoch_(Clock::now()) {
+    shard_count = roundUpPow2(shard_count ? shard_count : 1);
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < shard_count) ++bits;
+    shard_shift_ = 64 - bits;
+
+    size_t per_shard = expected_sessions / shard_count + 1;
+    size_t capacity = roundUpPow2(per_shard * kLoadDen / kLoadNum + 1);
+    if (capacity < kMinShardCapacity) capacity = kMinShardCapacity;
+
+    // Колесо покрывает весь таймаут плюс запас в две корзины, поэтому
+    // новая или обновлённая сессия всегда попадает в свою корзину.
+    // Более дальние сроки (не возникают при постоянном таймауте) кладутся
+    // в последнюю корзину и перекладываются, когда до неё доходит очередь.
+    size_t wheel_size = roundUpPow2(static_cast<size_t>(timeout_ / tick_) + 2);
+    wheel_mask_ = wheel_size - 1;
+
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->table_ = this;
+        shard->slots_.assign(capacity, Session{});
+        shard->mask_ = capacity - 1;
+        shard->wheel_.assign(wheel_size, kNil);
+        shard->publishSlots();
+        shards_.push_back(std::move(shard));
+    }
+}
+
+size_t SessionTable::shardOf(uint64_t imsi) const {
+    // Старшие биты хэша выбирают шард, младшие — слот внутри шарда
+    if (shard_shift_ == 64) return 0;
+    return static_cast<size_t>(mixImsiHash(imsi) >> shard_shift_);
+}
+
+SessionTable::TouchResult SessionTable::touch(uint64_t imsi, Clock::time_point now) {
+    TouchResult result;
+    withShard(shardOf(imsi), [&](Shard& s) { result = s.touch(imsi, now); });
+    return result;
+}
+
+bool SessionTable::contains(uint64_t imsi) const {
+    return shards_[shardOf(imsi)]->read(imsi, nullptr);
+}
+
+bool SessionTable::lookup(uint64_t imsi, Session& out) const {
+    return shards_[shardOf(imsi)]->read(imsi, &out);
+}
+
+bool SessionTable::erase(uint64_t imsi) {
+    bool erased = false;
+    withShard(shardOf(imsi), [&](Shard& s) { erased = s.erase(imsi); });
+    return erased;
+}
+
+bool SessionTable::insert(uint64_t imsi, Clock::time_point created, Clock::time_point expires_at) {
+    bool inserted = false;
+    withShard(shardOf(imsi), [&](Shard& s) { inserted = s.insert(imsi, created, expires_at); });
+    return inserted;
+}
+
+void SessionTable::lookupBatch(const std::vector<uint64_t>& keys, std::vector<Session>& out) const {
+    out.assign(keys.size(), Session{});
+    std::vector<std::pair<size_t, uint32_t>> order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) order[i] = {shardOf(keys[i]), static_cast<uint32_t>(i)};
+    std::sort(order.begin(), order.end());
+    std::vector<uint32_t> index(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) index[i] = order[i].second;
+
+    size_t begin = 0;
+    while (begin < order.size()) {
+        size_t shard = order[begin].first;
+        size_t end = begin;
+        while (end < order.size() && order[end].first == shard && end - begin < kReadBatch) ++end;
+        shards_[shard]->readBatch(keys.data(), index.data() + begin, end - begin, out.data());
+        begin = end;
+    }
+}
+
+// Курсор: номер шарда в старших битах, номер слота — в младших kCursorSlotBits;
+// шард 0 / слот 0 кодируется единицей, чтобы 0 означал конец обхода
+uint64_t SessionTable::scan(uint64_t cursor, size_t max_slots, std::vector<Session>& out) const {
+    constexpr unsigned kCursorSlotBits = 40;
+    uint64_t position = cursor ? cursor - 1 : 0;
+    size_t shard = static_cast<size_t>(position >> kCursorSlotBits);
+    size_t slot = static_cast<size_t>(position & ((uint64_t(1) << kCursorSlotBits) - 1));
+    if (shard >= shards_.size()) return 0;
+    size_t capacity = shards_[shard]->readSlots(slot, max_slots, out);
+    slot += max_slots;
+    if (slot >= capacity) {
+        ++shard;
+        slot = 0;
+        if (shard >= shards_.size()) return 0;
+    }
+    return ((static_cast<uint64_t>(shard) << kCursorSlotBits) | slot) + 1;
+}
+
+size_t SessionTable::size() const {
+    size_t total = 0;
+    for (const auto& s : shards_) total += s->size();
+    return total;
+}
+
+// Корзина тика t срабатывает, когда тик t полностью прошёл: все сроки в ней
+// меньше now. Записи, положенные в корзину «на вырост», перекладываются.
+template <typename Fn>
+size_t SessionTable::Shard::expire(int64_t now_tick, Fn&& fn) {
+    size_t erased = 0;
+    while (wheel_cursor_ < now_tick) {
+        uint32_t bucket = static_cast<uint32_t>(wheel_cursor_ & static_cast<int64_t>(table_->wheel_mask_));
+        while (wheel_[bucket] != kNil) {
+            uint32_t slot = wheel_[bucket];
+            if (tickOf(slots_[slot].expires_at) <= wheel_cursor_) {
+                fn(slots_[slot]);
+                eraseSlot(slot);
+                ++erased;
+            } else {
+                unlink(slot);
+                link(slot);
+            }
+        }
+        ++wheel_cursor_;
+    }
+    return erased;
+}
+
+// Сдвиг при удалении переносит запись из следующих слотов в удалённый,
+// а через границу массива — из его начала в конец, поэтому пройденные
+// слоты остаются пустыми, пока нет вставок. Вставки во время удаления находит
+// второй проход с начала шарда.
+template <typename Fn>
+size_t SessionTable::Shard::drain(size_t max_count, Fn&& fn) {
+    size_t erased = 0;
+    size_t slot = drain_slot_ < slots_.size() ? drain_slot_ : 0;
+    bool wrapped = slot == 0;
+    while (erased < max_count && size() > 0) {
+        if (slot == slots_.size()) {
+            if (wrapped) break;
+            wrapped = true;
+            slot = 0;
+        }
+        if (slots_[slot].imsi != 0) {
+            fn(slots_[slot]);
+            eraseSlot(slot);
+            ++erased;
+            // после сдвига в slot могла переехать следующая запись — проверяем его снова
+            continue;
+        }
+        ++slot;
+    }
+    drain_slot_ = slot;
+    return erased;
+}
+
+size_t SessionTable::expire(Clock::time_point now, std::vector<uint64_t>& out) {
+    size_t erased = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        withShard(i, [&](Shard& s) {
+            erased += s.expire(s.tickOf(now), [&](const Session& rec) { out.push_back(rec.imsi); });
+        });
+    }
+    return erased;
+}
+
+size_t SessionTable::expire(Clock::time_point now, std::vector<Session>& out) {
+    size_t erased = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        withShard(i, [&](Shard& s) {
+            erased += s.expire(s.tickOf(now), [&](const Session& rec) { out.push_back(rec); });
+        });
+    }
+    return erased;
+}
+
+size_t SessionTable::drain(size_t max_count, std::vector<uint64_t>& out) {
+    size_t erased = 0;
+    for (size_t i = 0; i < shards_.size() && erased < max_count; ++i) {
+        withShard(i, [&](Shard& s) {
+            erased += s.drain(max_count - erased, [&](const Session& rec) { out.push_back(rec.imsi); });
+        });
+    }
+    return erased;
+}
+
+size_t SessionTable::drain(size_t max_count, std::vector<Session>& out) {
+    size_t erased = 0;
+    for (size_t i = 0; i < shards_.size() && erased < max_count; ++i) {
+        withShard(i, [&](Shard& s) {
+            erased += s.drain(max_count - erased, [&](const Session& rec) { out.push_back(rec); });
+        });
+    }
+    return erased;
+}
+
+size_t SessionTable::drainShard(size_t shard, size_t max_count, std::vector<Session>& out) {
+    size_t erased = 0;
+    withShard(shard, [&](Shard& s) {
+        erased = s.drain(max_count, [&](const Session& rec) { out.push_back(rec); });
+    });
+    return erased;
+}
+
+size_t SessionTable::Shard::homeSlot(uint64_t imsi) const {
+    return static_cast<size_t>(mixImsiHash(imsi)) & mask_;
+}
+
+size_t SessionTable::Shard::findSlot(uint64_t imsi) const {
+    size_t slot = homeSlot(imsi);
+    while (slots_[slot].imsi != 0) {
+        if (slots_[slot].imsi == imsi) return slot;
+        slot = (slot + 1) & mask_;
+    }
+    return slot;
+}
+
+SessionTable::TouchResult SessionTable::Shard::touch(uint64_t imsi, Clock::time_point now, uint32_t* coalesced) {
+    size_t slot = findSlot(imsi);
+    const uint32_t now_sec = secondsOf(now);
+    if (slots_[slot].imsi == imsi) {
+        unlink(static_cast<uint32_t>(slot));
+        Session& rec = slots_[slot];
+        rec.expires_at = now + table_->timeout_;
+        link(static_cast<uint32_t>(slot));
+        if (table_->renew_window_sec_ != 0) {
+            if (rec.renew_at != kNoRenewWindow && now_sec - rec.renew_at < table_->renew_window_sec_) {
+                ++rec.renews;
+                return TouchResult::Coalesced;
+            }
+            if (coalesced) *coalesced = rec.renews;
+            rec.renews = 0;
+            rec.renew_at = now_sec;
+        }
+        return TouchResult::Refreshed;
+    }
+    insertAt(slot, Session{imsi, now, now + table_->timeout_, kNil, kNil, 0, kNoRenewWindow});
+    return TouchResult::Created;
+}
+
+bool SessionTable::Shard::insert(uint64_t imsi, Clock::time_point created, Clock::time_point expires_at) {
+    size_t slot = findSlot(imsi);
+    if (slots_[slot].imsi == imsi) return false;
+    insertAt(slot, Session{imsi, created, expires_at, kNil, kNil, 0, kNoRenewWindow});
+    return true;
+}
+
+// slot — свободный слот, найденный findSlot для rec.imsi
+void SessionTable::Shard::insertAt(size_t slot, const Session& rec) {
+    if ((size() + 1) * kLoadDen > slots_.size() * kLoadNum) {
+        grow();
+        slot = findSlot(rec.imsi);
+    }
+    slots_[slot] = rec;
+    link(static_cast<uint32_t>(slot));
+    size_.store(size() + 1, std::memory_order_relaxed);
+}
+
+// Массив и маска публикуются так, что читатель, увидевший новую маску,
+// видит и новый массив; со старой маской годится любой из двух массивов
+void SessionTable::Shard::publishSlots() {
+    read_slots_.store(slots_.data(), std::memory_order_relaxed);
+    read_mask_.store(mask_, std::memory_order_release);
+}
+
+bool SessionTable::Shard::read(uint64_t imsi, Session* out) const {
+    for (unsigned attempt = 0;; ++attempt) {
+        uint32_t begin = seq_.load(std::memory_order_acquire);
+        if ((begin & 1) == 0) {
+            size_t mask = read_mask_.load(std::memory_order_acquire);
+            const Session* slots = read_slots_.load(std::memory_order_relaxed);
+            Session copy;
+            bool found = false;
+            size_t slot = static_cast<size_t>(mixImsiHash(imsi)) & mask;
+            // число проб ограничено: при гонке с писателем цепочка может выглядеть любой
+            for (size_t probes = 0; probes <= mask; ++probes) {
+                uint64_t key = slots[slot].imsi;
+                if (key == 0) break;
+                if (key == imsi) {
+                    copy = slots[slot];
+                    found = true;
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == begin) {
+                if (found && out) *out = copy;
+                return found;
+            }
+        }
+        if (attempt >= kReadSpins) std::this_thread::yield();
+    }
+}
+
+void SessionTable::Shard::readBatch(const uint64_t* keys, const uint32_t* index, size_t count,
+                                    Session* out) const {
+    for (unsigned attempt = 0;; ++attempt) {
+        uint32_t begin = seq_.load(std::memory_order_acquire);
+        if ((begin & 1) == 0) {
+            size_t mask = read_mask_.load(std::memory_order_acquire);
+            const Session* slots = read_slots_.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t imsi = keys[index[i]];
+                Session& result = out[index[i]];
+                result.imsi = 0;
+                size_t slot = static_cast<size_t>(mixImsiHash(imsi)) & mask;
+                for (size_t probes = 0; probes <= mask; ++probes) {
+                    uint64_t key = slots[slot].imsi;
+                    if (key == 0) break;
+                    if (key == imsi) {
+                        result = slots[slot];
+                        break;
+                    }
+                    slot = (slot + 1) & mask;
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == begin) return;
+        }
+        if (attempt >= kReadSpins) std::this_thread::yield();
+    }
+}
+
+size_t SessionTable::Shard::readSlots(size_t from, size_t count, std::vector<Session>& out) const {
+    size_t base = out.size();
+    for (unsigned attempt = 0;; ++attempt) {
+        uint32_t begin = seq_.load(std::memory_order_acquire);
+        if ((begin & 1) == 0) {
+            size_t capacity = read_mask_.load(std::memory_order_acquire) + 1;
+            const Session* slots = read_slots_.load(std::memory_order_relaxed);
+            size_t end = from + count < capacity ? from + count : capacity;
+            for (size_t slot = from; slot < end; ++slot) {
+                if (slots[slot].imsi != 0) out.push_back(slots[slot]);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == begin) return capacity;
+            out.resize(base);
+        }
+        if (attempt >= kReadSpins) std::this_thread::yield();
+    }
+}
+
+const SessionTable::Session* SessionTable::Shard::find(uint64_t imsi) const {
+    size_t slot = findSlot(imsi);
+    return slots_[slot].imsi == imsi ? &slots_[slot] : nullptr;
+}
+
+bool SessionTable::Shard::erase(uint64_t imsi) {
+    size_t slot = findSlot(imsi);
+    if (slots_[slot].imsi != imsi) return false;
+    eraseSlot(slot);
+    return true;
+}
+
+// Удаление со сдвигом назад (backward shift): вместо надгробий подтягиваем
+// последующие записи цепочки, чтобы поиск не деградировал со временем.
+// Переезжающие записи перешиваются в списках колеса.
+void SessionTable::Shard::eraseSlot(size_t slot) {
+    unlink(static_cast<uint32_t>(slot));
+    size_t hole = slot;
+    size_t next = (hole + 1) & mask_;
+    while (slots_[next].imsi != 0) {
+        size_t home = homeSlot(slots_[next].imsi);
+        // запись можно перенести в дыру, если её домашний слот не лежит в (hole, next]
+        bool in_range = hole <= next ? (home > hole && home <= next)
+                                     : (home > hole || home <= next);
+        if (!in_range) {
+            relocate(static_cast<uint32_t>(next), static_cast<uint32_t>(hole));
+            hole = next;
+        }
+        next = (next + 1) & mask_;
+    }
+    slots_[hole].imsi = 0;
+    size_.store(size() - 1, std::memory_order_relaxed);
+}
+
+void SessionTable::Shard::grow() {
+    std::vector<Session> old;
+    old.swap(slots_);
+    slots_.assign(old.size() * 2, Session{});
+    mask_ = slots_.size() - 1;
+    drain_slot_ = 0;
+    wheel_.assign(wheel_.size(), kNil);
+    for (const Session& rec : old) {
+        if (rec.imsi == 0) continue;
+        size_t slot = findSlot(rec.imsi);
+        slots_[slot] = rec;
+        link(static_cast<uint32_t>(slot));
+    }
+    publishSlots();
+    // старый массив ещё могут читать без блокировки
+    retired_.push_back(std::move(old));
+}
+
+int64_t SessionTable::Shard::tickOf(Clock::time_point t) const {
+    return static_cast<int64_t>((t - table_->epoch_) / table_->tick_);
+}
+
+uint32_t SessionTable::Shard::secondsOf(Clock::time_point t) const {
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>(t - table_->epoch_).count();
+    return sec > 0 ? static_cast<uint32_t>(sec) : 0;
+}
+
+void SessionTable::Shard::link(uint32_t slot) {
+    int64_t tick = tickOf(slots_[slot].expires_at);
+    int64_t last = wheel_cursor_ + static_cast<int64_t>(table_->wheel_mask_);
+    if (tick < wheel_cursor_) tick = wheel_cursor_;
+    if (tick > last) tick = last;
+    uint32_t bucket = static_cast<uint32_t>(tick & static_cast<int64_t>(table_->wheel_mask_));
+    Session& rec = slots_[slot];
+    rec.wheel_prev = kHead | bucket;
+    rec.wheel_next = wheel_[bucket];
+    if (rec.wheel_next != kNil) slots_[rec.wheel_next].wheel_prev = slot;
+    wheel_[bucket] = slot;
+}
+
+void SessionTable::Shard::unlink(uint32_t slot) {
+    Session& rec = slots_[slot];
+    if (rec.wheel_prev & kHead)
+        wheel_[rec.wheel_prev & ~kHead] = rec.wheel_next;
+    else
+        slots_[rec.wheel_prev].wheel_next = rec.wheel_next;
+    if (rec.wheel_next != kNil) slots_[rec.wheel_next].wheel_prev = rec.wheel_prev;
+}
+
+void SessionTable::Shard::relocate(uint32_t from, uint32_t to) {
+    slots_[to] = slots_[from];
+    Session& rec = slots_[to];
+    if (rec.wheel_prev & kHead)
+        wheel_[rec.wheel_prev & ~kHead] = to;
+    else
+        slots_[rec.wheel_prev].wheel_next = to;
+    if (rec.wheel_next != kNil) slots_[rec.wheel_next].wheel_prev = to;
+}
@@ -0,0 +1,209 @@
+#ifndef SESSION_TABLE_H
+#define SESSION_TABLE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "../common/imsi.h"
+
+// Таблица сессий: open-addressing хэш-таблица с линейным пробированием,
+// ключ — упакованный IMSI (Imsi::packed, см. imsi.h). Таблица разбита на
+// шарды со своим mutex, записи хранятся прямо в массиве слотов, поэтому
+// поиск, вставка и обновление не выделяют память (пока не нужен рост шарда).
+// Ключ 0 зарезервирован под пустой слот: у упакованного IMSI младший
+// полубайт всегда 0xF, так что реальный ключ нулём не бывает.
+//
+// Истечение сессий: у каждого шарда своё колесо таймеров — кольцо корзин
+// по тику, в корзине интрузивный двусвязный список индексов слотов.
+// Обновление сессии переносит её в другую корзину за O(1), а тик
+// просматривает только корзины, чьё время прошло, то есть только
+// истекающие сессии.
+//
+// Чтение без блокировок (contains, lookup — для HTTP): у шарда есть счётчик
+// версий (seqlock). Писатель под mutex делает его нечётным на время изменения,
+// читатель копирует запись и повторяет попытку, если счётчик изменился.
+// Читатели никогда не задерживают писателей. Массив слотов после роста
+// шарда не освобождается до удаления таблицы, чтобы читатель, начавший
+// пробирование до роста, не обратился к освобождённой памяти; при росте
+// удвоением эти массивы в сумме не больше текущего.
+class SessionTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Session {
+        uint64_t imsi;
+        Clock::time_point created;
+        Clock::time_point expires_at;
+        uint32_t wheel_prev;
+        uint32_t wheel_next;
+        // Объединение renew (setRenewWindow): обновлений без записи CDR
+        // и начало текущего окна, секунды от создания таблицы; до первого
+        // renew окна нет
+        uint32_t renews;
+        uint32_t renew_at;
+    };
+
+    // Coalesced — сессия обновлена, но окно объединения renew ещё не
+    // прошло: запись CDR не нужна, обновление учтено в Session::renews
+    enum class TouchResult { Created, Refreshed, Coalesced };
+
+    // Шард: все методы вызываются под его mutex (см. withShard)
+    class Shard {
+    public:
+        // Для Refreshed в coalesced (если не nullptr) пишется число
+        // объединённых обновлений прошлого окна — их нужно указать в записи renew
+        TouchResult touch(uint64_t imsi, Clock::time_point now, uint32_t* coalesced = nullptr);
+        const Session* find(uint64_t imsi) const;
+        bool erase(uint64_t imsi);
+        // Вставка с заданными сроками (восстановление из снимка);
+        // false, если сессия уже есть
+        bool insert(uint64_t imsi, Clock::time_point created, Clock::time_point expires_at);
+        size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+        // Копия сессии без блокировки (seqlock); false, если её нет
+        bool read(uint64_t imsi, Session* out) const;
+        // То же для count ключей keys[index[i]] за одну проверку версии;
+        // отсутствующим в out[index[i]] пишется imsi = 0
+        void readBatch(const uint64_t* keys, const uint32_t* index, size_t count, Session* out) const;
+        // Копии сессий из слотов [from, from + count) без блокировки;
+        // возвращает число слотов шарда на момент чтения
+        size_t readSlots(size_t from, size_t count, std::vector<Session>& out) const;
+
+        // Обход сессий шарда: fn(const Session&)
+        template <typename Fn>
+        void forEach(Fn&& fn) const {
+            for (const Session& rec : slots_)
+                if (rec.imsi != 0) fn(rec);
+        }
+
+    private:
+        friend class SessionTable;
+
+        size_t homeSlot(uint64_t imsi) const;
+        size_t findSlot(uint64_t imsi) const;
+        void eraseSlot(size_t slot);
+        void insertAt(size_t slot, const Session& rec);
+        void publishSlots();
+        void grow();
+
+        int64_t tickOf(Clock::time_point t) const;
+        uint32_t secondsOf(Clock::time_point t) const;
+        void link(uint32_t slot);
+        void unlink(uint32_t slot);
+        void relocate(uint32_t from, uint32_t to);
+        template <typename Fn>
+        size_t expire(int64_t now_tick, Fn&& fn);
+        template <typename Fn>
+        size_t drain(size_t max_count, Fn&& fn);
+
+        const SessionTable* table_ = nullptr;
+        std::vector<Session> slots_;
+        size_t mask_ = 0;
+        // Пишется под mutex, читается без блокировки (SessionTable::size)
+        std::atomic<size_t> size_{0};
+        std::vector<uint32_t> wheel_;   // голова списка каждой корзины
+        int64_t wheel_cursor_ = 0;      // тик ближайшей ещё не обработанной корзины
+        size_t drain_slot_ = 0;         // слот, с которого продолжает drain
+        mutable std::mutex mutex_;
+
+        // seqlock: нечётное значение — идёт изменение
+        alignas(64) std::atomic<uint32_t> seq_{0};
+        std::atomic<const Session*> read_slots_{nullptr};
+        std::atomic<size_t> read_mask_{0};
+        std::vector<std::vector<Session>> retired_;
+    };
+
+    // shard_count округляется вверх до степени двойки,
+    // expected_sessions задаёт начальную ёмкость без перехэширования.
+    // Сессия живёт timeout с последнего обновления, точность истечения — tick.
+    SessionTable(size_t shard_count, size_t expected_sessions,
+                 Clock::duration timeout, Clock::duration tick = std::chrono::seconds(1));
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+    TouchResult touch(uint64_t imsi, Clock::time_point now);
+    // Окно объединения renew: первое обновление сессии даёт Refreshed
+    // и открывает окно, следующие в течение window только считаются. 0 — каждое
+    // обновление даёт Refreshed. Задаётся до начала работы.
+    void setRenewWindow(std::chrono::seconds window) { renew_window_sec_ = static_cast<uint32_t>(window.count()); }
+    bool coalescesRenews() const { return renew_window_sec_ != 0; }
+    // Без блокировок, см. комментарий к классу
+    bool contains(uint64_t imsi) const;
+    bool lookup(uint64_t imsi, Session& out) const;
+    // Пакетный поиск: ключи группируются по шардам, каждый шард читается
+    // короткими сериями без блокировок. out[i] — сессия keys[i] или imsi = 0.
+    void lookupBatch(const std::vector<uint64_t>& keys, std::vector<Session>& out) const;
+
+    // Курсорный обход для выгрузки: дописывает в out сессии из следующих
+    // max_slots слотов и возвращает новый курсор (0 — обход закончен).
+    // Начальный курсор — 0. Каждый шаг читает небольшой участок шарда
+    // без блокировок. Обход слабо согласован: сессии, созданные или
+    // перемещённые во время обхода, могут быть пропущены или повторены.
+    uint64_t scan(uint64_t cursor, size_t max_slots, std::vector<Session>& out) const;
+    bool erase(uint64_t imsi);
+    bool insert(uint64_t imsi, Clock::time_point created, Clock::time_point expires_at);
+    // Сумма размеров шардов без блокировок: каждое слагаемое точное,
+    // но шарды могут меняться во время подсчёта
+    size_t size() const;
+
+    // Удаляет сессии, истёкшие к моменту now, и дописывает в out их IMSI
+    // или копии записей (со счётчиками renew для CDR).
+    // Шарды блокируются по одному, просматриваются только наступившие корзины.
+    size_t expire(Clock::time_point now, std::vector<uint64_t>& out);
+    size_t expire(Clock::time_point now, std::vector<Session>& out);
+
+    // Удаляет не более max_count произвольных сессий (для плавного завершения)
+    size_t drain(size_t max_count, std::vector<uint64_t>& out);
+    size_t drain(size_t max_count, std::vector<Session>& out);
+    // То же для одного шарда за одно взятие его mutex (пакетное удаление
+    // при плавном завершении). Повторные вызовы продолжают с места, где
+    // остановился предыдущий, поэтому удаление всего шарда частями — O(слотов).
+    size_t drainShard(size_t shard, size_t max_count, std::vector<Session>& out);
+
+    // Время последнего обновления сессии
+    Clock::time_point lastSeen(const Session& s) const { return s.expires_at - timeout_; }
+
+    size_t shardCount() const { return shards_.size(); }
+    size_t shardOf(uint64_t imsi) const;
+    Clock::duration timeout() const { return timeout_; }
+
+    // Выполнение fn(Shard&) под блокировкой одного шарда —
+    // для пакетной обработки нескольких IMSI за одно взятие mutex.
+    // Всё время выполнения fn шард помечен для читателей как изменяемый.
+    template <typename Fn>
+    void withShard(size_t shard, Fn&& fn) {
+        Shard& s = *shards_[shard];
+        std::lock_guard<std::mutex> lock(s.mutex_);
+        s.seq_.store(s.seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        struct SeqEnd {
+            std::atomic<uint32_t>& seq;
+            ~SeqEnd() { seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+        } seq_end{s.seq_};
+        fn(s);
+    }
+
+    // fn(const Shard&) под блокировкой без пометки изменения: длинные обходы
+    // (снимок) не заставляют читателей повторять попытки
+    template <typename Fn>
+    void readShard(size_t shard, Fn&& fn) const {
+        const Shard& s = *shards_[shard];
+        std::lock_guard<std::mutex> lock(s.mutex_);
+        fn(s);
+    }
+
+private:
+    std::vector<std::unique_ptr<Shard>> shards_;
+    unsigned shard_shift_ = 0;
+    Clock::duration timeout_;
+    Clock::duration tick_;
+    Clock::time_point epoch_;
+    size_t wheel_mask_ = 0;
+    uint32_t renew_window_sec_ = 0;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "shutdown_drain.h"
+#include <algorithm>
+
+constexpr int64_t kTokenUnit = 1000000000;      // токенов на сессию: rate * нс
+
+ShutdownDrain::ShutdownDrain(SessionTable& sessions, uint32_t rate)
+    : sessions_(sessions), rate_(std::max<uint32_t>(rate, 1)) {
+    period_ = std::clamp<Clock::duration>(std::chrono::nanoseconds(kTokenUnit / rate_), std::chrono::milliseconds(1),
+                                          std::chrono::milliseconds(100));
+    int64_t period_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(period_).count();
+    burst_ = std::max<int64_t>(2 * kTokenUnit, 2 * period_ns * rate_);
+}
+
+void ShutdownDrain::start(Clock::time_point now) {
+    last_ = now;
+    tokens_ = 0;
+    total_.store(sessions_.size(), std::memory_order_relaxed);
+    started_ns_.store(nanosOf(now), std::memory_order_release);
+    finishIfEmpty(now);
+}
+
+size_t ShutdownDrain::step(Clock::time_point now, std::vector<SessionTable::Session>& out) {
+    if (finished()) return 0;
+    // Пауза длиннее ведра ограничивается до умножения, чтобы не переполнить tokens_
+    int64_t elapsed = std::min<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count(), burst_ / rate_ + 1);
+    last_ = now;
+    if (elapsed > 0) tokens_ = std::min(tokens_ + elapsed * rate_, burst_);
+    const size_t want = static_cast<size_t>(tokens_ / kTokenUnit);
+
+    const size_t shards = sessions_.shardCount();
+    size_t removed = 0;
+    size_t empty_shards = 0;
+    while (removed < want && empty_shards < shards) {
+        size_t n = sessions_.drainShard(shard_, std::min(kBatch, want - removed), out);
+        removed += n;
+        empty_shards = n == 0 ? empty_shards + 1 : 0;
+        shard_ = (shard_ + 1) % shards;
+    }
+    tokens_ -= static_cast<int64_t>(removed) * kTokenUnit;
+    removed_.fetch_add(removed, std::memory_order_relaxed);
+    finishIfEmpty(now);
+    return removed;
+}
+
+void ShutdownDrain::finishIfEmpty(Clock::time_point now) {
+    if (sessions_.size() == 0) finished_ns_.store(std::max<int64_t>(nanosOf(now), 1), std::memory_order_release);
+}
+
+DrainProgress ShutdownDrain::progress(Clock::time_point now) const {
+    DrainProgress p;
+    p.rate = rate_;
+    int64_t started = started_ns_.load(std::memory_order_acquire);
+    if (started == 0) return p;
+    int64_t finished = finished_ns_.load(std::memory_order_acquire);
+    p.started = true;
+    p.finished = finished != 0;
+    p.total = total_.load(std::memory_order_relaxed);
+    p.removed = removed_.load(std::memory_order_relaxed);
+    p.remaining = p.finished ? 0 : sessions_.size();
+    p.elapsed_sec = static_cast<double>((p.finished ? finished : nanosOf(now)) - started) / 1e9;
+    p.eta_sec = static_cast<double>(p.remaining) / rate_;
+    return p;
+}
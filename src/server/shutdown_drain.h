@@ -0,0 +1,76 @@
+#ifndef SHUTDOWN_DRAIN_H
+#define SHUTDOWN_DRAIN_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "session_table.h"
+
+// Плавное завершение: удаление всех сессий со скоростью graceful_shutdown_rate.
+// Скорость задаёт ведро токенов на монотонных часах: шаги идут каждые
+// period() — около одной сессии на шаг, но не реже 100 мс и не чаще 1 мс, —
+// и каждый удаляет столько сессий, сколько набралось токенов, с переносом
+// дробной части. Ведро вмещает не больше двух шагов: задержка потока
+// догоняется, долгая пауза не превращается во всплеск удалений.
+// Сессии удаляются пачками до kBatch из одного шарда за одно взятие его
+// mutex, шарды — по кругу.
+//
+// start и step вызывает один поток, progress — любой (HTTP).
+struct DrainProgress {
+    bool started = false;
+    bool finished = false;
+    uint32_t rate = 0;              // сессий в секунду
+    uint64_t total = 0;             // сессий в начале удаления
+    uint64_t removed = 0;
+    uint64_t remaining = 0;
+    double elapsed_sec = 0;
+    double eta_sec = 0;             // оставшиеся сессии при заданной скорости
+};
+
+class ShutdownDrain {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kBatch = 256;
+
+    // rate >= 1
+    ShutdownDrain(SessionTable& sessions, uint32_t rate);
+    ShutdownDrain(const ShutdownDrain&) = delete;
+    ShutdownDrain& operator=(const ShutdownDrain&) = delete;
+
+    Clock::duration period() const { return period_; }
+
+    void start(Clock::time_point now);
+    // Удаляет сессии, на которые набрались токены к now, и дописывает их
+    // в out. Возвращает число удалённых.
+    size_t step(Clock::time_point now, std::vector<SessionTable::Session>& out);
+    // Таблица пуста, шаги больше не нужны
+    bool finished() const { return finished_ns_.load(std::memory_order_acquire) != 0; }
+
+    DrainProgress progress(Clock::time_point now) const;
+
+private:
+    static int64_t nanosOf(Clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+    void finishIfEmpty(Clock::time_point now);
+
+    SessionTable& sessions_;
+    uint32_t rate_;
+    Clock::duration period_;
+    // Токены в миллиардных долях сессии: пополнение rate * нс без округлений
+    int64_t tokens_ = 0;
+    int64_t burst_ = 0;
+    Clock::time_point last_{};
+    size_t shard_ = 0;              // шард следующей пачки
+
+    // Для progress; время — нс монотонных часов, 0 — не наступило
+    std::atomic<int64_t> started_ns_{0};
+    std::atomic<int64_t> finished_ns_{0};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> removed_{0};
+};
+
+#endif
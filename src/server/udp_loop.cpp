@@ -0,0 +1,203 @@
+#include "udp_loop.h"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "log_limiter.h"
+
+int waitReadable(int epoll_fd, int timeout_ms) {
+    epoll_event events[4];
+    int ready = epoll_wait(epoll_fd, events, 4, timeout_ms);
+    return ready < 0 && errno == EINTR ? 0 : ready;
+}
+
+bool addToEpoll(int epoll_fd, int fd) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool enableRxTimestamps(int sock) {
+    int on = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+int64_t rxTimestampNs(const msghdr& msg) {
+    for (const cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(const_cast<msghdr*>(&msg), const_cast<cmsghdr*>(c))) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+    }
+    return 0;
+}
+
+bool enableBusyPoll(int sock, int usec) {
+#ifdef SO_BUSY_POLL
+    return setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == 0;
+#else
+    (void)sock;
+    (void)usec;
+    errno = ENOPROTOOPT;
+    return false;
+#endif
+}
+
+// Пауза в цикле опроса: снижает потребление и не отнимает ресурсы у
+// соседнего гиперпотока, не отдавая ядро планировщику
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+UdpBackend parseUdpBackend(const std::string& value) {
+    if (value == "socket") return UdpBackend::Socket;
+    if (value == "io_uring") return UdpBackend::IoUring;
+    throw std::invalid_argument("Unknown udp_backend: " + value);
+}
+
+void runSocketLoop(const UdpLoopOptions& options, RequestHandler& handler, WorkerMetrics& metrics) {
+    auto logger = spdlog::default_logger();
+    const int sock = options.sock;
+    // Поток спит в epoll, пока нет датаграмм; shutdown_fd будит его при остановке
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0 || !addToEpoll(epoll_fd, sock) || !addToEpoll(epoll_fd, options.shutdown_fd)) {
+        logger->critical("UDP epoll setup failed: {}", strerror(errno));
+        if (epoll_fd >= 0) close(epoll_fd);
+        return;
+    }
+
+    // Буферы пакетной обработки: до batch_size датаграмм за один recvmmsg,
+    // ответы на весь пакет уходят одним sendmmsg
+    const int batch_size = options.batch_size;
+    std::vector<std::array<char, kMaxDatagram>> rx_bufs(batch_size);
+    std::vector<sockaddr_in> rx_addrs(batch_size);
+    std::vector<std::array<char, kRxControlSize>> rx_control(batch_size);
+    std::vector<iovec> rx_iov(batch_size);
+    std::vector<mmsghdr> rx_msgs(batch_size);
+    std::vector<iovec> tx_iov(batch_size);
+    std::vector<mmsghdr> tx_msgs(batch_size);
+    std::vector<Datagram> datagrams(batch_size);
+    std::vector<Reply> replies(batch_size);
+
+    // Ошибки приёма и отправки повторяются на каждом пакете: не больше
+    // одного сообщения в секунду каждого вида
+    LogRateLimiter recv_error_log(1);
+    LogRateLimiter send_error_log(1);
+    uint64_t suppressed = 0;
+
+    // Заголовки приёма восстанавливаются, только если recvmmsg их заполнил:
+    // пустой опрос в режиме busy_poll ничего не переписывает
+    int used = batch_size;
+    while (!options.stop->load(std::memory_order_relaxed)) {
+        for (int i = 0; i < used; ++i) {
+            rx_iov[i] = {rx_bufs[i].data(), rx_bufs[i].size()};
+            rx_msgs[i].msg_hdr = msghdr{};
+            rx_msgs[i].msg_hdr.msg_name = &rx_addrs[i];
+            rx_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+            rx_msgs[i].msg_hdr.msg_iovlen = 1;
+            rx_msgs[i].msg_hdr.msg_control = rx_control[i].data();
+            rx_msgs[i].msg_hdr.msg_controllen = kRxControlSize;
+        }
+        // Неблокирующий сокет: забираем всё, что уже пришло (до batch_size)
+        used = 0;
+        int received = recvmmsg(sock, rx_msgs.data(), batch_size, 0, nullptr);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Очередь сокета пуста: опрашиваем снова (флаг остановки
+                // проверяется в начале цикла) или ждём датаграмм в epoll
+                if (options.busy_poll) {
+                    cpuRelax();
+                    continue;
+                }
+                if (waitReadable(epoll_fd, -1) < 0) {
+                    logger->error("epoll_wait error: {}", strerror(errno));
+                    break;
+                }
+                continue;
+            }
+            if (errno == EINTR) continue;
+            const int err = errno;
+            if (recv_error_log.allow(std::chrono::steady_clock::now(), suppressed)) {
+                logger->error("recvmmsg error: {}{}", strerror(err), suppressedNote(suppressed));
+            }
+            // Сокет непригоден — цикл завершается, как при ошибке epoll;
+            // иначе (например, ENOMEM) пауза до готовности сокета, не дольше
+            // 100 мс, вместо повтора вхолостую
+            if (err == EBADF || err == ENOTSOCK) break;
+            if (waitReadable(epoll_fd, 100) < 0) {
+                logger->error("epoll_wait error: {}", strerror(errno));
+                break;
+            }
+            continue;
+        }
+        used = received;
+        auto rx_time = std::chrono::steady_clock::now();
+        bumpCounter(metrics.rx_syscalls);
+        bumpCounter(metrics.rx_packets, received);
+
+        for (int i = 0; i < received; ++i) {
+            datagrams[i] = Datagram{reinterpret_cast<const uint8_t*>(rx_bufs[i].data()), rx_msgs[i].msg_len,
+                                    (rx_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0, &rx_addrs[i],
+                                    rxTimestampNs(rx_msgs[i].msg_hdr)};
+        }
+        size_t answered = handler.handle(datagrams.data(), static_cast<size_t>(received), replies.data());
+        if (answered == 0) continue;
+
+        int to_send = 0;
+        for (int i = 0; i < received; ++i) {
+            if (!replies[i].data) continue;
+            tx_iov[to_send] = {const_cast<uint8_t*>(replies[i].data), replies[i].size};
+            tx_msgs[to_send].msg_hdr = msghdr{};
+            tx_msgs[to_send].msg_hdr.msg_name = &rx_addrs[i];
+            tx_msgs[to_send].msg_hdr.msg_namelen = rx_msgs[i].msg_hdr.msg_namelen;
+            tx_msgs[to_send].msg_hdr.msg_iov = &tx_iov[to_send];
+            tx_msgs[to_send].msg_hdr.msg_iovlen = 1;
+            ++to_send;
+        }
+        int sent_total = 0;
+        while (sent_total < to_send) {
+            int sent = sendmmsg(sock, tx_msgs.data() + sent_total, to_send - sent_total, 0);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // Буфер отправки заполнен: ждём места, но не дольше 100 мс
+                    pollfd out{sock, POLLOUT, 0};
+                    if (poll(&out, 1, 100) > 0) continue;
+                    // Места так и нет: остаток ответов пакета отбрасывается
+                    bumpCounter(metrics.tx_errors, to_send - sent_total);
+                    break;
+                }
+                // sendmmsg возвращает ошибку, только если не отправлен первый
+                // ответ (например, адрес с портом 0 — EINVAL): он пропускается,
+                // остальные отправляются
+                if (send_error_log.allow(std::chrono::steady_clock::now(), suppressed)) {
+                    logger->error("sendmmsg error: {}{}", strerror(errno), suppressedNote(suppressed));
+                }
+                bumpCounter(metrics.tx_errors);
+                ++sent_total;
+                continue;
+            }
+            bumpCounter(metrics.tx_syscalls);
+            bumpCounter(metrics.tx_packets, sent);
+            sent_total += sent;
+        }
+        // Весь пакет ждал ответа одинаково: одно значение с весом числа датаграмм
+        auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - rx_time).count();
+        metrics.latency.record(static_cast<uint64_t>(latency), answered);
+    }
+    close(epoll_fd);
+}
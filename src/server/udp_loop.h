@@ -0,0 +1,56 @@
+#ifndef UDP_LOOP_H
+#define UDP_LOOP_H
+
+#include <atomic>
+#include <ctime>
+#include <string>
+#include <sys/socket.h>
+#include "request_handler.h"
+
+// Ожидание готовности на чтение любого из fd, добавленных в epoll_fd,
+// не дольше timeout_ms (-1 — без ограничения). EINTR считается таймаутом.
+int waitReadable(int epoll_fd, int timeout_ms);
+bool addToEpoll(int epoll_fd, int fd);
+
+// Метки времени приёма ядром (SO_TIMESTAMPNS): по ним считается, сколько
+// датаграмма ждала в очереди сокета
+bool enableRxTimestamps(int sock);
+constexpr size_t kRxControlSize = CMSG_SPACE(sizeof(timespec));
+// Метка из управляющих данных recvmsg в наносекундах, 0 — её нет
+int64_t rxTimestampNs(const msghdr& msg);
+
+// SO_BUSY_POLL: ядро опрашивает очередь сетевой карты при чтении из сокета
+// до usec микросекунд вместо ожидания прерывания. Значение больше
+// net.core.busy_read требует CAP_NET_ADMIN; false — errno от setsockopt.
+bool enableBusyPoll(int sock, int usec);
+
+enum class UdpBackend { Socket, IoUring };
+
+// std::invalid_argument при неизвестном значении
+UdpBackend parseUdpBackend(const std::string& value);
+
+// Приём одного UDP-потока. Цикл работает, пока не установлен stop;
+// shutdown_fd (eventfd) будит поток, ждущий датаграмм.
+struct UdpLoopOptions {
+    int sock = -1;                              // неблокирующий UDP-сокет
+    int shutdown_fd = -1;
+    const std::atomic<bool>* stop = nullptr;
+    int batch_size = 32;                        // датаграмм на один вызов обработчика
+    bool busy_poll = false;                     // опрос сокета в цикле вместо сна в epoll
+};
+
+// recvmmsg/sendmmsg на неблокирующем сокете, ожидание в epoll. При
+// busy_poll поток не засыпает: пустой recvmmsg сразу повторяется, и
+// датаграмма забирается без пробуждения потока планировщиком. Поток
+// занимает ядро CPU целиком, поэтому его стоит привязать к отдельному ядру.
+void runSocketLoop(const UdpLoopOptions& options, RequestHandler& handler, WorkerMetrics& metrics);
+
+// io_uring: многоразовый (multishot) recvmsg с кольцом буферов, выделенных
+// заранее (provided buffer ring), ответы — SQE sendmsg, отправляемые одним
+// io_uring_enter вместе с ожиданием следующих датаграмм.
+// false, если ядро не поддерживает нужные возможности (причина в error):
+// к этому моменту из сокета ничего не прочитано, и можно перейти на runSocketLoop.
+bool runUringLoop(const UdpLoopOptions& options, RequestHandler& handler, WorkerMetrics& metrics,
+                  std::string& error);
+
+#endif
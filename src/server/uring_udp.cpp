@@ -0,0 +1,444 @@
+#include "udp_loop.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// io_uring без liburing: кольца отображаются в память напрямую,
+// системные вызовы — io_uring_setup/io_uring_enter/io_uring_register.
+
+namespace {
+
+// user_data: вид операции в старших битах, для отправки — номер слота в младших
+constexpr uint64_t kRecvTag = 1ULL << 62;
+constexpr uint64_t kShutdownTag = 1ULL << 61;
+constexpr uint64_t kCancelTag = 1ULL << 60;
+constexpr uint64_t kSendTag = 1ULL << 59;
+
+constexpr unsigned kRingEntries = 2048;
+constexpr unsigned kBufferCount = 4096;     // степень двойки (требование кольца буферов)
+constexpr uint16_t kBufferGroup = 0;
+// Буфер multishot recvmsg: заголовок io_uring_recvmsg_out, адрес отправителя,
+// управляющие данные (метка времени приёма), данные
+constexpr size_t kBufferSize = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + kRxControlSize + kMaxDatagram;
+constexpr unsigned kSendSlots = 4096;
+
+int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int uringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+template <typename T>
+T loadAcquire(const T* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+void storeRelease(T* p, T value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+// Кольца отправки и завершения одного потока
+class Uring {
+public:
+    Uring() = default;
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring() {
+        if (fd_ >= 0) close(fd_);
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+    }
+
+    bool init(unsigned entries, std::string& error) {
+        io_uring_params params{};
+        // Кольцо используется только создавшим его потоком
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = entries * 4;
+        fd_ = uringSetup(entries, &params);
+        if (fd_ < 0 && errno == EINVAL) {
+            // старое ядро: без необязательных флагов
+            params = io_uring_params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = entries * 4;
+            fd_ = uringSetup(entries, &params);
+        }
+        if (fd_ < 0) {
+            error = std::string("io_uring_setup: ") + strerror(errno);
+            return false;
+        }
+        if (!(params.features & IORING_FEAT_NODROP)) {
+            error = "io_uring without IORING_FEAT_NODROP";
+            return false;
+        }
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            error = std::string("mmap SQ ring: ") + strerror(errno);
+            return false;
+        }
+        cq_ptr_ = single_mmap ? sq_ptr_
+                              : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                     IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (cq_ptr_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            error = std::string("mmap io_uring: ") + strerror(errno);
+            return false;
+        }
+        char* sq = static_cast<char*>(sq_ptr_);
+        char* cq = static_cast<char*>(cq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        local_tail_ = *sq_tail_;
+        return true;
+    }
+
+    int fd() const { return fd_; }
+    unsigned freeSqes() const { return sq_entries_ - (local_tail_ - loadAcquire(sq_head_)); }
+
+    // Следующий SQE (обнулённый); nullptr, если кольцо заполнено
+    io_uring_sqe* nextSqe() {
+        if (freeSqes() == 0) return nullptr;
+        unsigned index = local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        ++local_tail_;
+        ++unsubmitted_;
+        return sqe;
+    }
+
+    // Отправляет накопленные SQE и ждёт не меньше min_complete завершений
+    int submit(unsigned min_complete) {
+        storeRelease(sq_tail_, local_tail_);
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int ret = uringEnter(fd_, unsubmitted_, min_complete, flags);
+        if (ret >= 0) unsubmitted_ -= std::min<unsigned>(unsubmitted_, static_cast<unsigned>(ret));
+        return ret;
+    }
+
+    unsigned unsubmitted() const { return unsubmitted_; }
+
+    // fn(const io_uring_cqe&) для всех готовых завершений
+    template <typename Fn>
+    void forEachCqe(Fn&& fn) {
+        unsigned head = *cq_head_;
+        unsigned tail = loadAcquire(cq_tail_);
+        for (; head != tail; ++head) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            // голова сдвигается до вызова: fn может поставить новые SQE
+            storeRelease(cq_head_, head + 1);
+            fn(cqe);
+        }
+    }
+
+private:
+    int fd_ = -1;
+    void* sq_ptr_ = MAP_FAILED;
+    void* cq_ptr_ = MAP_FAILED;
+    void* sqes_ = MAP_FAILED;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned local_tail_ = 0;
+    unsigned unsubmitted_ = 0;
+};
+
+// Кольцо буферов приёма (provided buffer ring): ядро само берёт свободный
+// буфер для каждой датаграммы, поток возвращает его после обработки
+class BufferRing {
+public:
+    BufferRing() = default;
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+
+    ~BufferRing() {
+        if (ring_ != MAP_FAILED) munmap(ring_, ring_size_);
+        if (buffers_ != MAP_FAILED) munmap(buffers_, buffers_size_);
+    }
+
+    bool init(int uring_fd, std::string& error) {
+        ring_size_ = kBufferCount * sizeof(io_uring_buf);
+        buffers_size_ = kBufferCount * kBufferSize;
+        ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        buffers_ = mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring_ == MAP_FAILED || buffers_ == MAP_FAILED) {
+            error = std::string("mmap buffer ring: ") + strerror(errno);
+            return false;
+        }
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring_);
+        reg.ring_entries = kBufferCount;
+        reg.bgid = kBufferGroup;
+        if (uringRegister(uring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            error = std::string("IORING_REGISTER_PBUF_RING: ") + strerror(errno);
+            return false;
+        }
+        for (uint16_t bid = 0; bid < kBufferCount; ++bid) recycle(bid);
+        publish();
+        return true;
+    }
+
+    char* buffer(uint16_t bid) const { return static_cast<char*>(buffers_) + size_t(bid) * kBufferSize; }
+
+    void recycle(uint16_t bid) {
+        io_uring_buf* buf = static_cast<io_uring_buf*>(ring_) + (tail_ & (kBufferCount - 1));
+        buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+        buf->len = kBufferSize;
+        buf->bid = bid;
+        ++tail_;
+    }
+
+    // Делает возвращённые буферы видимыми ядру
+    void publish() { storeRelease(&static_cast<io_uring_buf_ring*>(ring_)->tail, tail_); }
+
+private:
+    void* ring_ = MAP_FAILED;
+    void* buffers_ = MAP_FAILED;
+    size_t ring_size_ = 0;
+    size_t buffers_size_ = 0;
+    uint16_t tail_ = 0;
+};
+
+// Адрес, сообщение и копия ответа живут до завершения его SQE: буфер
+// пакетных ответов обработчика переиспользуется следующим пакетом
+struct SendSlot {
+    sockaddr_in addr;
+    iovec iov;
+    msghdr msg;
+    uint8_t data[kMaxReply];
+};
+
+}
+
+bool runUringLoop(const UdpLoopOptions& options, RequestHandler& handler, WorkerMetrics& metrics,
+                  std::string& error) {
+    auto logger = spdlog::default_logger();
+    const int sock = options.sock;
+    // Кольцо io_uring закрывается раньше, чем освобождается память буферов
+    BufferRing buffers;
+    Uring ring;
+    if (!ring.init(kRingEntries, error) || !buffers.init(ring.fd(), error)) return false;
+
+    // Шаблон recvmsg: ядро кладёт в буфер адрес длиной msg_namelen,
+    // до msg_controllen байт управляющих данных и данные
+    msghdr recv_msg{};
+    recv_msg.msg_namelen = sizeof(sockaddr_in);
+    recv_msg.msg_controllen = kRxControlSize;
+    auto arm_recv = [&]() {
+        io_uring_sqe* sqe = ring.nextSqe();
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock;
+        sqe->addr = reinterpret_cast<uint64_t>(&recv_msg);
+        sqe->len = 1;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->user_data = kRecvTag;
+        return true;
+    };
+    io_uring_sqe* stop_sqe = ring.nextSqe();
+    stop_sqe->opcode = IORING_OP_POLL_ADD;
+    stop_sqe->fd = options.shutdown_fd;
+    stop_sqe->poll32_events = POLLIN;
+    stop_sqe->user_data = kShutdownTag;
+    arm_recv();
+    bool recv_armed = true;
+
+    std::vector<SendSlot> slots(kSendSlots);
+    std::vector<uint32_t> free_slots;
+    free_slots.reserve(kSendSlots);
+    for (uint32_t i = kSendSlots; i > 0; --i) free_slots.push_back(i - 1);
+
+    const size_t batch_size = static_cast<size_t>(options.batch_size);
+    std::vector<Datagram> datagrams(batch_size);
+    std::vector<Reply> replies(batch_size);
+    std::vector<uint16_t> bids(batch_size);
+    size_t pending = 0;
+    // Ответы в SQ, ещё не переданные ядру: io_uring_enter, который их
+    // передаёт, считается и в tx_syscalls, как sendmmsg у цикла на сокете
+    size_t queued_sends = 0;
+    auto submit = [&](unsigned min_complete) {
+        int ret = ring.submit(min_complete);
+        if (ret >= 0 && queued_sends > 0) {
+            bumpCounter(metrics.tx_syscalls);
+            queued_sends = 0;
+        }
+        return ret;
+    };
+    bool received_any = false;
+    bool unsupported = false;
+    bool stop = false;
+    std::chrono::steady_clock::time_point rx_time;
+    LogRateLimiter send_error_log(1);
+    uint64_t suppressed = 0;
+
+    // Обработка накопленного пакета: ответы ставятся в SQ, буферы возвращаются в кольцо
+    auto flush = [&]() {
+        size_t answered = handler.handle(datagrams.data(), pending, replies.data());
+        for (size_t i = 0; i < pending && answered > 0; ++i) {
+            if (!replies[i].data) continue;
+            if (ring.freeSqes() == 0) submit(0);
+            io_uring_sqe* sqe = free_slots.empty() ? nullptr : ring.nextSqe();
+            if (!sqe) {
+                // Все слоты заняты незавершёнными отправками: обычный sendto
+                ssize_t sent = sendto(sock, replies[i].data, replies[i].size, 0,
+                                      reinterpret_cast<const sockaddr*>(datagrams[i].from), sizeof(sockaddr_in));
+                bumpCounter(metrics.tx_syscalls);
+                bumpCounter(sent < 0 ? metrics.tx_errors : metrics.tx_packets);
+                continue;
+            }
+            uint32_t index = free_slots.back();
+            free_slots.pop_back();
+            SendSlot& slot = slots[index];
+            slot.addr = *datagrams[i].from;
+            std::memcpy(slot.data, replies[i].data, replies[i].size);
+            slot.iov = {slot.data, replies[i].size};
+            slot.msg = msghdr{};
+            slot.msg.msg_name = &slot.addr;
+            slot.msg.msg_namelen = sizeof(slot.addr);
+            slot.msg.msg_iov = &slot.iov;
+            slot.msg.msg_iovlen = 1;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = sock;
+            sqe->addr = reinterpret_cast<uint64_t>(&slot.msg);
+            sqe->len = 1;
+            sqe->user_data = kSendTag | index;
+            ++queued_sends;
+        }
+        for (size_t i = 0; i < pending; ++i) buffers.recycle(bids[i]);
+        buffers.publish();
+        // Задержка — до постановки ответов в очередь: они уходят в ядро
+        // ближайшим io_uring_enter без ожидания
+        if (answered > 0) {
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - rx_time).count();
+            metrics.latency.record(static_cast<uint64_t>(latency), answered);
+        }
+        pending = 0;
+    };
+
+    auto on_cqe = [&](const io_uring_cqe& cqe) {
+        if (cqe.user_data == kShutdownTag) {
+            stop = true;
+        } else if (cqe.user_data & kSendTag) {
+            free_slots.push_back(static_cast<uint32_t>(cqe.user_data & (kSendTag - 1)));
+            if (cqe.res < 0) {
+                if (send_error_log.allow(std::chrono::steady_clock::now(), suppressed)) {
+                    logger->error("io_uring sendmsg error: {}{}", strerror(-cqe.res), suppressedNote(suppressed));
+                }
+                bumpCounter(metrics.tx_errors);
+            } else {
+                bumpCounter(metrics.tx_packets);
+            }
+        } else if (cqe.user_data == kRecvTag) {
+            if (!(cqe.flags & IORING_CQE_F_MORE)) recv_armed = false;
+            if (cqe.res < 0) {
+                // ENOBUFS: все буферы заняты, приём перезапускается после их возврата
+                if (cqe.res == -ENOBUFS) return;
+                if (!received_any && (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)) {
+                    unsupported = true;
+                    error = std::string("multishot recvmsg: ") + strerror(-cqe.res);
+                    return;
+                }
+                logger->error("io_uring recvmsg error: {}", strerror(-cqe.res));
+                return;
+            }
+            if (!(cqe.flags & IORING_CQE_F_BUFFER)) return;
+            received_any = true;
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            const char* buf = buffers.buffer(bid);
+            const io_uring_recvmsg_out* out = reinterpret_cast<const io_uring_recvmsg_out*>(buf);
+            const char* name = buf + sizeof(io_uring_recvmsg_out);
+            const char* control = name + recv_msg.msg_namelen;
+            const char* payload = control + recv_msg.msg_controllen;
+            if (pending == 0) rx_time = std::chrono::steady_clock::now();
+            msghdr control_msg{};
+            control_msg.msg_control = const_cast<char*>(control);
+            control_msg.msg_controllen = out->controllen;
+            datagrams[pending] = Datagram{reinterpret_cast<const uint8_t*>(payload), out->payloadlen,
+                                          (out->flags & MSG_TRUNC) != 0,
+                                          reinterpret_cast<const sockaddr_in*>(name), rxTimestampNs(control_msg)};
+            bids[pending] = bid;
+            bumpCounter(metrics.rx_packets);
+            if (++pending == batch_size) flush();
+        }
+    };
+
+    while (!stop && !options.stop->load(std::memory_order_relaxed)) {
+        if (!recv_armed && !unsupported) recv_armed = arm_recv();
+        // Один вызов отправляет ответы предыдущего пакета и ждёт следующих датаграмм
+        int ret = submit(1);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            logger->error("io_uring_enter error: {}", strerror(errno));
+            break;
+        }
+        bumpCounter(metrics.rx_syscalls);
+        ring.forEachCqe(on_cqe);
+        if (pending > 0) flush();
+        if (unsupported) break;
+    }
+
+    // Отмена приёма и ожидание незавершённых операций: после выхода
+    // ядро не должно писать в буферы и слоты, которые сейчас освободятся
+    if (recv_armed) {
+        io_uring_sqe* sqe = ring.nextSqe();
+        if (!sqe) {
+            ring.submit(0);
+            sqe = ring.nextSqe();
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = kRecvTag;
+        sqe->user_data = kCancelTag;
+    }
+    for (int i = 0; i < 1000 && (recv_armed || free_slots.size() < kSendSlots); ++i) {
+        if (ring.submit(1) < 0 && errno != EINTR) break;
+        ring.forEachCqe([&](const io_uring_cqe& cqe) {
+            if (cqe.user_data == kRecvTag && cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                buffers.recycle(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            if (cqe.user_data == kRecvTag && !(cqe.flags & IORING_CQE_F_MORE)) recv_armed = false;
+            if (cqe.user_data & kSendTag) {
+                free_slots.push_back(static_cast<uint32_t>(cqe.user_data & (kSendTag - 1)));
+            }
+        });
+    }
+    return !unsupported;
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include "../src/server/blacklist.h"
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+
+// Ключи в формате упакованного IMSI: младший полубайт — заполнитель 0xF
+static uint64_t makeKey(uint64_t n) {
+    return (n << 4) | 0x0F;
+}
+
+TEST(BlacklistTest, ContainsWithAndWithoutBloom) {
+    std::mt19937_64 rng(7);
+    std::set<uint64_t> keys;
+    while (keys.size() < 100000) keys.insert(makeKey(rng() >> 8));
+    std::vector<uint64_t> list(keys.begin(), keys.end());
+    list.push_back(list.front());   // дубликат
+
+    for (bool bloom : {false, true}) {
+        Blacklist bl(list, bloom);
+        EXPECT_EQ(bl.size(), keys.size());
+        EXPECT_EQ(bl.hasBloom(), bloom);
+        for (uint64_t key : keys) ASSERT_TRUE(bl.contains(Imsi{key}));
+        size_t absent = 0, found = 0;
+        while (absent < 100000) {
+            uint64_t key = makeKey(rng() >> 8);
+            if (keys.count(key)) continue;
+            ++absent;
+            if (bl.contains(Imsi{key})) ++found;
+        }
+        EXPECT_EQ(found, 0u);
+    }
+    EXPECT_FALSE(Blacklist({}, true).contains(Imsi{makeKey(1)}));
+}
+
+TEST(BlacklistTest, LoadFileSkipsCommentsAndInvalidLines) {
+    const std::string path = "test_blacklist.txt";
+    {
+        std::ofstream out(path);
+        out << "# deny list\n"
+            << "001010123456789\n"
+            << "\n"
+            << "  001010000000001 \r\n"
+            << "12345\n"
+            << "00101000000000x\n";
+    }
+    std::vector<uint64_t> keys = loadBlacklistFile(path);
+    std::remove(path.c_str());
+    ASSERT_EQ(keys.size(), 2u);
+    Imsi imsi;
+    ASSERT_EQ(parseImsi("001010000000001", 15, imsi), ImsiError::Ok);
+    EXPECT_EQ(keys[1], imsi.packed);
+    EXPECT_THROW(loadBlacklistFile("no_such_blacklist.txt"), std::runtime_error);
+}
+
+TEST(BlacklistTest, HolderSwapsListAndBumpsVersion) {
+    BlacklistHolder holder(std::make_shared<const Blacklist>(std::vector<uint64_t>{makeKey(1)}, true));
+    auto old = holder.current();
+    uint64_t version = holder.version();
+    holder.replace(std::make_shared<const Blacklist>(std::vector<uint64_t>{makeKey(2)}, true));
+    EXPECT_NE(holder.version(), version);
+    // Старый список остаётся валидным у тех, кто ещё держит указатель
+    EXPECT_TRUE(old->contains(Imsi{makeKey(1)}));
+    EXPECT_FALSE(holder.current()->contains(Imsi{makeKey(1)}));
+    EXPECT_TRUE(holder.current()->contains(Imsi{makeKey(2)}));
+}
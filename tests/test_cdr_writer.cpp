@@ -0,0 +1,303 @@
+#include <gtest/gtest.h>
+#include "../src/server/cdr_writer.h"
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+static Imsi imsiOf(const char* digits) {
+    Imsi imsi;
+    parseImsi(digits, 15, imsi);
+    return imsi;
+}
+
+static std::vector<std::string> readLines(const std::string& path) {
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);) lines.push_back(line);
+    return lines;
+}
+
+TEST(CdrFormatterTest, FormatsCsvLine) {
+    CdrFormatter formatter;
+    std::time_t ts = std::time(nullptr);
+    char expected_ts[32];
+    std::tm tm{};
+    localtime_r(&ts, &tm);
+    std::strftime(expected_ts, sizeof(expected_ts), "%Y-%m-%d %H:%M:%S", &tm);
+
+    char line[CdrFormatter::kMaxLine];
+    CdrRecord record{imsiOf("001010123456789").packed, ts, CdrEvent::Create};
+    size_t len = formatter.format(record, line);
+    EXPECT_EQ(std::string(line, len), std::string(expected_ts) + ",001010123456789,create\n");
+
+    // повторная запись в ту же секунду использует кэш строки времени
+    record.event = CdrEvent::Shutdown;
+    len = formatter.format(record, line);
+    EXPECT_EQ(std::string(line, len), std::string(expected_ts) + ",001010123456789,shutdown\n");
+}
+
+TEST(CdrFormatterTest, FormatsRenewCounters) {
+    CdrFormatter formatter;
+    std::time_t ts = std::time(nullptr);
+    auto text = [](std::time_t t) {
+        char buf[32];
+        std::tm tm{};
+        localtime_r(&t, &tm);
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        return std::string(buf);
+    };
+    char line[CdrFormatter::kMaxLine];
+    CdrRecord record{imsiOf("001010123456789").packed, ts, CdrEvent::Delete, 4294967295u, ts - 30};
+    size_t len = formatter.format(record, line);
+    EXPECT_EQ(std::string(line, len),
+              text(ts) + ",001010123456789,delete,4294967295," + text(ts - 30) + "\n");
+    record.renews = 0;
+    record.event = CdrEvent::Renew;
+    record.last_seen = ts;
+    len = formatter.format(record, line);
+    EXPECT_EQ(std::string(line, len), text(ts) + ",001010123456789,renew,0," + text(ts) + "\n");
+}
+
+TEST(CdrWriterTest, WritesAllRecordsFromManyProducers) {
+    const std::string path = "test_cdr_writer.log";
+    std::remove(path.c_str());
+    {
+        CdrWriterOptions options;
+        options.path = path;
+        options.ring_size = 64;  // маленькое кольцо: производители упираются в Block
+        CdrWriter writer(options);
+        writer.start();
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t) {
+            producers.emplace_back([&] {
+                for (int i = 0; i < 1000; ++i)
+                    writer.push(imsiOf("123456789012345"), CdrEvent::Renew, std::time(nullptr));
+            });
+        }
+        for (auto& p : producers) p.join();
+        writer.stop();
+        EXPECT_EQ(writer.written(), 4000u);
+        EXPECT_EQ(writer.dropped(), 0u);
+    }
+    auto lines = readLines(path);
+    ASSERT_EQ(lines.size(), 4000u);
+    EXPECT_NE(lines[0].find(",123456789012345,renew"), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(CdrWriterTest, DropPolicyCountsDroppedRecords) {
+    const std::string path = "test_cdr_drop.log";
+    std::remove(path.c_str());
+    CdrWriterOptions options;
+    options.path = path;
+    options.ring_size = 4;
+    options.overflow = CdrOverflowPolicy::Drop;
+    CdrWriter writer(options);
+    // поток записи не запущен: кольцо заполняется, остальное отбрасывается
+    for (int i = 0; i < 10; ++i) writer.push(imsiOf("123456789012345"), CdrEvent::Create, 0);
+    EXPECT_EQ(writer.dropped(), 6u);
+    writer.start();
+    writer.stop();
+    EXPECT_EQ(writer.written(), 4u);
+    EXPECT_EQ(readLines(path).size(), 4u);
+    std::remove(path.c_str());
+}
+
+TEST(CdrWriterTest, PushBatchKeepsOrder) {
+    const std::string path = "test_cdr_batch.log";
+    std::remove(path.c_str());
+    std::vector<CdrRecord> records;
+    for (int i = 0; i < 1000; ++i) {
+        char digits[16];
+        std::snprintf(digits, sizeof(digits), "00101%010d", i);
+        records.push_back(CdrRecord{imsiOf(digits).packed, std::time(nullptr), CdrEvent::Shutdown});
+    }
+    {
+        CdrWriterOptions options;
+        options.path = path;
+        options.ring_size = 64;  // пачка больше кольца: части ждут места (Block)
+        CdrWriter writer(options);
+        writer.start();
+        EXPECT_EQ(writer.pushBatch(records.data(), records.size()), 1000u);
+        writer.stop();
+        EXPECT_EQ(writer.written(), 1000u);
+    }
+    auto lines = readLines(path);
+    ASSERT_EQ(lines.size(), 1000u);
+    EXPECT_NE(lines[0].find(",001010000000000,shutdown"), std::string::npos);
+    EXPECT_NE(lines[999].find(",001010000000999,shutdown"), std::string::npos);
+    std::remove(path.c_str());
+
+    CdrWriterOptions options;
+    options.path = path;
+    options.ring_size = 8;
+    options.overflow = CdrOverflowPolicy::Drop;
+    CdrWriter writer(options);
+    // поток записи не запущен: половина кольца пачкой, остаток по одной
+    EXPECT_EQ(writer.pushBatch(records.data(), 3), 3u);
+    EXPECT_EQ(writer.pushBatch(records.data() + 3, 10), 5u);
+    EXPECT_EQ(writer.dropped(), 5u);
+    writer.start();
+    writer.stop();
+    EXPECT_EQ(writer.written(), 8u);
+    std::remove(path.c_str());
+}
+
+TEST(CdrWriterTest, BlockWaitIsBounded) {
+    const std::string path = "test_cdr_block.log";
+    std::remove(path.c_str());
+    CdrWriterOptions options;
+    options.path = path;
+    options.ring_size = 4;
+    options.block_timeout_ms = 50;
+    CdrWriter writer(options);
+    // поток записи не запущен: место не освободится
+    for (int i = 0; i < 4; ++i) EXPECT_TRUE(writer.push(imsiOf("123456789012345"), CdrEvent::Create, 0));
+    auto started = std::chrono::steady_clock::now();
+    EXPECT_FALSE(writer.push(imsiOf("123456789012345"), CdrEvent::Create, 0));
+    EXPECT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(50));
+    // до освобождения места — без ожидания
+    started = std::chrono::steady_clock::now();
+    EXPECT_FALSE(writer.push(imsiOf("123456789012345"), CdrEvent::Create, 0));
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(50));
+    EXPECT_EQ(writer.blockTimeouts(), 2u);
+    EXPECT_EQ(writer.dropped(), 2u);
+
+    // Поток записи освобождает место и будит ждущих производителей
+    writer.start();
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&] {
+            for (int i = 0; i < 500; ++i) writer.push(imsiOf("123456789012345"), CdrEvent::Renew, 0);
+        });
+    }
+    for (auto& p : producers) p.join();
+    writer.stop();
+    EXPECT_EQ(writer.written() + writer.dropped(), 2006u);
+    EXPECT_EQ(writer.dropped(), writer.blockTimeouts());
+    std::remove(path.c_str());
+}
+
+TEST(CdrWriterTest, ParsePolicies) {
+    EXPECT_EQ(parseCdrFsyncPolicy("interval"), CdrFsyncPolicy::Interval);
+    EXPECT_EQ(parseCdrOverflowPolicy("drop"), CdrOverflowPolicy::Drop);
+    EXPECT_THROW(parseCdrFsyncPolicy("sometimes"), std::invalid_argument);
+    EXPECT_THROW(CdrWriter(CdrWriterOptions{"/nonexistent/dir/cdr.log"}), std::runtime_error);
+}
+
+TEST(CdrWriterTest, BinarySegmentsRotateBySize) {
+    const std::string base = "test_cdr_binary";
+    CdrWriterOptions options;
+    options.path = base;
+    options.format = CdrOutputFormat::Binary;
+    options.segment_bytes = 100 * sizeof(CdrBinaryRecord);
+    options.segment_sec = 0;
+    Imsi imsi = imsiOf("001010123456789");
+    {
+        CdrWriter writer(options);
+        writer.start();
+        for (int i = 0; i < 250; ++i) writer.push(imsi, i % 2 ? CdrEvent::Renew : CdrEvent::Create, 1000 + i);
+        writer.stop();
+        EXPECT_EQ(writer.segments(), 3u);
+    }
+
+    // Сегменты называются <base>.<время>-<n>.cdrb; читаем их по порядку номеров
+    std::vector<std::string> paths;
+    FILE* ls = popen(("ls " + base + ".*.cdrb").c_str(), "r");
+    ASSERT_NE(ls, nullptr);
+    char name[256];
+    while (fgets(name, sizeof(name), ls)) {
+        std::string path(name);
+        path.pop_back();
+        paths.push_back(path);
+    }
+    pclose(ls);
+    ASSERT_EQ(paths.size(), 3u);
+    std::sort(paths.begin(), paths.end(), [](const std::string& a, const std::string& b) {
+        return std::stoi(a.substr(a.rfind('-') + 1)) < std::stoi(b.substr(b.rfind('-') + 1));
+    });
+
+    size_t total = 0;
+    for (const auto& path : paths) {
+        CdrSegmentReader reader;
+        std::string error;
+        ASSERT_TRUE(reader.open(path, error)) << error;
+        EXPECT_EQ(reader.header().version, kCdrSegmentVersion);
+        for (size_t i = 0; i < reader.size(); ++i, ++total) {
+            CdrRecord record = reader.record(i);
+            EXPECT_EQ(record.imsi, imsi.packed);
+            EXPECT_EQ(record.timestamp, static_cast<int64_t>(1000 + total));
+            EXPECT_EQ(record.event, total % 2 ? CdrEvent::Renew : CdrEvent::Create);
+        }
+        std::remove(path.c_str());
+    }
+    EXPECT_EQ(total, 250u);
+}
+
+TEST(CdrSegmentReaderTest, ReadsCountersAndVersion1) {
+    const std::string base = "test_cdr_counters";
+    CdrWriterOptions options;
+    options.path = base;
+    options.format = CdrOutputFormat::Binary;
+    Imsi imsi = imsiOf("001010123456789");
+    {
+        CdrWriter writer(options);
+        writer.start();
+        writer.push(imsi, CdrEvent::Delete, 2000, 17, 1990);
+        writer.stop();
+    }
+    FILE* ls = popen(("ls " + base + ".*.cdrb").c_str(), "r");
+    ASSERT_NE(ls, nullptr);
+    char name[256];
+    ASSERT_NE(fgets(name, sizeof(name), ls), nullptr);
+    pclose(ls);
+    std::string path(name);
+    path.pop_back();
+    {
+        CdrSegmentReader reader;
+        std::string error;
+        ASSERT_TRUE(reader.open(path, error)) << error;
+        ASSERT_EQ(reader.size(), 1u);
+        CdrRecord record = reader.record(0);
+        EXPECT_EQ(record.event, CdrEvent::Delete);
+        EXPECT_EQ(record.renews, 17u);
+        EXPECT_EQ(record.last_seen, 1990);
+    }
+    std::remove(path.c_str());
+
+    // Сегмент версии 1: записи по 16 байт без счётчиков
+    const std::string v1 = "test_cdr_v1.cdrb";
+    CdrSegmentHeader header = makeCdrSegmentHeader(1000);
+    header.version = 1;
+    header.record_size = kCdrBinaryRecordV1Size;
+    CdrBinaryRecord bin = toBinaryRecord(CdrRecord{imsi.packed, 1500, CdrEvent::Renew});
+    {
+        std::ofstream out(v1, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(&bin), kCdrBinaryRecordV1Size);
+        out.write(reinterpret_cast<const char*>(&bin), kCdrBinaryRecordV1Size);
+    }
+    CdrSegmentReader reader;
+    std::string error;
+    ASSERT_TRUE(reader.open(v1, error)) << error;
+    ASSERT_EQ(reader.size(), 2u);
+    CdrRecord record = reader.record(1);
+    EXPECT_EQ(record.imsi, imsi.packed);
+    EXPECT_EQ(record.timestamp, 1500);
+    EXPECT_EQ(record.event, CdrEvent::Renew);
+    EXPECT_EQ(record.renews, 0u);
+    EXPECT_EQ(record.last_seen, 0);
+    reader.close();
+    std::remove(v1.c_str());
+}
+
+TEST(CdrSegmentReaderTest, RejectsForeignFile) {
+    const std::string path = "test_not_a_segment.cdrb";
+    std::ofstream(path) << "this is definitely not a CDR segment";
+    CdrSegmentReader reader;
+    std::string error;
+    EXPECT_FALSE(reader.open(path, error));
+    EXPECT_FALSE(error.empty());
+    std::remove(path.c_str());
+}
@@ -7,6 +7,10 @@
 #include <unistd.h>
 #include <fstream>
 #include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <map>
+#include "../src/common/protocol.h"
 
 // Тест отправки и приёма
 TEST(ClientIntegration, SuccessfulRequest) {
@@ -53,3 +57,153 @@ TEST(ClientIntegration, SuccessfulRequest) {
     std::remove("cli.log");
     std::remove("out.txt");
 }
+
+// Заглушка сервера для пакетного режима: ответ зависит от чётности последней
+// цифры IMSI (последний байт BCD — заполнитель 0xF и цифра в старшей тетраде), первые drop_first
+// датаграмм остаются без ответа. Понимает и пакетный формат (protocol.h).
+static void runStubServer(int sock, int drop_first, std::atomic<bool>& stop) {
+    timeval tv{0, 100000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int received = 0;
+    while (!stop) {
+        uint8_t buf[kMaxBatchRequest];
+        sockaddr_in cli{};
+        socklen_t len = sizeof(cli);
+        ssize_t n = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr*)&cli, &len);
+        if (n <= 0 || ++received <= drop_first) continue;
+        BatchHeader hdr;
+        if (n != 8 && parseBatchRequest(buf, n, hdr)) {
+            uint8_t reply[kMaxBatchReply];
+            writeBatchHeader(hdr.count, hdr.seq, reply);
+            for (size_t i = 0; i < hdr.count; ++i) {
+                uint8_t last = buf[kBatchHeaderSize + i * 8 + 7];
+                reply[kBatchHeaderSize + i] =
+                    static_cast<uint8_t>((last >> 4) % 2 == 0 ? ImsiStatus::Created : ImsiStatus::Rejected);
+            }
+            sendto(sock, reply, kBatchHeaderSize + hdr.count, 0, (sockaddr*)&cli, len);
+            continue;
+        }
+        if (n != 8) continue;
+        const char* reply = (buf[7] >> 4) % 2 == 0 ? "created" : "rejected";
+        sendto(sock, reply, strlen(reply), 0, (sockaddr*)&cli, len);
+    }
+}
+
+static int bindStub(int port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in serv{};
+    serv.sin_family = AF_INET;
+    serv.sin_port   = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &serv.sin_addr);
+    bind(sock, (sockaddr*)&serv, sizeof(serv));
+    return sock;
+}
+
+static void writeClientConfig(int port) {
+    std::ofstream ofs("cfg_cli_batch.json");
+    ofs << R"({"server_ip":"127.0.0.1","server_port":)" << port
+        << R"(,"log_file":"cli_batch.log","log_level":"INFO","request_timeout_ms":200})";
+}
+
+static std::map<std::string, std::string> readResults(const char* path) {
+    std::map<std::string, std::string> results;
+    std::ifstream in(path);
+    std::string imsi, result;
+    while (in >> imsi >> result) results[imsi] = result;
+    return results;
+}
+
+// Пакетный режим: окно запросов в полёте, ответы сопоставлены своим IMSI
+TEST(ClientIntegration, BatchWindow) {
+    int sock = bindStub(31001);
+    ASSERT_GE(sock, 0);
+    std::atomic<bool> stop{false};
+    std::thread srv(runStubServer, sock, 0, std::ref(stop));
+    writeClientConfig(31001);
+
+    {
+        std::ofstream in("imsi_batch.txt");
+        in << "# comment\n\n";
+        for (int i = 0; i < 500; ++i) in << "0010100000" << 10000 + i << "\n";
+        in << "12ab\n";
+    }
+    int ret = system("./src/client/pgw_client cfg_cli_batch.json --batch imsi_batch.txt --window 32 > out_batch.txt");
+    EXPECT_EQ(WEXITSTATUS(ret), 1);  // строка "12ab" — invalid
+
+    auto results = readResults("out_batch.txt");
+    EXPECT_EQ(results.size(), 501u);
+    for (int i = 0; i < 500; ++i) {
+        std::string imsi = "0010100000" + std::to_string(10000 + i);
+        EXPECT_EQ(results[imsi], i % 2 == 0 ? "created" : "rejected") << imsi;
+    }
+    EXPECT_EQ(results["12ab"], "invalid");
+
+    stop = true;
+    srv.join();
+    close(sock);
+    std::remove("imsi_batch.txt");
+    std::remove("out_batch.txt");
+    std::remove("cfg_cli_batch.json");
+    std::remove("cli_batch.log");
+}
+
+// Потерянный запрос повторяется после таймаута; без ответа — "timeout"
+TEST(ClientIntegration, BatchRetryAndTimeout) {
+    int sock = bindStub(31002);
+    ASSERT_GE(sock, 0);
+    std::atomic<bool> stop{false};
+    std::thread srv(runStubServer, sock, 1, std::ref(stop));
+    writeClientConfig(31002);
+
+    int ret = system("printf '001010000000001\\n001010000000002\\n' | "
+                     "./src/client/pgw_client cfg_cli_batch.json --batch - --window 1 > out_batch.txt");
+    EXPECT_EQ(WEXITSTATUS(ret), 0);
+    auto results = readResults("out_batch.txt");
+    EXPECT_EQ(results["001010000000001"], "rejected");
+    EXPECT_EQ(results["001010000000002"], "created");
+
+    stop = true;
+    srv.join();
+    close(sock);
+
+    // Сервер больше не отвечает: одиночный запрос завершается по таймауту
+    ret = system("./src/client/pgw_client cfg_cli_batch.json 001010000000001 --retries 1 > out_batch.txt");
+    EXPECT_EQ(WEXITSTATUS(ret), 1);
+
+    std::remove("out_batch.txt");
+    std::remove("cfg_cli_batch.json");
+    std::remove("cli_batch.log");
+}
+
+// Пакетный протокол: до 150 IMSI в датаграмме, потерянная датаграмма
+// повторяется целиком с новым номером
+TEST(ClientIntegration, BatchProtocol) {
+    int sock = bindStub(31003);
+    ASSERT_GE(sock, 0);
+    std::atomic<bool> stop{false};
+    std::thread srv(runStubServer, sock, 1, std::ref(stop));
+    writeClientConfig(31003);
+
+    {
+        std::ofstream in("imsi_batch.txt");
+        for (int i = 0; i < 500; ++i) in << "0010100000" << 10000 + i << "\n";
+    }
+    int ret = system("./src/client/pgw_client cfg_cli_batch.json --batch imsi_batch.txt --window 2 "
+                     "--imsis-per-datagram 150 > out_batch.txt");
+    EXPECT_EQ(WEXITSTATUS(ret), 0);
+
+    auto results = readResults("out_batch.txt");
+    EXPECT_EQ(results.size(), 500u);
+    for (int i = 0; i < 500; ++i) {
+        std::string imsi = "0010100000" + std::to_string(10000 + i);
+        EXPECT_EQ(results[imsi], i % 2 == 0 ? "created" : "rejected") << imsi;
+    }
+
+    stop = true;
+    srv.join();
+    close(sock);
+    std::remove("imsi_batch.txt");
+    std::remove("out_batch.txt");
+    std::remove("cfg_cli_batch.json");
+    std::remove("cli_batch.log");
+}
@@ -0,0 +1,265 @@
+#include <gtest/gtest.h>
+#include "cluster.h"
+#include "udp_loop.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string imsiAt(uint64_t i) {
+    char digits[16];
+    std::snprintf(digits, sizeof(digits), "00101%010llu", static_cast<unsigned long long>(i));
+    return digits;
+}
+
+static uint64_t packed(const std::string& digits) {
+    Imsi imsi;
+    parseImsi(digits.data(), digits.size(), imsi);
+    return imsi.packed;
+}
+
+TEST(HashRingTest, BalancedAndConsistent) {
+    HashRing three({"a", "b", "c"});
+    std::vector<double> shares = three.shares();
+    ASSERT_EQ(shares.size(), 3u);
+    double total = 0;
+    for (double share : shares) {
+        EXPECT_GT(share, 0.2);
+        EXPECT_LT(share, 0.47);
+        total += share;
+    }
+    EXPECT_NEAR(total, 1.0, 1e-9);
+
+    // Новый участник забирает ключи только себе; точки не зависят от порядка в списке
+    HashRing four({"d", "c", "b", "a"});
+    const size_t to_index[] = {3, 2, 1};     // a, b, c в списке four
+    size_t counts[4] = {};
+    size_t moved = 0;
+    const size_t keys = 100000;
+    for (uint64_t i = 0; i < keys; ++i) {
+        uint64_t key = packed(imsiAt(i));
+        size_t before = three.ownerOf(key);
+        size_t after = four.ownerOf(key);
+        ++counts[after];
+        if (after != to_index[before]) {
+            EXPECT_EQ(after, 0u);
+            ++moved;
+        }
+    }
+    EXPECT_GT(moved, keys / 8);
+    EXPECT_LT(moved, keys * 3 / 8);
+    for (size_t count : counts) EXPECT_GT(count, keys / 8);
+}
+
+static ClusterMember memberOf(const char* id, int udp_port, int peer_port) {
+    ClusterMember m;
+    m.id = id;
+    m.udp.sin_family = AF_INET;
+    m.udp.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m.udp.sin_port = htons(udp_port);
+    m.peer = m.udp;
+    m.peer.sin_port = htons(peer_port);
+    m.http_host = "127.0.0.1";
+    return m;
+}
+
+static std::vector<ClusterMember> twoMembers() {
+    return {memberOf("a", 31101, 31111), memberOf("b", 31102, 31112)};
+}
+
+// Участник кластера в этом процессе: UDP-поток и поток связи
+class Node {
+public:
+    Node(size_t self, std::chrono::milliseconds timeout)
+        : cdr_path_("test_cluster_cdr_" + std::to_string(self) + ".log"),
+          cdr_([this] {
+              CdrWriterOptions options;
+              options.path = cdr_path_;
+              return options;
+          }()),
+          forwarder_(twoMembers(), self, timeout) {
+        cdr_.start();
+        std::string error;
+        EXPECT_TRUE(forwarder_.open(error)) << error;
+        sock_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        const sockaddr_in& addr = forwarder_.members()[self].udp;
+        EXPECT_EQ(bind(sock_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+        shutdown_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        worker_ = std::thread([this]() {
+            RequestHandler handler(sessions, cdr_, blacklist_, admission_, metrics, 0);
+            handler.setCluster(&forwarder_, sock_);
+            UdpLoopOptions options;
+            options.sock = sock_;
+            options.shutdown_fd = shutdown_fd_;
+            options.stop = &stop_;
+            runSocketLoop(options, handler, metrics);
+            forwarder_.detach(sock_);
+        });
+        peer_ = std::thread([this]() { forwarder_.run(shutdown_fd_, stop_); });
+    }
+
+    ~Node() {
+        stop_ = true;
+        uint64_t one = 1;
+        (void)!write(shutdown_fd_, &one, sizeof(one));
+        worker_.join();
+        peer_.join();
+        close(sock_);
+        close(shutdown_fd_);
+        cdr_.stop();
+        std::remove(cdr_path_.c_str());
+    }
+
+    ClusterForwarder& forwarder() { return forwarder_; }
+
+    SessionTable sessions{4, 64, std::chrono::seconds(30)};
+    WorkerMetrics metrics;
+
+private:
+    std::string cdr_path_;
+    CdrWriter cdr_;
+    BlacklistHolder blacklist_{std::make_shared<const Blacklist>()};
+    AdmissionControl admission_{OverloadOptions{}};
+    ClusterForwarder forwarder_;
+    int sock_ = -1;
+    int shutdown_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread worker_;
+    std::thread peer_;
+};
+
+// Запрос на UDP-адрес участника; "" — нет ответа за timeout_ms
+static std::string roundTrip(const sockaddr_in& to, const std::string& request, int timeout_ms = 500) {
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    sendto(client, request.data(), request.size(), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+    pollfd pfd{client, POLLIN, 0};
+    char buf[kMaxReply];
+    sockaddr_in from{};
+    socklen_t len = sizeof(from);
+    ssize_t n = poll(&pfd, 1, timeout_ms) > 0
+                    ? recvfrom(client, buf, sizeof(buf), 0, reinterpret_cast<sockaddr*>(&from), &len)
+                    : 0;
+    close(client);
+    // Ответ приходит с того адреса, на который отправлен запрос
+    if (n > 0) {
+        EXPECT_EQ(from.sin_port, to.sin_port);
+    }
+    return std::string(buf, n > 0 ? static_cast<size_t>(n) : 0);
+}
+
+static std::string bcdOf(const std::string& digits) {
+    uint8_t bcd[kImsiBcdSize];
+    encodeImsiBcd(Imsi{packed(digits)}, bcd);
+    return std::string(reinterpret_cast<const char*>(bcd), sizeof(bcd));
+}
+
+static std::string batchOf(uint32_t seq, const std::vector<std::string>& imsis) {
+    std::string out(kBatchHeaderSize, '\0');
+    writeBatchHeader(static_cast<uint8_t>(imsis.size()), seq, reinterpret_cast<uint8_t*>(&out[0]));
+    for (const std::string& imsi : imsis) out += bcdOf(imsi);
+    return out;
+}
+
+static std::string batchReplyOf(uint32_t seq, size_t count, ImsiStatus status) {
+    std::string out(kBatchHeaderSize, '\0');
+    writeBatchHeader(static_cast<uint8_t>(count), seq, reinterpret_cast<uint8_t*>(&out[0]));
+    out.append(count, static_cast<char>(status));
+    return out;
+}
+
+// IMSI вперемешку: чётные принадлежат участнику 0, нечётные — участнику 1
+static std::vector<std::string> mixedImsis(const HashRing& ring, size_t count) {
+    std::vector<std::string> out;
+    for (uint64_t i = 0; out.size() < count; ++i) {
+        std::string imsi = imsiAt(i);
+        if (ring.ownerOf(packed(imsi)) == out.size() % 2) out.push_back(imsi);
+    }
+    return out;
+}
+
+TEST(ClusterTest, ForwardsToOwnerAndRepliesTransparently) {
+    Node a(0, std::chrono::milliseconds(500));
+    Node b(1, std::chrono::milliseconds(500));
+    const sockaddr_in to_a = a.forwarder().members()[0].udp;
+    const sockaddr_in to_b = a.forwarder().members()[1].udp;
+    std::vector<std::string> imsis = mixedImsis(a.forwarder().ring(), 6);
+
+    EXPECT_EQ(roundTrip(to_a, batchOf(41, imsis)), batchReplyOf(41, 6, ImsiStatus::Created));
+    // Сессии — только у владельцев
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        EXPECT_EQ(a.sessions.contains(packed(imsis[i])), i % 2 == 0) << imsis[i];
+        EXPECT_EQ(b.sessions.contains(packed(imsis[i])), i % 2 == 1) << imsis[i];
+    }
+    // Исходный формат и запрос, пришедший на другого участника
+    EXPECT_EQ(roundTrip(to_a, bcdOf(imsis[1])), "refresh");
+    EXPECT_EQ(roundTrip(to_b, bcdOf(imsis[0])), "refresh");
+    EXPECT_EQ(roundTrip(to_b, batchOf(42, imsis)), batchReplyOf(42, 6, ImsiStatus::Refreshed));
+
+    EXPECT_EQ(a.metrics.cluster_forwarded.load(), 4u);
+    EXPECT_EQ(b.metrics.cluster_peer_imsis.load(), 4u);
+    EXPECT_EQ(b.metrics.cluster_forwarded.load(), 4u);
+    EXPECT_EQ(a.metrics.cluster_peer_imsis.load(), 4u);
+    ClusterStats stats = a.forwarder().stats();
+    EXPECT_EQ(stats.forwards, 2u);
+    EXPECT_EQ(stats.completed, 2u);
+    EXPECT_EQ(stats.timeouts, 0u);
+    EXPECT_EQ(stats.pending, 0u);
+}
+
+TEST(ClusterTest, OwnerTimeoutDropsReply) {
+    Node a(0, std::chrono::milliseconds(50));
+    const sockaddr_in to_a = a.forwarder().members()[0].udp;
+    std::vector<std::string> imsis = mixedImsis(a.forwarder().ring(), 2);
+
+    // Участник 1 не запущен: клиент не получает ответа и повторит запрос,
+    // свой IMSI при этом уже обработан, как при потере ответа
+    EXPECT_EQ(roundTrip(to_a, batchOf(7, imsis), 300), "");
+    EXPECT_EQ(roundTrip(to_a, bcdOf(imsis[0])), "refresh");
+    ClusterStats stats = a.forwarder().stats();
+    EXPECT_EQ(stats.timeouts, 1u);
+    EXPECT_EQ(stats.pending, 0u);
+    EXPECT_TRUE(a.sessions.contains(packed(imsis[0])));
+}
+
+// pgw_client с окном запросов в полёте: IMSI одного сокета уходят то
+// принявшему участнику, то другому, и ответы на них приходят не в порядке
+// отправки. Каждый результат должен достаться своему IMSI.
+TEST(ClusterTest, PipelinedClientGetsOwnReplies) {
+    Node a(0, std::chrono::milliseconds(500));
+    Node b(1, std::chrono::milliseconds(500));
+    std::vector<std::string> imsis = mixedImsis(a.forwarder().ring(), 300);
+    // У каждого третьего IMSI сессия уже есть у владельца: ответ "refresh", у остальных — "created"
+    for (size_t i = 0; i < imsis.size(); i += 3) {
+        (i % 2 == 0 ? a : b).sessions.touch(packed(imsis[i]), SessionTable::Clock::now());
+    }
+    {
+        std::ofstream in("imsi_cluster.txt");
+        for (const std::string& imsi : imsis) in << imsi << "\n";
+        std::ofstream cfg("cfg_cli_cluster.json");
+        cfg << R"({"server_ip":"127.0.0.1","server_port":31101,"log_file":"cli_cluster.log","log_level":"INFO"})";
+    }
+    int ret = system("./src/client/pgw_client cfg_cli_cluster.json --batch imsi_cluster.txt --window 64 "
+                     "> out_cluster.txt");
+    EXPECT_EQ(WEXITSTATUS(ret), 0);
+
+    std::map<std::string, std::string> results;
+    std::ifstream out("out_cluster.txt");
+    std::string imsi, result;
+    while (out >> imsi >> result) results[imsi] = result;
+    EXPECT_EQ(results.size(), imsis.size());
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        EXPECT_EQ(results[imsis[i]], i % 3 == 0 ? "refresh" : "created") << imsis[i];
+    }
+    EXPECT_GT(a.forwarder().stats().completed, 0u);
+
+    std::remove("imsi_cluster.txt");
+    std::remove("cfg_cli_cluster.json");
+    std::remove("cli_cluster.log");
+    std::remove("out_cluster.txt");
+}
@@ -37,6 +37,257 @@ TEST(ConfigTest, LoadServerConfigValid) {
     EXPECT_EQ(cfg.blacklist.size(), 2u);
     EXPECT_EQ(cfg.blacklist[0], "111");
     EXPECT_EQ(cfg.blacklist[1], "222");
+    EXPECT_EQ(cfg.udp_workers, 1);
+    EXPECT_TRUE(cfg.udp_cpus.empty());
+    EXPECT_EQ(cfg.udp_batch_size, 32);
+    EXPECT_EQ(cfg.cdr_renew_window_sec, 0);
+    EXPECT_EQ(cfg.cdr_block_timeout_ms, 1000);
+    EXPECT_FALSE(cfg.snapshot_keep_sessions);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigSnapshotKeepSessions) {
+    const std::string fname = "test_server_snapshot.json";
+    const std::string base = R"(
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[])";
+    // Снимок сам по себе не отменяет удаление сессий при остановке
+    writeFile(fname, "{" + base + R"(, "snapshot_file":"s.snap"})");
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.snapshot_file, "s.snap");
+    EXPECT_FALSE(cfg.snapshot_keep_sessions);
+
+    writeFile(fname, "{" + base + R"(, "snapshot_file":"s.snap", "snapshot_keep_sessions":true})");
+    EXPECT_TRUE(loadServerConfig(fname).snapshot_keep_sessions);
+
+    // Сохранять сессии некуда
+    writeFile(fname, "{" + base + R"(, "snapshot_keep_sessions":true})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigZeroShutdownRate) {
+    const std::string fname = "test_server_shutdown_rate.json";
+    writeFile(fname, R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":0,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[]
+    })");
+    // Сессии никогда бы не удалились, и сервер не завершился бы
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigUdpWorkers) {
+    const std::string fname = "test_server_workers.json";
+    writeFile(fname, R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[],
+        "udp_workers":4,
+        "udp_cpus":[2,3],
+        "udp_batch_size":64
+    })");
+
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.udp_workers, 4);
+    ASSERT_EQ(cfg.udp_cpus.size(), 2u);
+    EXPECT_EQ(cfg.udp_cpus[0], 2);
+    EXPECT_EQ(cfg.udp_cpus[1], 3);
+    EXPECT_EQ(cfg.udp_batch_size, 64);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigLogging) {
+    const std::string fname = "test_server_logging.json";
+    const std::string base = R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[])";
+    writeFile(fname, base + "}");
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.log_mode, "sync");
+    EXPECT_EQ(cfg.log_event_rate, 0);
+
+    writeFile(fname, base + R"(, "log_mode":"async", "log_queue_size":1024, "log_overflow":"overrun_oldest",
+        "log_flush_interval_sec":2, "log_event_rate":50})");
+    cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.log_mode, "async");
+    EXPECT_EQ(cfg.log_queue_size, 1024);
+    EXPECT_EQ(cfg.log_overflow, "overrun_oldest");
+    EXPECT_EQ(cfg.log_flush_interval_sec, 2);
+    EXPECT_EQ(cfg.log_event_rate, 50);
+
+    writeFile(fname, base + R"(, "log_mode":"fast"})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "log_overflow":"drop"})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigOverload) {
+    const std::string fname = "test_server_overload.json";
+    const std::string base = R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[])";
+    writeFile(fname, base + "}");
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.max_sessions, 0);
+    EXPECT_EQ(cfg.new_session_rate, 0);
+    EXPECT_EQ(cfg.overload_queue_delay_ms, 0);
+
+    writeFile(fname, base + R"(, "max_sessions":5000000, "new_session_rate":20000, "new_session_burst":5000,
+        "overload_queue_delay_ms":20})");
+    cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.max_sessions, 5000000);
+    EXPECT_EQ(cfg.new_session_rate, 20000);
+    EXPECT_EQ(cfg.new_session_burst, 5000);
+    EXPECT_EQ(cfg.overload_queue_delay_ms, 20);
+
+    writeFile(fname, base + R"(, "new_session_rate":-1})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigCdrSegments) {
+    const std::string fname = "test_server_cdr_segments.json";
+    const std::string base = R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[],
+        "cdr_format":"binary")";
+    writeFile(fname, base + R"(, "cdr_segment_bytes":0, "cdr_segment_sec":0})");
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.cdr_segment_bytes, 0);
+    EXPECT_EQ(cfg.cdr_segment_sec, 0);
+
+    // Заголовок сегмента и одна запись — 48 байт
+    writeFile(fname, base + R"(, "cdr_segment_bytes":48})");
+    EXPECT_EQ(loadServerConfig(fname).cdr_segment_bytes, 48);
+
+    writeFile(fname, base + R"(, "cdr_segment_bytes":-1})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "cdr_segment_bytes":47})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "cdr_segment_sec":-1})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigCluster) {
+    const std::string fname = "test_server_cluster.json";
+    const std::string base = R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[])";
+    writeFile(fname, base + "}");
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_TRUE(cfg.cluster_members.empty());
+    EXPECT_EQ(cfg.cluster_peer_timeout_ms, 200);
+
+    const std::string members = R"("cluster_members":[
+        {"id":"a", "udp":"127.0.0.1:9000", "peer":"127.0.0.1:9100", "http":"127.0.0.1:8080"},
+        {"id":"b", "udp":"127.0.0.1:9001", "peer":"127.0.0.1:9101", "http":"127.0.0.1:8081"}])";
+    writeFile(fname, base + R"(, "cluster_self":"b", "cluster_peer_timeout_ms":50, )" + members + "}");
+    cfg = loadServerConfig(fname);
+    EXPECT_EQ(cfg.cluster_self, "b");
+    EXPECT_EQ(cfg.cluster_peer_timeout_ms, 50);
+    ASSERT_EQ(cfg.cluster_members.size(), 2u);
+    EXPECT_EQ(cfg.cluster_members[1].peer, "127.0.0.1:9101");
+
+    writeFile(fname, base + R"(, "cluster_self":"c", )" + members + "}");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "cluster_self":"a", "cluster_members":[
+        {"id":"a", "udp":"127.0.0.1:9000", "peer":"127.0.0.1", "http":"127.0.0.1:8080"}]})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "cluster_self":"a", "cluster_members":[
+        {"id":"a", "udp":"127.0.0.1:9000", "peer":"127.0.0.1:9100", "http":"127.0.0.1:8080"},
+        {"id":"a", "udp":"127.0.0.1:9001", "peer":"127.0.0.1:9101", "http":"127.0.0.1:8081"}]})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadServerConfigBusyPoll) {
+    const std::string fname = "test_server_busy_poll.json";
+    const std::string base = R"({
+        "udp_ip":"0.0.0.0",
+        "udp_port":9000,
+        "session_timeout_sec":30,
+        "cdr_file":"cdr.log",
+        "http_port":8080,
+        "graceful_shutdown_rate":10,
+        "log_file":"pgw.log",
+        "log_level":"INFO",
+        "blacklist":[])";
+    writeFile(fname, base + "}");
+    ServerConfig cfg = loadServerConfig(fname);
+    EXPECT_FALSE(cfg.udp_busy_poll);
+    EXPECT_EQ(cfg.udp_busy_poll_usec, 50);
+    EXPECT_TRUE(cfg.housekeeping_cpus.empty());
+
+    writeFile(fname, base + R"(, "udp_workers":2, "udp_cpus":[2,3], "udp_busy_poll":true,
+        "udp_busy_poll_usec":0, "housekeeping_cpus":[0,1]})");
+    cfg = loadServerConfig(fname);
+    EXPECT_TRUE(cfg.udp_busy_poll);
+    EXPECT_EQ(cfg.udp_busy_poll_usec, 0);
+    ASSERT_EQ(cfg.housekeeping_cpus.size(), 2u);
+    EXPECT_EQ(cfg.housekeeping_cpus[1], 1);
+
+    // Ядро на каждый поток, без повторов
+    writeFile(fname, base + R"(, "udp_workers":2, "udp_cpus":[2], "udp_busy_poll":true})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "udp_workers":2, "udp_cpus":[2,2], "udp_busy_poll":true})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "udp_cpus":[2], "udp_busy_poll":true, "udp_backend":"io_uring"})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "udp_cpus":[2], "housekeeping_cpus":[1,2]})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
+    writeFile(fname, base + R"(, "udp_busy_poll_usec":-1})");
+    EXPECT_THROW(loadServerConfig(fname), std::runtime_error);
     std::remove(fname.c_str());
 }
 
@@ -58,6 +309,48 @@ TEST(ConfigTest, LoadClientConfigValid) {
     EXPECT_EQ(cfg.server_port, 4321);
     EXPECT_EQ(cfg.log_file, "client.log");
     EXPECT_EQ(cfg.log_level, "INFO");
+    EXPECT_EQ(cfg.request_timeout_ms, 1000);
+    EXPECT_EQ(cfg.request_retries, 2);
+    EXPECT_EQ(cfg.batch_window, 64);
+    EXPECT_EQ(cfg.imsis_per_datagram, 1);
+    std::remove(fname.c_str());
+}
+
+TEST(ConfigTest, LoadClientConfigBatch) {
+    const std::string fname = "test_client_batch.json";
+    writeFile(fname, R"({
+        "server_ip":"127.0.0.1",
+        "server_port":9000,
+        "log_file":"client.log",
+        "log_level":"INFO",
+        "request_timeout_ms":250,
+        "request_retries":0,
+        "batch_window":512,
+        "imsis_per_datagram":150
+    })");
+    ClientConfig cfg = loadClientConfig(fname);
+    EXPECT_EQ(cfg.request_timeout_ms, 250);
+    EXPECT_EQ(cfg.request_retries, 0);
+    EXPECT_EQ(cfg.batch_window, 512);
+    EXPECT_EQ(cfg.imsis_per_datagram, 150);
+
+    writeFile(fname, R"({
+        "server_ip":"127.0.0.1",
+        "server_port":9000,
+        "log_file":"client.log",
+        "log_level":"INFO",
+        "batch_window":0
+    })");
+    EXPECT_THROW(loadClientConfig(fname), std::runtime_error);
+
+    writeFile(fname, R"({
+        "server_ip":"127.0.0.1",
+        "server_port":9000,
+        "log_file":"client.log",
+        "log_level":"INFO",
+        "imsis_per_datagram":151
+    })");
+    EXPECT_THROW(loadClientConfig(fname), std::runtime_error);
     std::remove(fname.c_str());
 }
 
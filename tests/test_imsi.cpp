@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include "../src/common/imsi.h"
+#include <cstring>
+
+TEST(ImsiTest, ParseAndFormatRoundTrip) {
+    const char* digits = "001010123456789";
+    Imsi imsi;
+    ASSERT_EQ(parseImsi(digits, 15, imsi), ImsiError::Ok);
+    EXPECT_EQ(imsi.packed, 0x001010123456789FULL);
+    char out[15];
+    formatImsi(imsi, out);
+    EXPECT_EQ(std::string(out, 15), digits);
+    EXPECT_EQ(imsiToString(imsi), digits);
+}
+
+TEST(ImsiTest, ParseErrors) {
+    Imsi imsi;
+    EXPECT_EQ(parseImsi("12345", 5, imsi), ImsiError::InvalidLength);
+    EXPECT_EQ(parseImsi("12345678901234a", 15, imsi), ImsiError::InvalidDigit);
+    EXPECT_EQ(parseImsi("/23456789012345", 15, imsi), ImsiError::InvalidDigit);
+    EXPECT_EQ(parseImsi("1234567890123:5", 15, imsi), ImsiError::InvalidDigit);
+}
+
+TEST(ImsiTest, DecodeEncodeBcd) {
+    const uint8_t bcd[8] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x12, 0x34, 0x5F};
+    Imsi imsi;
+    ASSERT_EQ(decodeImsiBcd(bcd, sizeof(bcd), imsi), ImsiError::Ok);
+    EXPECT_EQ(imsiToString(imsi), "123456789012345");
+    uint8_t out[8];
+    encodeImsiBcd(imsi, out);
+    EXPECT_EQ(std::memcmp(out, bcd, 8), 0);
+}
+
+TEST(ImsiTest, DecodeNormalizesFiller) {
+    const uint8_t with_filler[8] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x12, 0x34, 0x5F};
+    const uint8_t without_filler[8] = {0x12, 0x34, 0x56, 0x78, 0x90, 0x12, 0x34, 0x50};
+    Imsi a, b;
+    ASSERT_EQ(decodeImsiBcd(with_filler, 8, a), ImsiError::Ok);
+    ASSERT_EQ(decodeImsiBcd(without_filler, 8, b), ImsiError::Ok);
+    EXPECT_EQ(a, b);
+}
+
+TEST(ImsiTest, DecodeRejectsEveryInvalidNibble) {
+    for (int byte = 0; byte < 8; ++byte) {
+        for (int high = 0; high < 2; ++high) {
+            if (byte == 7 && !high) continue;  // заполнитель не проверяется
+            uint8_t bcd[8] = {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F};
+            for (uint8_t nibble = 0xA; nibble <= 0xF; ++nibble) {
+                bcd[byte] = high ? static_cast<uint8_t>((nibble << 4) | (bcd[byte] & 0x0F))
+                                 : static_cast<uint8_t>((bcd[byte] & 0xF0) | nibble);
+                Imsi imsi;
+                EXPECT_EQ(decodeImsiBcd(bcd, 8, imsi), ImsiError::InvalidDigit)
+                    << "byte " << byte << " high " << high << " nibble " << int(nibble);
+            }
+        }
+    }
+}
+
+TEST(ImsiTest, DecodeInvalidLength) {
+    const uint8_t bcd[4] = {0x12, 0x34, 0x56, 0x78};
+    Imsi imsi;
+    EXPECT_EQ(decodeImsiBcd(bcd, sizeof(bcd), imsi), ImsiError::InvalidLength);
+}
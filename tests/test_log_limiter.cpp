@@ -0,0 +1,29 @@
+#include <gtest/gtest.h>
+#include "log_limiter.h"
+
+using Clock = LogRateLimiter::Clock;
+
+TEST(LogRateLimiterTest, UnlimitedByDefault) {
+    LogRateLimiter limiter;
+    uint64_t suppressed = 1;
+    Clock::time_point now = Clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(limiter.allow(now, suppressed));
+        EXPECT_EQ(suppressed, 0u);
+    }
+}
+
+TEST(LogRateLimiterTest, LimitsPerSecondAndReportsSuppressed) {
+    LogRateLimiter limiter(3);
+    uint64_t suppressed = 0;
+    Clock::time_point t0 = Clock::time_point(std::chrono::seconds(100));
+    int allowed = 0;
+    for (int i = 0; i < 10; ++i) allowed += limiter.allow(t0 + std::chrono::milliseconds(i * 10), suppressed);
+    EXPECT_EQ(allowed, 3);
+
+    // Первое сообщение следующей секунды несёт число подавленных
+    EXPECT_TRUE(limiter.allow(t0 + std::chrono::seconds(1), suppressed));
+    EXPECT_EQ(suppressed, 7u);
+    EXPECT_TRUE(limiter.allow(t0 + std::chrono::seconds(1), suppressed));
+    EXPECT_EQ(suppressed, 0u);
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include "../src/server/metrics.h"
+
+TEST(LatencyHistogramTest, BucketsAreContiguousWithBoundedError) {
+    uint64_t prev_upper = 0;
+    for (size_t b = 1; b < LatencyHistogram::kBuckets; ++b) {
+        uint64_t upper = LatencyHistogram::bucketUpper(b);
+        ASSERT_GT(upper, prev_upper);
+        EXPECT_EQ(LatencyHistogram::bucketOf(prev_upper + 1), b);
+        EXPECT_EQ(LatencyHistogram::bucketOf(upper), b);
+        // ширина корзины не больше 1/16 её нижней границы
+        if (b >= 2 * LatencyHistogram::kSubBuckets) {
+            EXPECT_LE(upper - prev_upper, (prev_upper + 1) / 16);
+        }
+        prev_upper = upper;
+    }
+    EXPECT_EQ(prev_upper, LatencyHistogram::kMaxValue);
+    EXPECT_EQ(LatencyHistogram::bucketOf(UINT64_MAX), LatencyHistogram::kBuckets - 1);
+}
+
+TEST(LatencyHistogramTest, QuantilesAndMerge) {
+    LatencyHistogram a, b;
+    for (uint64_t v = 1; v <= 1000; ++v) a.record(v * 1000);   // 1..1000 мкс
+    b.record(5000000, 10);                                     // 10 значений по 5 мс
+    HistogramSnapshot snap;
+    a.mergeInto(snap);
+    b.mergeInto(snap);
+    EXPECT_EQ(snap.count, 1010u);
+    uint64_t p50 = snap.quantile(0.5);
+    EXPECT_GE(p50, 500000u);
+    EXPECT_LE(p50, 500000u + 500000u / 16);
+    EXPECT_GE(snap.quantile(0.999), 5000000u);
+    EXPECT_EQ(snap.countAtMost(LatencyHistogram::kMaxValue), 1010u);
+    EXPECT_EQ(snap.countAtMost(999), 0u);
+}
+
+TEST(PrometheusWriterTest, HistogramIsCumulative) {
+    LatencyHistogram h;
+    h.record(2000);        // 2 мкс
+    h.record(3000000, 2);  // 3 мс
+    HistogramSnapshot snap;
+    h.mergeInto(snap);
+    PrometheusWriter out;
+    out.histogram("test_latency_seconds", "Test", snap);
+    const std::string& text = out.text();
+    EXPECT_NE(text.find("# TYPE test_latency_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"1.024e-06\"} 0\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"2.048e-06\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"0.004194304\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_count 3\n"), std::string::npos);
+}
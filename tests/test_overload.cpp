@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include "overload.h"
+#include "request_handler.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = AdmissionControl::Clock;
+
+TEST(OverloadTest, TokenBucketBurstAndRefill) {
+    OverloadOptions options;
+    options.new_session_rate = 10;     // токен каждые 100 мс
+    options.new_session_burst = 5;
+    AdmissionControl admission(options);
+    Clock::time_point t0 = Clock::time_point(std::chrono::seconds(100));
+    int granted = 0;
+    for (int i = 0; i < 20; ++i) granted += admission.takeToken(t0);
+    EXPECT_EQ(granted, 5);
+    EXPECT_FALSE(admission.takeToken(t0 + std::chrono::milliseconds(50)));
+    EXPECT_TRUE(admission.takeToken(t0 + std::chrono::milliseconds(100)));
+    EXPECT_FALSE(admission.takeToken(t0 + std::chrono::milliseconds(100)));
+    // Простой наполняет ведро не больше чем до burst
+    granted = 0;
+    for (int i = 0; i < 20; ++i) granted += admission.takeToken(t0 + std::chrono::seconds(60));
+    EXPECT_EQ(granted, 5);
+}
+
+TEST(OverloadTest, SessionReservationIsShared) {
+    OverloadOptions options;
+    options.max_sessions = 1000;
+    AdmissionControl admission(options);
+    admission.setSessions(100);
+    // Потоки занимают места одновременно: вместе — ровно до предела
+    std::vector<std::thread> threads;
+    std::atomic<int> granted{0};
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) granted += admission.reserveSession();
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(granted.load(), 900);
+    EXPECT_EQ(admission.sessions(), 1000u);
+    EXPECT_FALSE(admission.reserveSession());
+    admission.releaseSessions(2);
+    EXPECT_TRUE(admission.reserveSession());
+    EXPECT_TRUE(admission.reserveSession());
+    EXPECT_FALSE(admission.reserveSession());
+
+    AdmissionControl unlimited{OverloadOptions{}};
+    EXPECT_TRUE(unlimited.reserveSession());
+    unlimited.releaseSessions(5);
+    EXPECT_EQ(unlimited.sessions(), 0u);
+}
+
+TEST(OverloadTest, DetectorHysteresis) {
+    Clock::time_point t0 = Clock::time_point(std::chrono::seconds(100));
+    OverloadDetector off(0);
+    EXPECT_FALSE(off.update(1000000000, t0));
+    EXPECT_FALSE(off.overloaded());
+
+    OverloadDetector detector(10, std::chrono::seconds(1));
+    EXPECT_FALSE(detector.update(9000000, t0));
+    EXPECT_TRUE(detector.update(11000000, t0));
+    EXPECT_TRUE(detector.overloaded());
+    // Выше половины порога — выдержка начинается заново
+    EXPECT_FALSE(detector.update(6000000, t0 + std::chrono::milliseconds(500)));
+    EXPECT_FALSE(detector.update(4000000, t0 + std::chrono::milliseconds(1400)));
+    EXPECT_TRUE(detector.overloaded());
+    EXPECT_TRUE(detector.update(4000000, t0 + std::chrono::milliseconds(1500)));
+    EXPECT_FALSE(detector.overloaded());
+}
+
+// Обработчик с заданными ограничениями; IMSI отправляются пакетом
+class OverloadHandlerTest : public ::testing::Test {
+protected:
+    void start(const OverloadOptions& options) {
+        CdrWriterOptions cdr_options;
+        cdr_options.path = cdr_path_;
+        cdr_ = std::make_unique<CdrWriter>(cdr_options);
+        cdr_->start();
+        admission_ = std::make_unique<AdmissionControl>(options);
+        handler_ = std::make_unique<RequestHandler>(sessions_, *cdr_, blacklist_, *admission_, metrics_, 0);
+    }
+
+    void TearDown() override {
+        handler_.reset();
+        if (cdr_) cdr_->stop();
+        std::remove(cdr_path_.c_str());
+    }
+
+    // rx_age_ms — сколько датаграммы "ждали" в очереди сокета
+    std::vector<std::string> send(const std::vector<std::string>& imsis, int rx_age_ms = 0) {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        int64_t rx_ns = int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec - int64_t(rx_age_ms) * 1000000;
+        std::vector<std::array<uint8_t, kImsiBcdSize>> bcd(imsis.size());
+        std::vector<Datagram> datagrams(imsis.size());
+        for (size_t i = 0; i < imsis.size(); ++i) {
+            Imsi imsi;
+            parseImsi(imsis[i].data(), imsis[i].size(), imsi);
+            encodeImsiBcd(imsi, bcd[i].data());
+            datagrams[i] = Datagram{bcd[i].data(), bcd[i].size(), false, &from_, rx_ns};
+        }
+        std::vector<Reply> replies(imsis.size());
+        handler_->handle(datagrams.data(), datagrams.size(), replies.data());
+        std::vector<std::string> out;
+        for (const Reply& reply : replies) out.emplace_back(reinterpret_cast<const char*>(reply.data), reply.size);
+        return out;
+    }
+
+    const std::string cdr_path_ = "test_overload_cdr.log";
+    SessionTable sessions_{4, 16, std::chrono::seconds(30)};
+    BlacklistHolder blacklist_{std::make_shared<const Blacklist>()};
+    WorkerMetrics metrics_;
+    sockaddr_in from_{};
+    std::unique_ptr<CdrWriter> cdr_;
+    std::unique_ptr<AdmissionControl> admission_;
+    std::unique_ptr<RequestHandler> handler_;
+};
+
+TEST_F(OverloadHandlerTest, RepeatedImsiKeepsArrivalOrder) {
+    start(OverloadOptions{});
+    // Каждый IMSI дважды в одном пакете, вперемешку по шардам: ответы
+    // и записи CDR — в порядке датаграмм при любой группировке по шардам
+    std::vector<std::string> imsis, expected;
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 32; ++i) {
+            int n = round == 0 ? i : 31 - i;
+            imsis.push_back("0010100000000" + std::to_string(10 + n));
+            expected.push_back(round == 0 ? "created" : "refresh");
+        }
+    }
+    EXPECT_EQ(send(imsis), expected);
+    cdr_->stop();
+    std::ifstream in(cdr_path_);
+    std::vector<std::string> events;
+    for (std::string line; std::getline(in, line);) events.push_back(line.substr(line.find(',') + 1));
+    ASSERT_EQ(events.size(), 64u);
+    for (int n = 0; n < 32; ++n) {
+        std::string imsi = "0010100000000" + std::to_string(10 + n);
+        auto create = std::find(events.begin(), events.end(), imsi + ",create");
+        auto renew = std::find(events.begin(), events.end(), imsi + ",renew");
+        ASSERT_NE(create, events.end()) << imsi;
+        EXPECT_LT(create, renew) << imsi;
+    }
+}
+
+TEST_F(OverloadHandlerTest, MaxSessions) {
+    OverloadOptions options;
+    options.max_sessions = 2;
+    start(options);
+    EXPECT_EQ(send({"001010000000001", "001010000000002", "001010000000003"}),
+              (std::vector<std::string>{"created", "created", "busy"}));
+    // Существующие сессии обновляются и при достигнутом пределе
+    EXPECT_EQ(send({"001010000000001", "001010000000004"}), (std::vector<std::string>{"refresh", "busy"}));
+    EXPECT_EQ(metrics_.shed_capacity.load(), 2u);
+    EXPECT_EQ(sessions_.size(), 2u);
+}
+
+TEST_F(OverloadHandlerTest, MaxSessionsAcrossWorkers) {
+    OverloadOptions options;
+    options.max_sessions = 3;
+    start(options);
+    // Второй UDP-поток с тем же допуском: предел общий, а не на поток
+    WorkerMetrics other_metrics;
+    RequestHandler other(sessions_, *cdr_, blacklist_, *admission_, other_metrics, 0);
+    EXPECT_EQ(send({"001010000000001", "001010000000002"}), (std::vector<std::string>{"created", "created"}));
+    std::vector<std::string> imsis = {"001010000000003", "001010000000004"};
+    std::vector<std::array<uint8_t, kImsiBcdSize>> bcd(imsis.size());
+    std::vector<Datagram> datagrams(imsis.size());
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        Imsi imsi;
+        parseImsi(imsis[i].data(), imsis[i].size(), imsi);
+        encodeImsiBcd(imsi, bcd[i].data());
+        datagrams[i] = Datagram{bcd[i].data(), bcd[i].size(), false, &from_, 0};
+    }
+    std::vector<Reply> replies(imsis.size());
+    other.handle(datagrams.data(), datagrams.size(), replies.data());
+    EXPECT_EQ(other_metrics.created.load(), 1u);
+    EXPECT_EQ(other_metrics.shed_capacity.load(), 1u);
+    EXPECT_EQ(sessions_.size(), 3u);
+    // Удалённые сессии освобождают места
+    admission_->releaseSessions(1);
+    EXPECT_EQ(send({"001010000000005"}), (std::vector<std::string>{"created"}));
+}
+
+TEST_F(OverloadHandlerTest, NewSessionRate) {
+    OverloadOptions options;
+    options.new_session_rate = 1;
+    options.new_session_burst = 2;
+    start(options);
+    EXPECT_EQ(send({"001010000000001", "001010000000002", "001010000000003", "001010000000001"}),
+              (std::vector<std::string>{"created", "created", "busy", "refresh"}));
+    EXPECT_EQ(metrics_.shed_rate.load(), 1u);
+    EXPECT_EQ(metrics_.created.load(), 2u);
+}
+
+TEST_F(OverloadHandlerTest, QueueDelay) {
+    OverloadOptions options;
+    options.queue_delay_ms = 50;
+    start(options);
+    EXPECT_EQ(send({"001010000000001"}), (std::vector<std::string>{"created"}));
+    // Пакет простоял в очереди 200 мс: новые сессии — "busy", обновления проходят
+    EXPECT_EQ(send({"001010000000002", "001010000000001"}, 200), (std::vector<std::string>{"busy", "refresh"}));
+    EXPECT_EQ(metrics_.overloaded.load(), 1u);
+    EXPECT_EQ(metrics_.shed_queue.load(), 1u);
+    // Очередь разобрана, но перегрузка снимается только после выдержки
+    EXPECT_EQ(send({"001010000000002"}), (std::vector<std::string>{"busy"}));
+    EXPECT_EQ(metrics_.overloaded.load(), 1u);
+    HistogramSnapshot delay;
+    metrics_.queue_delay.mergeInto(delay);
+    EXPECT_EQ(delay.count, 4u);
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "../src/common/protocol.h"
+#include <vector>
+
+TEST(ProtocolTest, HeaderRoundTrip) {
+    std::vector<uint8_t> request(kBatchHeaderSize + 3 * kImsiBcdSize, 0x11);
+    writeBatchHeader(3, 0x01020304, request.data());
+    EXPECT_EQ(request[0], 'P');
+    EXPECT_EQ(request[1], 'B');
+    EXPECT_EQ(request[2], kBatchVersion);
+    EXPECT_EQ(request[3], 3);
+    EXPECT_EQ(request[4], 0x01);
+    EXPECT_EQ(request[7], 0x04);
+    BatchHeader hdr;
+    ASSERT_TRUE(parseBatchRequest(request.data(), request.size(), hdr));
+    EXPECT_EQ(hdr.count, 3);
+    EXPECT_EQ(hdr.seq, 0x01020304u);
+}
+
+TEST(ProtocolTest, RejectsMalformedRequests) {
+    std::vector<uint8_t> request(kBatchHeaderSize + 2 * kImsiBcdSize, 0x11);
+    writeBatchHeader(2, 1, request.data());
+    BatchHeader hdr;
+    // Длина не совпадает с числом IMSI
+    EXPECT_FALSE(parseBatchRequest(request.data(), request.size() - 1, hdr));
+    EXPECT_FALSE(parseBatchRequest(request.data(), kImsiBcdSize, hdr));
+    // Чужая сигнатура и версия
+    request[0] = 'X';
+    EXPECT_FALSE(parseBatchRequest(request.data(), request.size(), hdr));
+    request[0] = 'P';
+    request[2] = kBatchVersion + 1;
+    EXPECT_FALSE(parseBatchRequest(request.data(), request.size(), hdr));
+    // Пустой пакет и больше kMaxBatchImsis
+    writeBatchHeader(0, 1, request.data());
+    EXPECT_FALSE(parseBatchRequest(request.data(), kBatchHeaderSize, hdr));
+    std::vector<uint8_t> big(kBatchHeaderSize + (kMaxBatchImsis + 1) * kImsiBcdSize, 0x11);
+    writeBatchHeader(static_cast<uint8_t>(kMaxBatchImsis + 1), 1, big.data());
+    EXPECT_FALSE(parseBatchRequest(big.data(), big.size(), hdr));
+    std::vector<uint8_t> max(kMaxBatchRequest, 0x11);
+    writeBatchHeader(static_cast<uint8_t>(kMaxBatchImsis), 1, max.data());
+    EXPECT_TRUE(parseBatchRequest(max.data(), max.size(), hdr));
+}
+
+TEST(ProtocolTest, ParseReply) {
+    uint8_t reply[kBatchHeaderSize + 4];
+    writeBatchHeader(4, 42, reply);
+    reply[8] = static_cast<uint8_t>(ImsiStatus::Created);
+    reply[9] = static_cast<uint8_t>(ImsiStatus::Refreshed);
+    reply[10] = static_cast<uint8_t>(ImsiStatus::Busy);
+    reply[11] = static_cast<uint8_t>(ImsiStatus::Invalid);
+    BatchHeader hdr;
+    ASSERT_TRUE(parseBatchReply(reply, sizeof(reply), hdr));
+    EXPECT_EQ(hdr.count, 4);
+    EXPECT_EQ(hdr.seq, 42u);
+    EXPECT_FALSE(parseBatchReply(reply, sizeof(reply) - 1, hdr));
+    reply[11] = 5;   // неизвестный код
+    EXPECT_FALSE(parseBatchReply(reply, sizeof(reply), hdr));
+}
+
+TEST(ProtocolTest, StatusNames) {
+    EXPECT_STREQ(imsiStatusName(ImsiStatus::Created), "created");
+    EXPECT_STREQ(imsiStatusName(ImsiStatus::Refreshed), "refresh");
+    EXPECT_STREQ(imsiStatusName(ImsiStatus::Rejected), "rejected");
+    EXPECT_STREQ(imsiStatusName(ImsiStatus::Busy), "busy");
+    EXPECT_STREQ(imsiStatusName(ImsiStatus::Invalid), "invalid");
+}
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include "../src/server/session_snapshot.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using Clock = SessionTable::Clock;
+using std::chrono::seconds;
+
+// Ключи в формате упакованного IMSI: младший полубайт — заполнитель 0xF
+static uint64_t makeKey(uint64_t n) {
+    return (n << 4) | 0x0F;
+}
+
+static int64_t wallNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TEST(SessionSnapshotTest, RoundTripKeepsRemainingTtl) {
+    const std::string path = "test_sessions.snap";
+    SessionTable table(8, 1000, seconds(30));
+    auto now = Clock::now();
+    for (uint64_t i = 1; i <= 1000; ++i) table.touch(makeKey(i), now);
+    EXPECT_EQ(writeSessionSnapshot(table, path), 1000u);
+
+    SessionTable restored(4, 10, seconds(30));
+    EXPECT_EQ(loadSessionSnapshot(restored, path), 1000u);
+    std::remove(path.c_str());
+    EXPECT_EQ(restored.size(), 1000u);
+    for (uint64_t i = 1; i <= 1000; ++i) ASSERT_TRUE(restored.contains(makeKey(i)));
+
+    // Срок не продлевается: через таймаут все сессии истекают
+    std::vector<uint64_t> expired;
+    restored.expire(Clock::now() + seconds(10), expired);
+    EXPECT_TRUE(expired.empty());
+    restored.expire(Clock::now() + seconds(32), expired);
+    EXPECT_EQ(expired.size(), 1000u);
+}
+
+TEST(SessionSnapshotTest, SkipsExpiredAndClampsToTimeout) {
+    const std::string path = "test_sessions_manual.snap";
+    int64_t now_ms = wallNowMs();
+    SnapshotRecord records[3] = {
+        {makeKey(1), now_ms - 60000, now_ms - 1000},     // истекла, пока сервер стоял
+        {makeKey(2), now_ms - 5000, now_ms + 5000},
+        {makeKey(3), now_ms - 5000, now_ms + 3600000},   // таймаут с тех пор уменьшили
+    };
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.record_size = sizeof(SnapshotRecord);
+    header.count = 3;
+    header.checksum = snapshotChecksum(records, 3);
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records), sizeof(records));
+    }
+    SessionTable table(4, 10, seconds(30));
+    EXPECT_EQ(loadSessionSnapshot(table, path), 2u);
+    std::remove(path.c_str());
+    EXPECT_FALSE(table.contains(makeKey(1)));
+    std::vector<uint64_t> expired;
+    table.expire(Clock::now() + seconds(7), expired);
+    EXPECT_EQ(expired, std::vector<uint64_t>{makeKey(2)});
+    table.expire(Clock::now() + seconds(32), expired);
+    EXPECT_EQ(expired.size(), 2u);
+}
+
+TEST(SessionSnapshotTest, RejectsCorruptedSnapshot) {
+    const std::string path = "test_sessions_corrupt.snap";
+    SessionTable table(2, 10, seconds(30));
+    table.touch(makeKey(1), Clock::now());
+    table.touch(makeKey(2), Clock::now());
+    writeSessionSnapshot(table, path);
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(sizeof(SnapshotHeader) + 3);
+        f.put('\x5a');
+    }
+    SessionTable restored(2, 10, seconds(30));
+    EXPECT_THROW(loadSessionSnapshot(restored, path), std::runtime_error);
+    EXPECT_EQ(restored.size(), 0u);
+    std::remove(path.c_str());
+    EXPECT_EQ(loadSessionSnapshot(restored, path), 0u);
+}
@@ -0,0 +1,269 @@
+#include <gtest/gtest.h>
+#include "../src/server/session_table.h"
+#include <random>
+#include <set>
+#include <atomic>
+#include <thread>
+
+using Clock = SessionTable::Clock;
+using std::chrono::seconds;
+
+// Ключи в формате упакованного IMSI: младший полубайт — заполнитель 0xF
+static uint64_t makeKey(uint64_t n) {
+    return (n << 4) | 0x0F;
+}
+
+TEST(SessionTableTest, CreateThenRefresh) {
+    SessionTable table(4, 100, seconds(30));
+    auto now = Clock::now();
+    EXPECT_EQ(table.touch(makeKey(1), now), SessionTable::TouchResult::Created);
+    EXPECT_EQ(table.touch(makeKey(1), now), SessionTable::TouchResult::Refreshed);
+    EXPECT_TRUE(table.contains(makeKey(1)));
+    EXPECT_FALSE(table.contains(makeKey(2)));
+    EXPECT_EQ(table.size(), 1u);
+}
+
+TEST(SessionTableTest, EraseKeepsOtherKeysReachable) {
+    // Один шард и маленькая ёмкость: много коллизий и сдвигов при удалении
+    SessionTable table(1, 8, seconds(30));
+    auto now = Clock::now();
+    std::mt19937_64 rng(42);
+    std::set<uint64_t> keys;
+    while (keys.size() < 2000) keys.insert(makeKey(rng() >> 8));
+    for (uint64_t k : keys) table.touch(k, now);
+    EXPECT_EQ(table.size(), keys.size());
+
+    size_t i = 0;
+    std::set<uint64_t> kept;
+    for (uint64_t k : keys) {
+        if (i++ % 2) {
+            EXPECT_TRUE(table.erase(k));
+        } else {
+            kept.insert(k);
+        }
+    }
+    EXPECT_EQ(table.size(), kept.size());
+    for (uint64_t k : keys) EXPECT_EQ(table.contains(k), kept.count(k) > 0);
+}
+
+TEST(SessionTableTest, ExpireRemovesOnlyStaleSessions) {
+    SessionTable table(8, 100, seconds(10));
+    auto start = Clock::now();
+    for (uint64_t n = 0; n < 100; ++n) table.touch(makeKey(n), start);
+    // половину сессий обновляем позже — они переезжают в другую корзину колеса
+    for (uint64_t n = 0; n < 50; ++n) table.touch(makeKey(n), start + seconds(5));
+
+    std::vector<uint64_t> expired;
+    EXPECT_EQ(table.expire(start + seconds(9), expired), 0u);
+    EXPECT_EQ(table.expire(start + seconds(12), expired), 50u);
+    EXPECT_EQ(expired.size(), 50u);
+    for (uint64_t key : expired) EXPECT_GE(key >> 4, 50u);
+    EXPECT_EQ(table.size(), 50u);
+
+    expired.clear();
+    EXPECT_EQ(table.expire(start + seconds(17), expired), 50u);
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(SessionTableTest, ExpireSurvivesRelocationAndGrowth) {
+    // Маленькая таблица растёт и сдвигает записи при удалении,
+    // списки колеса должны оставаться согласованными
+    SessionTable table(1, 8, seconds(4));
+    auto start = Clock::now();
+    std::mt19937_64 rng(7);
+    std::set<uint64_t> keys;
+    while (keys.size() < 3000) keys.insert(makeKey(rng() >> 8));
+    size_t i = 0;
+    for (uint64_t k : keys) table.touch(k, start + seconds(i++ % 3));
+    i = 0;
+    for (uint64_t k : keys) {
+        if (i++ % 5 == 0) table.erase(k);
+    }
+    size_t remaining = table.size();
+
+    std::vector<uint64_t> expired;
+    table.expire(start + seconds(60), expired);
+    EXPECT_EQ(expired.size(), remaining);
+    EXPECT_EQ(table.size(), 0u);
+    std::set<uint64_t> unique(expired.begin(), expired.end());
+    EXPECT_EQ(unique.size(), expired.size());
+}
+
+TEST(SessionTableTest, DrainRemovesAtMostRequested) {
+    SessionTable table(4, 10, seconds(30));
+    auto now = Clock::now();
+    for (uint64_t n = 0; n < 25; ++n) table.touch(makeKey(n), now);
+    std::vector<uint64_t> out;
+    EXPECT_EQ(table.drain(10, out), 10u);
+    EXPECT_EQ(table.size(), 15u);
+    EXPECT_EQ(table.drain(100, out), 15u);
+    EXPECT_EQ(out.size(), 25u);
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(SessionTableTest, DrainShardInParts) {
+    SessionTable table(4, 400, seconds(30));
+    auto now = Clock::now();
+    for (uint64_t n = 0; n < 1000; ++n) table.touch(makeKey(n), now);
+    std::vector<SessionTable::Session> out;
+    for (size_t shard = 0; shard < table.shardCount(); ++shard) {
+        // частями по 7: каждая продолжает с места предыдущей
+        while (table.drainShard(shard, 7, out) == 7) {}
+        EXPECT_EQ(table.drainShard(shard, 7, out), 0u);
+    }
+    EXPECT_EQ(table.size(), 0u);
+    ASSERT_EQ(out.size(), 1000u);
+    std::set<uint64_t> unique;
+    for (const auto& s : out) {
+        unique.insert(s.imsi);
+        EXPECT_FALSE(table.contains(s.imsi));
+    }
+    EXPECT_EQ(unique.size(), 1000u);
+
+    // Сессия, вставленная в уже пройденный слот, находится вторым проходом
+    table.touch(makeKey(5), now);
+    EXPECT_EQ(table.drainShard(table.shardOf(makeKey(5)), 10, out), 1u);
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST(SessionTableTest, RenewCoalescing) {
+    SessionTable table(4, 100, seconds(300));
+    table.setRenewWindow(seconds(60));
+    const uint64_t key = makeKey(7);
+    auto start = Clock::now();
+    EXPECT_EQ(table.touch(key, start), SessionTable::TouchResult::Created);
+    // Первое обновление пишется и открывает окно
+    EXPECT_EQ(table.touch(key, start + seconds(1)), SessionTable::TouchResult::Refreshed);
+    EXPECT_EQ(table.touch(key, start + seconds(2)), SessionTable::TouchResult::Coalesced);
+    EXPECT_EQ(table.touch(key, start + seconds(3)), SessionTable::TouchResult::Coalesced);
+    // Окно прошло: обновление пишется и уносит счётчик прошлого окна
+    uint32_t renews = 0;
+    SessionTable::TouchResult result;
+    table.withShard(table.shardOf(key), [&](SessionTable::Shard& s) {
+        result = s.touch(key, start + seconds(61), &renews);
+    });
+    EXPECT_EQ(result, SessionTable::TouchResult::Refreshed);
+    EXPECT_EQ(renews, 2u);
+    EXPECT_EQ(table.touch(key, start + seconds(62)), SessionTable::TouchResult::Coalesced);
+
+    // Остаток счётчика и время последнего обновления — в удалённой записи
+    std::vector<SessionTable::Session> expired;
+    EXPECT_EQ(table.expire(start + seconds(62 + 300 + 2), expired), 1u);
+    ASSERT_EQ(expired.size(), 1u);
+    EXPECT_EQ(expired[0].imsi, key);
+    EXPECT_EQ(expired[0].renews, 1u);
+    EXPECT_EQ(table.lastSeen(expired[0]), start + seconds(62));
+
+    // Без окна каждое обновление — Refreshed
+    SessionTable plain(4, 100, seconds(300));
+    EXPECT_FALSE(plain.coalescesRenews());
+    plain.touch(key, start);
+    EXPECT_EQ(plain.touch(key, start + seconds(1)), SessionTable::TouchResult::Refreshed);
+}
+
+TEST(SessionTableTest, FirstRenewAfterCreateIsRecorded) {
+    SessionTable table(4, 100, seconds(300));
+    table.setRenewWindow(seconds(60));
+    const uint64_t key = makeKey(8);
+    auto start = Clock::now();
+    uint32_t renews = 7;
+    SessionTable::TouchResult created, renewed;
+    table.withShard(table.shardOf(key), [&](SessionTable::Shard& s) {
+        created = s.touch(key, start, &renews);
+        renewed = s.touch(key, start, &renews);
+    });
+    // renew в ту же секунду, что и create, не теряется; до него считать нечего
+    EXPECT_EQ(created, SessionTable::TouchResult::Created);
+    EXPECT_EQ(renewed, SessionTable::TouchResult::Refreshed);
+    EXPECT_EQ(renews, 0u);
+    EXPECT_EQ(table.touch(key, start + seconds(59)), SessionTable::TouchResult::Coalesced);
+
+    // Восстановленная из снимка сессия тоже начинает без окна
+    SessionTable restored(4, 100, seconds(300));
+    restored.setRenewWindow(seconds(60));
+    ASSERT_TRUE(restored.insert(key, start, start + seconds(300)));
+    EXPECT_EQ(restored.touch(key, Clock::now()), SessionTable::TouchResult::Refreshed);
+    EXPECT_EQ(restored.touch(key, Clock::now()), SessionTable::TouchResult::Coalesced);
+}
+
+TEST(SessionTableTest, LockFreeReadsDuringWritesAndGrowth) {
+    // Один шард с маленькой ёмкостью: писатель постоянно сдвигает записи
+    // и несколько раз увеличивает массив, пока читатели ищут ключи
+    SessionTable table(1, 8, seconds(30));
+    auto now = Clock::now();
+    const uint64_t kStable = 500;
+    for (uint64_t i = 1; i <= kStable; ++i) table.touch(makeKey(i), now);
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> misses{0}, phantoms{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&, r]() {
+            uint64_t i = static_cast<uint64_t>(r);
+            while (!stop.load(std::memory_order_relaxed)) {
+                ++i;
+                if (!table.contains(makeKey(1 + i % kStable))) misses.fetch_add(1);
+                if (table.contains(makeKey(1000000 + i % 1000))) phantoms.fetch_add(1);
+                SessionTable::Session s;
+                if (table.lookup(makeKey(1 + i % kStable), s) && s.imsi != makeKey(1 + i % kStable))
+                    misses.fetch_add(1);
+            }
+        });
+    }
+    for (uint64_t round = 0; round < 20; ++round) {
+        for (uint64_t i = 0; i < 5000; ++i) table.touch(makeKey(10000 + round * 5000 + i), now);
+        for (uint64_t i = 0; i < 5000; ++i) table.erase(makeKey(10000 + round * 5000 + i));
+        for (uint64_t i = 1; i <= kStable; i += 7) table.touch(makeKey(i), now);
+    }
+    stop = true;
+    for (auto& t : readers) t.join();
+    EXPECT_EQ(misses.load(), 0u);
+    EXPECT_EQ(phantoms.load(), 0u);
+    EXPECT_EQ(table.size(), kStable);
+}
+
+TEST(SessionTableTest, LookupBatchKeepsInputOrder) {
+    SessionTable table(8, 1000, seconds(30));
+    auto now = Clock::now();
+    for (uint64_t i = 1; i <= 1000; i += 2) table.touch(makeKey(i), now);
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 1000; i >= 1; --i) keys.push_back(makeKey(i));
+    keys.push_back(0);
+    std::vector<SessionTable::Session> found;
+    table.lookupBatch(keys, found);
+    ASSERT_EQ(found.size(), keys.size());
+    for (size_t i = 0; i + 1 < keys.size(); ++i) {
+        bool odd = ((keys[i] >> 4) & 1) != 0;
+        EXPECT_EQ(found[i].imsi, odd ? keys[i] : 0u);
+        if (odd) {
+            EXPECT_EQ(found[i].expires_at, now + seconds(30));
+        }
+    }
+    EXPECT_EQ(found.back().imsi, 0u);
+}
+
+TEST(SessionTableTest, ScanVisitsEverySessionOnce) {
+    SessionTable table(8, 100, seconds(30));
+    auto now = Clock::now();
+    for (uint64_t i = 1; i <= 5000; ++i) table.touch(makeKey(i), now);
+    std::vector<SessionTable::Session> out;
+    uint64_t cursor = 0;
+    size_t steps = 0;
+    do {
+        size_t before = out.size();
+        cursor = table.scan(cursor, 100, out);
+        EXPECT_LE(out.size() - before, 100u);
+        ++steps;
+    } while (cursor != 0);
+    EXPECT_GT(steps, 8u);
+    std::set<uint64_t> seen;
+    for (const auto& s : out) seen.insert(s.imsi);
+    EXPECT_EQ(out.size(), 5000u);
+    EXPECT_EQ(seen.size(), 5000u);
+
+    SessionTable empty(4, 10, seconds(30));
+    out.clear();
+    cursor = 0;
+    do { cursor = empty.scan(cursor, 1000, out); } while (cursor != 0);
+    EXPECT_TRUE(out.empty());
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "shutdown_drain.h"
+#include <set>
+
+using Clock = ShutdownDrain::Clock;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+// Ключи в формате упакованного IMSI: младший полубайт — заполнитель 0xF
+static uint64_t makeKey(uint64_t n) {
+    return (n << 4) | 0x0F;
+}
+
+static void fill(SessionTable& table, size_t count) {
+    auto now = Clock::now();
+    for (uint64_t n = 0; n < count; ++n) table.touch(makeKey(n), now);
+}
+
+TEST(ShutdownDrainTest, MeetsRateEveryStep) {
+    SessionTable table(4, 1000, seconds(3600));
+    fill(table, 1000);
+    ShutdownDrain drain(table, 200);
+    EXPECT_EQ(drain.period(), milliseconds(5));
+
+    auto t0 = Clock::now();
+    drain.start(t0);
+    std::vector<SessionTable::Session> out;
+    // Шаги с неровными интервалами: к моменту t удалено ровно floor(rate * t)
+    auto now = t0;
+    for (int i = 1; i <= 100; ++i) {
+        now += milliseconds(i % 2 ? 3 : 7);
+        drain.step(now, out);
+        auto ms = std::chrono::duration_cast<milliseconds>(now - t0).count();
+        ASSERT_EQ(out.size(), static_cast<size_t>(ms / 5)) << "at " << ms << " ms";
+    }
+    EXPECT_EQ(out.size(), 100u);
+
+    DrainProgress p = drain.progress(now);
+    EXPECT_TRUE(p.started);
+    EXPECT_FALSE(p.finished);
+    EXPECT_EQ(p.total, 1000u);
+    EXPECT_EQ(p.removed, 100u);
+    EXPECT_EQ(p.remaining, 900u);
+    EXPECT_DOUBLE_EQ(p.elapsed_sec, 0.5);
+    EXPECT_DOUBLE_EQ(p.eta_sec, 4.5);
+}
+
+TEST(ShutdownDrainTest, StallDoesNotBurst) {
+    SessionTable table(4, 1000, seconds(3600));
+    fill(table, 1000);
+    ShutdownDrain drain(table, 200);
+    auto t0 = Clock::now();
+    drain.start(t0);
+    std::vector<SessionTable::Session> out;
+    // Поток стоял 10 с: догоняются не больше двух шагов
+    EXPECT_EQ(drain.step(t0 + seconds(10), out), 2u);
+    EXPECT_EQ(drain.step(t0 + seconds(10) + milliseconds(5), out), 1u);
+}
+
+TEST(ShutdownDrainTest, DrainsAllShardsInBatches) {
+    SessionTable table(64, 100000, seconds(3600));
+    fill(table, 100000);
+    ShutdownDrain drain(table, 1000000);
+    EXPECT_EQ(drain.period(), milliseconds(1));
+
+    auto t0 = Clock::now();
+    drain.start(t0);
+    std::vector<SessionTable::Session> out;
+    auto now = t0;
+    while (!drain.finished()) {
+        now += drain.period();
+        size_t removed = drain.step(now, out);
+        if (!drain.finished()) {
+            ASSERT_EQ(removed, 1000u);
+        }
+    }
+    EXPECT_EQ(now - t0, milliseconds(100));
+    EXPECT_EQ(table.size(), 0u);
+    std::set<uint64_t> unique;
+    for (const auto& s : out) unique.insert(s.imsi);
+    EXPECT_EQ(unique.size(), 100000u);
+
+    DrainProgress p = drain.progress(now + seconds(5));
+    EXPECT_TRUE(p.finished);
+    EXPECT_EQ(p.removed, 100000u);
+    EXPECT_EQ(p.remaining, 0u);
+    EXPECT_DOUBLE_EQ(p.elapsed_sec, 0.1);
+    EXPECT_DOUBLE_EQ(p.eta_sec, 0.0);
+    EXPECT_EQ(drain.step(now + seconds(1), out), 0u);
+}
+
+TEST(ShutdownDrainTest, EmptyTableFinishesAtStart) {
+    SessionTable table(4, 10, seconds(3600));
+    ShutdownDrain drain(table, 10);
+    EXPECT_EQ(drain.period(), milliseconds(100));
+    EXPECT_FALSE(drain.progress(Clock::now()).started);
+    drain.start(Clock::now());
+    EXPECT_TRUE(drain.finished());
+}
@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include "udp_loop.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static Imsi imsiOf(const char* digits) {
+    Imsi imsi;
+    parseImsi(digits, 15, imsi);
+    return imsi;
+}
+
+static std::string bcdOf(const char* digits) {
+    uint8_t bcd[kImsiBcdSize];
+    encodeImsiBcd(imsiOf(digits), bcd);
+    return std::string(reinterpret_cast<const char*>(bcd), sizeof(bcd));
+}
+
+// Прогон одного способа приёма: сервер на 127.0.0.1 с чёрным списком из
+// одного IMSI, клиент отправляет запросы по одному и собирает ответы
+// ("" — ответа нет за 200 мс). used_uring = false, если io_uring недоступен.
+static std::vector<std::string> runBackend(UdpBackend backend, const std::vector<std::string>& requests,
+                                           bool& used_uring) {
+    const std::string cdr_path = "test_udp_backends_cdr.log";
+    CdrWriterOptions cdr_options;
+    cdr_options.path = cdr_path;
+    CdrWriter cdr(cdr_options);
+    cdr.start();
+    SessionTable sessions(4, 16, std::chrono::seconds(30));
+    BlacklistHolder blacklist(std::make_shared<const Blacklist>(
+        std::vector<uint64_t>{imsiOf("001010000000666").packed}, true));
+    AdmissionControl admission(OverloadOptions{});
+    WorkerMetrics metrics;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    socklen_t len = sizeof(addr);
+    getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+
+    std::atomic<bool> stop{false};
+    int shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    UdpLoopOptions options;
+    options.sock = sock;
+    options.shutdown_fd = shutdown_fd;
+    options.stop = &stop;
+    options.batch_size = 8;
+    used_uring = false;
+    std::thread worker([&]() {
+        RequestHandler handler(sessions, cdr, blacklist, admission, metrics, 0);
+        if (backend == UdpBackend::IoUring) {
+            std::string error;
+            used_uring = runUringLoop(options, handler, metrics, error);
+            if (used_uring) return;
+        }
+        runSocketLoop(options, handler, metrics);
+    });
+
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    std::vector<std::string> replies;
+    for (const std::string& request : requests) {
+        sendto(client, request.data(), request.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        pollfd pfd{client, POLLIN, 0};
+        char buf[kMaxReply];
+        ssize_t n = poll(&pfd, 1, 200) > 0 ? recv(client, buf, sizeof(buf), 0) : 0;
+        replies.emplace_back(buf, n > 0 ? static_cast<size_t>(n) : 0);
+    }
+
+    stop = true;
+    uint64_t one = 1;
+    EXPECT_EQ(write(shutdown_fd, &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    worker.join();
+    close(client);
+    close(shutdown_fd);
+    close(sock);
+    cdr.stop();
+    std::remove(cdr_path.c_str());
+
+    EXPECT_EQ(metrics.created.load(), 3u);
+    EXPECT_EQ(metrics.refreshed.load(), 2u);
+    EXPECT_EQ(metrics.rejected.load(), 2u);
+    EXPECT_EQ(metrics.size_errors.load(), 2u);
+    EXPECT_EQ(metrics.decode_errors.load(), 2u);
+    EXPECT_EQ(metrics.batch_datagrams.load(), 1u);
+    EXPECT_EQ(metrics.batch_imsis.load(), 4u);
+    // Системные вызовы отправки в обоих режимах: sendmmsg или io_uring_enter с ответами
+    EXPECT_GT(metrics.tx_syscalls.load(), 0u);
+    EXPECT_LE(metrics.tx_syscalls.load(), metrics.tx_packets.load());
+    return replies;
+}
+
+// Пакетный запрос (protocol.h) из готовых 8-байтовых BCD
+static std::string batchOf(uint32_t seq, const std::vector<std::string>& bcds) {
+    std::string out(kBatchHeaderSize, '\0');
+    writeBatchHeader(static_cast<uint8_t>(bcds.size()), seq, reinterpret_cast<uint8_t*>(&out[0]));
+    for (const std::string& bcd : bcds) out += bcd;
+    return out;
+}
+
+static std::string batchReplyOf(uint32_t seq, const std::vector<ImsiStatus>& statuses) {
+    std::string out(kBatchHeaderSize, '\0');
+    writeBatchHeader(static_cast<uint8_t>(statuses.size()), seq, reinterpret_cast<uint8_t*>(&out[0]));
+    for (ImsiStatus status : statuses) out += static_cast<char>(status);
+    return out;
+}
+
+static const std::string kNotBcd("\x1A\x00\x00\x00\x00\x00\x00\x0F", 8);
+
+static std::vector<std::string> testRequests() {
+    return {
+        bcdOf("001010000000001"),
+        bcdOf("001010000000001"),
+        bcdOf("001010000000666"),
+        std::string("\x00\x01\x02", 3),                             // короткая датаграмма
+        std::string(kMaxDatagram + 100, '\x11'),                    // длиннее буфера приёма
+        kNotBcd,
+        bcdOf("001010000000002"),
+        batchOf(7, {bcdOf("001010000000003"), bcdOf("001010000000666"), kNotBcd, bcdOf("001010000000001")}),
+    };
+}
+
+TEST(UdpBackendTest, SocketLoopReplies) {
+    bool used_uring = false;
+    std::vector<std::string> replies = runBackend(UdpBackend::Socket, testRequests(), used_uring);
+    std::vector<std::string> expected = {
+        "created", "refresh", "rejected", "", "", "", "created",
+        batchReplyOf(7, {ImsiStatus::Created, ImsiStatus::Rejected, ImsiStatus::Invalid, ImsiStatus::Refreshed}),
+    };
+    EXPECT_EQ(replies, expected);
+}
+
+TEST(UdpBackendTest, UringLoopMatchesSocketLoop) {
+    bool used_uring = false;
+    std::vector<std::string> uring = runBackend(UdpBackend::IoUring, testRequests(), used_uring);
+    if (!used_uring) GTEST_SKIP() << "io_uring is not available";
+    bool unused = false;
+    EXPECT_EQ(uring, runBackend(UdpBackend::Socket, testRequests(), unused));
+}
+
+// Ответ, который ядро не отправляет (датаграмма с портом отправителя 0 —
+// EINVAL), не мешает ответам на остальные датаграммы того же пакета
+TEST(UdpBackendTest, SocketLoopSkipsUnsendableReply) {
+    int raw = socket(AF_INET, SOCK_RAW, IPPROTO_UDP);
+    if (raw < 0) GTEST_SKIP() << "raw sockets are not available";
+    const std::string cdr_path = "test_udp_backends_skip_cdr.log";
+    CdrWriterOptions cdr_options;
+    cdr_options.path = cdr_path;
+    CdrWriter cdr(cdr_options);
+    cdr.start();
+    SessionTable sessions(4, 16, std::chrono::seconds(30));
+    BlacklistHolder blacklist(std::make_shared<const Blacklist>());
+    AdmissionControl admission(OverloadOptions{});
+    WorkerMetrics metrics;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    socklen_t len = sizeof(addr);
+    getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+
+    // Датаграммы лежат в очереди до запуска потока и приходят одним recvmmsg:
+    // первая — с портом отправителя 0, за ней три обычных клиента
+    std::string spoofed(sizeof(udphdr), '\0');
+    spoofed += bcdOf("001010000000010");
+    udphdr hdr{};
+    hdr.source = 0;
+    hdr.dest = addr.sin_port;
+    hdr.len = htons(static_cast<uint16_t>(spoofed.size()));
+    std::memcpy(&spoofed[0], &hdr, sizeof(hdr));
+    EXPECT_EQ(sendto(raw, spoofed.data(), spoofed.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)),
+              static_cast<ssize_t>(spoofed.size()));
+    close(raw);
+    int clients[3];
+    for (int i = 0; i < 3; ++i) {
+        clients[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        std::string request = bcdOf(("00101000000002" + std::to_string(i)).c_str());
+        sendto(clients[i], request.data(), request.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+
+    std::atomic<bool> stop{false};
+    int shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    UdpLoopOptions options;
+    options.sock = sock;
+    options.shutdown_fd = shutdown_fd;
+    options.stop = &stop;
+    options.batch_size = 8;
+    std::thread worker([&]() {
+        RequestHandler handler(sessions, cdr, blacklist, admission, metrics, 0);
+        runSocketLoop(options, handler, metrics);
+    });
+    for (int client : clients) {
+        pollfd pfd{client, POLLIN, 0};
+        char buf[kMaxReply];
+        ssize_t n = poll(&pfd, 1, 500) > 0 ? recv(client, buf, sizeof(buf), 0) : 0;
+        EXPECT_EQ(std::string(buf, n > 0 ? static_cast<size_t>(n) : 0), "created");
+        close(client);
+    }
+
+    stop = true;
+    uint64_t one = 1;
+    EXPECT_EQ(write(shutdown_fd, &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    worker.join();
+    close(shutdown_fd);
+    close(sock);
+    cdr.stop();
+    std::remove(cdr_path.c_str());
+
+    EXPECT_EQ(metrics.rx_syscalls.load(), 1u);
+    EXPECT_EQ(metrics.created.load(), 4u);
+    EXPECT_EQ(metrics.tx_errors.load(), 1u);
+    EXPECT_EQ(metrics.tx_packets.load(), 3u);
+}
+
+TEST(UdpBackendTest, ParseBackend) {
+    EXPECT_EQ(parseUdpBackend("socket"), UdpBackend::Socket);
+    EXPECT_EQ(parseUdpBackend("io_uring"), UdpBackend::IoUring);
+    EXPECT_THROW(parseUdpBackend("dpdk"), std::invalid_argument);
+}
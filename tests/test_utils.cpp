@@ -47,6 +47,19 @@ TEST(UtilsTest, RoundTripConversion) {
     EXPECT_EQ(result, imsi);
 }
 
+TEST(UtilsTest, ParseHostPort) {
+    std::string host;
+    int port = 0;
+    EXPECT_TRUE(parseHostPort("127.0.0.1:9000", host, port));
+    EXPECT_EQ(host, "127.0.0.1");
+    EXPECT_EQ(port, 9000);
+    EXPECT_FALSE(parseHostPort("127.0.0.1", host, port));
+    EXPECT_FALSE(parseHostPort("127.0.0.1:", host, port));
+    EXPECT_FALSE(parseHostPort("127.0.0.1:70000", host, port));
+    EXPECT_FALSE(parseHostPort("localhost:9000", host, port));
+    EXPECT_FALSE(parseHostPort("127.0.0.1:90a", host, port));
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();